@@ -46,8 +46,10 @@ static constexpr size_t kHugepageSize = (2 * 1024 * 1024);  ///< Hugepage size
 #define PERF_TEST_THR 1
 #define PERF_TEST_LAT_MIN_MAX 1
 #define PERT_TEST_MBUF_RANGE 1
-#define PERF_LAT_SAMPLE_STRIP 4096        // Sample once every 4096 packets
-#define PERF_LAT_SAMPLE_NUM 1024    // Sample 1024 packets
+#define PERF_LAT_BREAKDOWN 0    // 1: timestamp requests at the client dispatcher and the server to break down the latency
+#define PERF_STATS_HIST 0       // 1: record a log-linear histogram at every net_stats counter, 0: sums only
+#define PERF_HW_COUNTERS 0      // 1: count cycles, instructions, LLC, dTLB and branch misses of each phase with perf_event_open
+#define PERF_CYCLE_ACCOUNTING 1 // 1: time every phase and the pacing spin, so that all cycles of a workspace are accounted
 
 // optimized latency measurement
 #define PERF_LAT_USE_RDTSCP 1           // use RDTSCP to improve precision
@@ -135,8 +137,16 @@ static constexpr size_t kStatefulMemorySizePerCore  = KB(256);
 #define kRxPktHandler  kRxPktHandler_Empty
 
 // client specific
-#define EnableInflyMessageLimit true    // whether to enable infly message limit, if false, the client will send messages as fast as possible
-static constexpr uint64_t kInflyMessageBudget = 1024;
+#define EnableInflyMessageLimit true    // whether to enable credit-based flow control, if false, the client will send messages as fast as possible
+static constexpr uint32_t kInflyMessageBudget = 1024;  // default credit window of each remote dispatcher
+// open-loop client: a message generated this long after its scheduled time is counted as sent late
+static constexpr double kOpenLoopLateUs = 2.0;
+
+// server specific: an incomplete multi-packet message is dropped this long after its first segment
+static constexpr double kReassemblyTimeoutUs = 1000.0;
+
+// stats monitor (stats_interval): a running workspace publishes its counters this often
+static constexpr double kStatsPublishUs = 1000.0;
 
 /**
  * ----------------------OneStage modes----------------------
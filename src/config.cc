@@ -4,6 +4,9 @@
  */
 #include "config.h"
 #include "util/logger.h"
+#include "util/math_utils.h"
+#include <climits>
+#include <stdexcept>
 
 namespace dperf {
 
@@ -138,6 +141,18 @@ namespace dperf {
         memcpy(server_config_->device_name, config.second[0].c_str(), config.second[0].size());
         server_config_->device_name[config.second[0].size()] = '\0';
       }
+      else if (config.first == "control_socket") {
+        server_config_->control_socket = config.second[0];
+      }
+      else if (config.first == "stats_interval") {
+        server_config_->stats_interval_ms = std::stoi(config.second[0]);
+      }
+      else if (config.first == "result_file") {
+        server_config_->result_file = config.second[0];
+      }
+      else if (config.first == "stats_shm") {
+        server_config_->stats_shm = config.second[0];
+      }
       /// Axio tunable params
       else if (config.first == "kAppCoreNum") {
         tune_params_->kAppCoreNum = std::stoi(config.second[0]);
@@ -163,12 +178,309 @@ namespace dperf {
       else if (config.first == "kNICRxPostSize") {
         tune_params_->kNICRxPostSize = std::stoi(config.second[0]);
       }
+      else if (config.first == "kBatchTargetUs") {
+        tune_params_->kBatchTargetUs = std::stod(config.second[0]);
+        rt_assert(tune_params_->kBatchTargetUs >= 0, "Batch latency target must not be negative");
+      }
+      else if (config.first == "kAppTicksPerMsg") {
+        tune_params_->kAppTicksPerMsg = std::stoul(config.second[0]);
+      }
+      /// Open-loop client
+      else if (config.first == "offered_load") {
+        config_load(config.second);
+      }
+      /// Closed-loop flow control
+      else if (config.first == "credit_window") {
+        config_credit(config.second);
+      }
+      /// Work stealing between app workspaces
+      else if (config.first == "work_stealing") {
+        config_steal(config.second);
+      }
+      /// Elastic app workspaces
+      else if (config.first == "elastic") {
+        config_elastic(config.second);
+      }
+      /// Loop pacing
+      else if (config.first == "disp_pacing") {
+        config_pacing(disp_pacing_, config.second);
+      }
+      else if (config.first == "worker_pacing") {
+        config_pacing(worker_pacing_, config.second);
+      }
+      else if (config.first == "instrument") {
+        config_instrument(config.second);
+      }
+      else if (config.first == "ring") {
+        config_ring(config.second);
+      }
+      else if (config.first == "footprint") {
+        footprint_config_->budget_bytes_ = std::stoul(config.second[0]) * KB(1);
+        rt_assert(footprint_config_->budget_bytes_ > 0, "Footprint budget must be positive");
+      }
       else {
         DPERF_ERROR("Invalid server/tunable params config key %s\n", config.first.c_str());
       }
     }
   }
 
+  std::string UserConfig::parse_live_config(std::vector<std::string> &lines, tunable_params *tune,
+                                            credit_config *credit, server_config *server) {
+    /// unlike the config file, a bad value is reported to the client instead of exiting
+    auto __int = [](std::string &value, long min, long max) {
+      size_t end = 0;
+      long v = std::stol(value, &end);
+      if (end != value.size() || v < min || v > max) throw std::out_of_range(value);
+      return v;
+    };
+    for (auto &line : lines) {
+      std::vector<std::string> values = split(line, ':');
+      if (values.size() < 2) return "malformed line '" + line + "'";
+      std::string key = trim(values[0]);
+      std::vector<std::string> args;
+      for (size_t i = 1; i < values.size(); ++i) args.push_back(trim(values[i]));
+      try {
+        if (key == "kAppTxMsgBatchSize") tune->kAppTxMsgBatchSize = __int(args[0], 1, kMaxBatchSize);
+        else if (key == "kAppRxMsgBatchSize") tune->kAppRxMsgBatchSize = __int(args[0], 1, kMaxBatchSize);
+        else if (key == "kDispTxBatchSize") tune->kDispTxBatchSize = __int(args[0], 1, kMaxBatchSize);
+        else if (key == "kDispRxBatchSize") tune->kDispRxBatchSize = __int(args[0], 1, kMaxBatchSize);
+        else if (key == "kAppTicksPerMsg") tune->kAppTicksPerMsg = __int(args[0], 0, LONG_MAX);
+        else if (key == "kBatchTargetUs") {
+          tune->kBatchTargetUs = std::stod(args[0]);
+          if (tune->kBatchTargetUs < 0) return "batch latency target must not be negative";
+        }
+        else if (key == "credit_window") {
+          /// same syntax as the config file
+          credit->window_ = __int(args[0], 1, UINT32_MAX);
+          credit->max_window_ = credit->window_;
+          credit->adaptive_ = false;
+          if (args.size() > 1) {
+            if (args.size() < 3) return "adaptive credit windows need a target RTT and a max window";
+            credit->adaptive_ = true;
+            credit->target_rtt_us_ = std::stod(args[1]);
+            credit->max_window_ = __int(args[2], credit->window_, UINT32_MAX);
+            if (credit->target_rtt_us_ <= 0) return "target RTT must be positive";
+          }
+        }
+        else if (key == "iteration") server->iteration = __int(args[0], 1, UINT8_MAX);
+        else if (key == "duration") server->duration = __int(args[0], 1, UINT8_MAX);
+        else return "'" + key + "' cannot be changed in daemon mode";
+      } catch (std::exception &e) {
+        return "invalid value of '" + key + "'";
+      }
+    }
+    return "";
+  }
+
+  void UserConfig::config_load(std::vector<std::string> &values) {
+    /// values are "<msgs per second> : const|poisson", or "<msgs per second> : onoff : <on us> : <off us>"
+    load_config_->open_loop_ = true;
+    load_config_->rate_ = std::stod(values[0]);
+    rt_assert(load_config_->rate_ > 0, "Offered load must be positive");
+    std::string dist = values.size() > 1 ? values[1] : "const";
+    if (dist == "const") {
+      load_config_->dist_ = kArrivalConstant;
+    }
+    else if (dist == "poisson") {
+      load_config_->dist_ = kArrivalPoisson;
+    }
+    else if (dist == "onoff") {
+      rt_assert(values.size() > 3, "On/off arrivals need the on and off periods");
+      load_config_->dist_ = kArrivalOnOff;
+      load_config_->on_us_ = std::stod(values[2]);
+      load_config_->off_us_ = std::stod(values[3]);
+    }
+    else {
+      DPERF_ERROR("Invalid arrival distribution %s\n", dist.c_str());
+    }
+  }
+
+  void UserConfig::config_credit(std::vector<std::string> &values) {
+    /// values are "<msgs>", or "<initial msgs> : <target RTT us> : <max msgs>" to adapt the windows
+    credit_config_->window_ = std::stoi(values[0]);
+    credit_config_->max_window_ = credit_config_->window_;
+    if (values.size() > 1) {
+      rt_assert(values.size() > 2, "Adaptive credit windows need a target RTT and a max window");
+      credit_config_->adaptive_ = true;
+      credit_config_->target_rtt_us_ = std::stod(values[1]);
+      credit_config_->max_window_ = std::stoi(values[2]);
+      rt_assert(credit_config_->target_rtt_us_ > 0, "Target RTT must be positive");
+      rt_assert(credit_config_->max_window_ >= credit_config_->window_, "Max credit window is below the initial window");
+    }
+  }
+
+  void UserConfig::config_steal(std::vector<std::string> &values) {
+    /// values are "on | off [: <min sibling backlog in msgs>]"
+    if (values[0] == "on") {
+      steal_config_->enabled_ = true;
+    }
+    else if (values[0] != "off") {
+      DPERF_ERROR("Invalid work stealing mode %s\n", values[0].c_str());
+    }
+    if (values.size() > 1) steal_config_->min_backlog_ = std::stoi(values[1]);
+  }
+
+  void UserConfig::config_elastic(std::vector<std::string> &values) {
+    /// values are "on | off [: <interval us> : <park util> : <unpark util> : <hold intervals> [: <min active>]]"
+    if (values[0] == "on") {
+      elastic_config_->enabled_ = true;
+    }
+    else if (values[0] != "off") {
+      DPERF_ERROR("Invalid elastic mode %s\n", values[0].c_str());
+    }
+    if (values.size() > 1) {
+      rt_assert(values.size() >= 5, "Elastic mode needs an interval, park and unpark utilizations, and a hold time");
+      elastic_config_->interval_us_ = std::stod(values[1]);
+      elastic_config_->park_util_ = std::stod(values[2]);
+      elastic_config_->unpark_util_ = std::stod(values[3]);
+      elastic_config_->hold_ = std::stoi(values[4]);
+      if (values.size() > 5) elastic_config_->min_active_ = std::stoi(values[5]);
+    }
+    rt_assert(elastic_config_->interval_us_ > 0, "Elastic control interval must be positive");
+    rt_assert(elastic_config_->park_util_ < elastic_config_->unpark_util_, "Park utilization must be below the unpark utilization");
+    rt_assert(elastic_config_->min_active_ >= 1, "Elastic mode keeps at least one app workspace per group");
+  }
+
+  void UserConfig::config_msg_size(std::vector<std::string> values) {
+    /// values are "<workload type> : <request sizes> [: <response sizes>]"
+    rt_assert(values.size() >= 2, "Message sizes need a workload type and a request size distribution");
+    uint8_t workload_type = std::stoi(values[0]);
+    rt_assert(workload_type < kInvalidWorkloadType, "Invalid workload type");
+    msg_size_config *sizes = &workloads_config_->workload_msg_size_map[workload_type];
+    config_size_dist(&sizes->req_, values[1]);
+    if (values.size() > 2) config_size_dist(&sizes->resp_, values[2]);
+  }
+
+  void UserConfig::config_size_dist(size_dist_spec *spec, std::string &value) {
+    /// value is "fixed,<B>", "uniform,<min B>,<max B>", "bimodal,<small B>,<large B>,<p large>", 
+    /// "cdf,<file of 'size cumulative_probability' lines>", "etc", or "usr"
+    std::vector<std::string> args = split(value, ',');
+    std::string type = trim(args[0]);
+    auto __params = [&](size_t num) {
+      rt_assert(args.size() == num + 1, "Wrong number of size distribution parameters");
+      for (size_t i = 1; i < args.size(); i++) spec->params_.push_back(std::stod(args[i]));
+    };
+    if (type == "fixed") {
+      spec->type_ = kSizeFixed;
+      __params(1);
+    }
+    else if (type == "uniform") {
+      spec->type_ = kSizeUniform;
+      __params(2);
+      rt_assert(spec->params_[0] <= spec->params_[1], "Uniform sizes need min <= max");
+    }
+    else if (type == "bimodal") {
+      spec->type_ = kSizeBimodal;
+      __params(3);
+      rt_assert(spec->params_[2] >= 0 && spec->params_[2] <= 1, "Bimodal probability must be in [0, 1]");
+    }
+    else if (type == "cdf") {
+      rt_assert(args.size() == 2, "Empirical sizes need a CDF file");
+      spec->type_ = kSizeEmpirical;
+      std::ifstream file(trim(args[1]));
+      rt_assert(file.is_open(), "Failed to open the message size CDF file");
+      double size, prob;
+      while (file >> size >> prob) {
+        rt_assert(spec->cdf_.empty() || (size >= spec->cdf_.back().first && prob >= spec->cdf_.back().second),
+                  "Message size CDF must be non-decreasing");
+        spec->cdf_.emplace_back(size, prob);
+      }
+      rt_assert(!spec->cdf_.empty(), "Empty message size CDF");
+    }
+    else if (type == "etc") {
+      spec->type_ = kSizeETC;
+    }
+    else if (type == "usr") {
+      spec->type_ = kSizeUSR;
+    }
+    else {
+      DPERF_ERROR("Invalid message size distribution %s\n", type.c_str());
+    }
+  }
+
+  void UserConfig::config_rx_dispatch(std::vector<std::string> values) {
+    /// values are "<workload type> : rr | wrr,<weight>,<weight>,... | flow | p2c | jsq"
+    rt_assert(values.size() == 2, "RX dispatch needs a workload type and a policy");
+    uint8_t workload_type = std::stoi(values[0]);
+    rt_assert(workload_type < kInvalidWorkloadType, "Invalid workload type");
+    dispatch_policy_config *policy = &workloads_config_->workload_rx_policy_map[workload_type];
+    std::vector<std::string> args = split(values[1], ',');
+    std::string type = trim(args[0]);
+    if (type == "rr") {
+      policy->policy_ = kSelectRR;
+    }
+    else if (type == "wrr") {
+      rt_assert(args.size() > 1, "Weighted round-robin needs the weights of the app workspaces");
+      policy->policy_ = kSelectWRR;
+      for (size_t i = 1; i < args.size(); i++) {
+        int weight = std::stoi(args[i]);
+        rt_assert(weight >= 0 && weight <= UINT8_MAX, "Invalid WRR weight");
+        policy->weights_.push_back(weight);
+      }
+    }
+    else if (type == "flow") {
+      policy->policy_ = kSelectFlowHash;
+    }
+    else if (type == "p2c") {
+      policy->policy_ = kSelectP2C;
+    }
+    else if (type == "jsq") {
+      policy->policy_ = kSelectJSQ;
+    }
+    else {
+      DPERF_ERROR("Invalid RX dispatch policy %s\n", type.c_str());
+    }
+  }
+
+  void UserConfig::config_pacing(pacing_config *pacing, std::vector<std::string> &values) {
+    /// values are "busy", "interval : <us>", or "backoff : <empty polls> : <max wait us>"
+    if (values[0] == "busy") {
+      pacing->policy_ = kPacingBusyPoll;
+    }
+    else if (values[0] == "interval") {
+      pacing->policy_ = kPacingInterval;
+      if (values.size() > 1) pacing->interval_us_ = std::stod(values[1]);
+      rt_assert(pacing->interval_us_ > 0, "Pacing interval must be positive");
+    }
+    else if (values[0] == "backoff") {
+      pacing->policy_ = kPacingBackoff;
+      if (values.size() > 1) pacing->backoff_thresh_ = std::stoi(values[1]);
+      if (values.size() > 2) pacing->backoff_max_us_ = std::stod(values[2]);
+      rt_assert(pacing->backoff_max_us_ > 0, "Pacing backoff wait must be positive");
+    }
+    else {
+      DPERF_ERROR("Invalid pacing policy %s\n", values[0].c_str());
+    }
+  }
+
+  void UserConfig::config_instrument(std::vector<std::string> &values) {
+    /// values are "off", "full", or "sampled : <loops per timed loop>"
+    if (values[0] == "off") {
+      instrument_config_->level_ = kInstrumentOff;
+    }
+    else if (values[0] == "full") {
+      instrument_config_->level_ = kInstrumentFull;
+    }
+    else if (values[0] == "sampled") {
+      instrument_config_->level_ = kInstrumentSampled;
+      if (values.size() > 1) instrument_config_->period_ = std::stoi(values[1]);
+      rt_assert(instrument_config_->period_ > 0, "Instrumentation period must be positive");
+    }
+    else {
+      DPERF_ERROR("Invalid instrumentation level %s\n", values[0].c_str());
+    }
+  }
+
+  void UserConfig::config_ring(std::vector<std::string> &values) {
+    /// values are "<rx descriptors> : <tx descriptors> : <mbufs>" per queue
+    footprint_config_->rx_ring_size_ = std::stoi(values[0]);
+    if (values.size() > 1) footprint_config_->tx_ring_size_ = std::stoi(values[1]);
+    if (values.size() > 2) footprint_config_->mempool_size_ = std::stoi(values[2]);
+    rt_assert(is_power_of_two<uint32_t>(footprint_config_->rx_ring_size_), "RX ring size must be a power of two");
+    rt_assert(is_power_of_two<uint32_t>(footprint_config_->tx_ring_size_), "TX ring size must be a power of two");
+    rt_assert(footprint_config_->mempool_size_ > 0, "Mempool size must be positive");
+  }
+
   void UserConfig::print_config() {
     std::cout << "----------------------" << YELLOW << "Basic Configuration" << RESET << "----------------------" << std::endl;
     printf("Node type: %s\n", NODE_TYPE == CLIENT ? "client" : "server");
@@ -196,6 +508,14 @@ namespace dperf {
     printf("Physical port: %u\n", server_config_->phy_port);
     printf("Iteration: %u\n", server_config_->iteration);
     printf("Duration: %u\n", server_config_->duration);
+    if (is_daemon()) 
+      printf("Daemon mode: control socket %s\n", server_config_->control_socket.c_str());
+    if (server_config_->stats_interval_ms > 0) 
+      printf("Stats monitor: every %u ms\n", server_config_->stats_interval_ms);
+    if (!server_config_->result_file.empty()) 
+      printf("Result file: %s\n", server_config_->result_file.c_str());
+    if (!server_config_->stats_shm.empty()) 
+      printf("Stats shared memory: %s\n", server_config_->stats_shm.c_str());
 
     std::cout << "----------------------" << YELLOW << "Current Tunable Params Configuration" << RESET << "----------------------" << std::endl;
     printf("App core number: %u\n", tune_params_->kAppCoreNum);
@@ -206,6 +526,98 @@ namespace dperf {
     printf("Dispatcher rx batch size: %u\n", tune_params_->kDispRxBatchSize);
     printf("NIC tx post size: %u\n", tune_params_->kNICTxPostSize);
     printf("NIC rx post size: %u\n", tune_params_->kNICRxPostSize);
+    if (tune_params_->kBatchTargetUs > 0) 
+      printf("Adaptive batch latency target: %.2f us (app rx, dispatcher tx)\n", tune_params_->kBatchTargetUs);
+    printf("App ticks per message: %zu\n", tune_params_->kAppTicksPerMsg);
+
+    std::cout << "----------------------" << YELLOW << "Load Configuration" << RESET << "----------------------" << std::endl;
+    if (load_config_->open_loop_) {
+      const char *dist_name[] = {"constant", "poisson", "on/off"};
+      printf("Open loop: %.0f msgs/s per client workspace, %s arrivals", load_config_->rate_, dist_name[load_config_->dist_]);
+      if (load_config_->dist_ == kArrivalOnOff) 
+        printf(" (on %.2f us, off %.2f us)", load_config_->on_us_, load_config_->off_us_);
+      printf("\n");
+    } else {
+      printf("Closed loop, credit window of %u msgs per remote dispatcher", credit_config_->window_);
+      if (credit_config_->adaptive_) 
+        printf(", adapted to a %.2f us RTT up to %u msgs", credit_config_->target_rtt_us_, credit_config_->max_window_);
+      printf("\n");
+    }
+
+    std::cout << "----------------------" << YELLOW << "Message Size Configuration" << RESET << "----------------------" << std::endl;
+    auto __print_size_dist = [](const char *dir, size_dist_spec &spec) {
+      if (spec.type_ == kSizeBuiltin) 
+        printf("    %s: built-in\n", dir);
+      else if (spec.type_ == kSizeFixed) 
+        printf("    %s: fixed %.0f B\n", dir, spec.params_[0]);
+      else if (spec.type_ == kSizeUniform) 
+        printf("    %s: uniform %.0f - %.0f B\n", dir, spec.params_[0], spec.params_[1]);
+      else if (spec.type_ == kSizeBimodal) 
+        printf("    %s: bimodal %.0f B / %.0f B, %.2f%% large\n", dir, spec.params_[0], spec.params_[1], 100 * spec.params_[2]);
+      else if (spec.type_ == kSizeEmpirical) 
+        printf("    %s: empirical CDF of %zu points, %.0f - %.0f B\n", dir, spec.cdf_.size(), spec.cdf_.front().first, spec.cdf_.back().first);
+      else 
+        printf("    %s: Facebook %s\n", dir, spec.type_ == kSizeETC ? "ETC" : "USR");
+    };
+    if (workloads_config_->workload_msg_size_map.empty()) {
+      printf("Built-in sizes\n");
+    }
+    for (auto &msg_size : workloads_config_->workload_msg_size_map) {
+      printf("Workload type %u:\n", msg_size.first);
+      __print_size_dist("Request", msg_size.second.req_);
+      __print_size_dist("Response", msg_size.second.resp_);
+    }
+
+    std::cout << "----------------------" << YELLOW << "RX Dispatch Configuration" << RESET << "----------------------" << std::endl;
+    for (auto &workload_appws : workloads_config_->workload_appws_map) {
+      uint8_t workload_type = workload_appws.first;
+      auto policy = workloads_config_->workload_rx_policy_map.find(workload_type);
+      uint8_t policy_type = policy == workloads_config_->workload_rx_policy_map.end() ? kSelectRR : policy->second.policy_;
+      printf("Workload type %u: %s", workload_type, select_policy_name(policy_type));
+      if (policy_type == kSelectWRR) {
+        printf(", weights");
+        for (auto &app_ws_group : workload_appws.second) {
+          for (auto &ws_id : *app_ws_group) printf(" %u:%u", ws_id, workloads_config_->get_rx_weight(workload_type, ws_id));
+        }
+      }
+      printf("\n");
+    }
+
+    if (steal_config_->enabled_) {
+      if (steal_config_->min_backlog_) 
+        printf("Work stealing: on, from siblings with >= %u msgs queued\n", steal_config_->min_backlog_);
+      else 
+        printf("Work stealing: on, from siblings with >= 2 RX batches queued\n");
+    }
+
+    if (elastic_config_->enabled_) {
+      printf("Elastic app workspaces: every %.2f us, park below %.2f utilization for %u intervals, unpark above %.2f, keep >= %u per group\n",
+             elastic_config_->interval_us_, elastic_config_->park_util_, elastic_config_->hold_, 
+             elastic_config_->unpark_util_, elastic_config_->min_active_);
+    }
+
+    std::cout << "----------------------" << YELLOW << "Loop Pacing Configuration" << RESET << "----------------------" << std::endl;
+    auto __print_pacing = [](const char *role, pacing_config *pacing) {
+      if (pacing->policy_ == kPacingBusyPoll) 
+        printf("%s: busy poll\n", role);
+      else if (pacing->policy_ == kPacingInterval) 
+        printf("%s: fixed interval of %.2f us\n", role, pacing->interval_us_);
+      else 
+        printf("%s: back off after %u empty polls, up to %.2f us\n", role, pacing->backoff_thresh_, pacing->backoff_max_us_);
+    };
+    __print_pacing("Dispatcher", disp_pacing_);
+    __print_pacing("Worker", worker_pacing_);
+    if (instrument_config_->level_ == kInstrumentOff) 
+      printf("Instrumentation: off, counters only\n");
+    else if (instrument_config_->level_ == kInstrumentSampled) 
+      printf("Instrumentation: 1 in %u loops\n", instrument_config_->period_);
+    else 
+      printf("Instrumentation: every loop\n");
+    if (footprint_config_->budget_bytes_ > 0) 
+      printf("Footprint: %lu KB of buffers per queue, rings and mempool derived from it\n", footprint_config_->budget_bytes_ / KB(1));
+    else 
+      printf("Rings: %u RX / %u TX descriptors, %u mbufs per queue\n", footprint_config_->rx_ring_size_,
+             footprint_config_->tx_ring_size_, footprint_config_->mempool_size_);
 
     std::cout << "----------------------" << YELLOW << "End of Configuration" << RESET << "----------------------\n" << std::endl;
   }
@@ -4,6 +4,9 @@
  */
 #pragma once
 #include "common.h"
+#include "util/arrival_schedule.h"
+#include "util/rule_table.h"
+#include "util/size_dist.h"
 #include <iostream>
 #include <fstream>
 #include <map>
@@ -11,6 +14,20 @@
 #include <vector>
 
 namespace dperf {
+/**
+ * ----------------------Loop pacing policies----------------------
+ */ 
+#define kPacingBusyPoll   0   // launch a loop on every spin
+#define kPacingInterval   1   // launch a loop once per fixed interval
+#define kPacingBackoff    2   // busy poll, back off after consecutive empty polls
+
+/**
+ * ----------------------Instrumentation levels----------------------
+ */ 
+#define kInstrumentOff      0   // counters only, no timestamps
+#define kInstrumentSampled  1   // time one in every period_ loops
+#define kInstrumentFull     2   // time every loop
+
 class UserConfig {
 /**
  * ----------------------Class Parameters----------------------
@@ -20,6 +37,16 @@ class UserConfig {
  * ----------------------Internal structures----------------------
  */ 
 public:
+    struct msg_size_config {
+        size_dist_spec req_;        // request sizes, drawn by client workers
+        size_dist_spec resp_;       // response sizes, carried to the server in ws_hdr
+    };
+
+    struct dispatch_policy_config {
+        uint8_t policy_ = kSelectRR;        // selection policy, see util/rule_table.h
+        std::vector<uint8_t> weights_;      // kSelectWRR: in the order of the app workspaces of the workload
+    };
+
     struct workloads_config {
         std::map<uint8_t, std::vector<std::string>> workload_pipephase_map;     // workload_type -> pipeline phase type
         std::map<uint8_t, std::vector<std::vector<uint8_t>*>> workload_appws_map; // workload_type -> app_ws_group
@@ -27,9 +54,25 @@ public:
         std::map<uint8_t, std::vector<uint8_t>> workload_remote_dispatcher_map;     // workload_type -> remote_dispatcher_ws_group
         std::map<uint8_t, uint8_t> ws_id_workload_map;  // ws_id -> workload_type
         std::map<uint8_t, uint8_t> ws_id_group_idx_map; // ws_id -> group_idx
+        std::map<uint8_t, msg_size_config> workload_msg_size_map;  // workload_type -> message sizes, built-in if absent
+        std::map<uint8_t, dispatch_policy_config> workload_rx_policy_map;  // workload_type -> RX dispatch policy, round-robin if absent
         uint8_t get_size() {
             return workload_pipephase_map.size();
         }
+        /// WRR weight of an app workspace, 1 unless configured
+        uint8_t get_rx_weight(uint8_t workload_type, uint8_t ws_id) {
+            auto policy = workload_rx_policy_map.find(workload_type);
+            if (policy == workload_rx_policy_map.end()) return 1;
+            size_t idx = 0;
+            for (auto &app_ws_group : workload_appws_map[workload_type]) {
+                for (auto &app_ws_id : *app_ws_group) {
+                    if (app_ws_id == ws_id) 
+                        return idx < policy->second.weights_.size() ? policy->second.weights_[idx] : 1;
+                    idx++;
+                }
+            }
+            return 1;
+        }
         uint8_t get_type(uint8_t workload_idx) {
             auto it = workload_pipephase_map.begin();
             std::advance(it, workload_idx);
@@ -48,6 +91,10 @@ public:
         uint8_t remote_mac[6];
         char device_pcie_addr[13];
         char device_name[32];
+        std::string control_socket;     // daemon mode: path of the control socket, empty to exit after the iterations
+        uint32_t stats_interval_ms = 0; // period of the stats monitor, 0 for stats at the end of each iteration only
+        std::string result_file;        // per-iteration results, JSON lines or CSV (.csv), empty for none
+        std::string stats_shm;          // shared memory the stats monitor writes instead of printing, empty for none
     };
 
     struct tunable_params {
@@ -59,6 +106,56 @@ public:
         uint16_t kDispRxBatchSize     = 32;
         uint16_t kNICTxPostSize       = 32;
         uint16_t kNICRxPostSize       = 32;
+        double kBatchTargetUs         = 0;    // latency target of the adaptive app RX / dispatcher TX batches, 0 for fixed batches
+        size_t kAppTicksPerMsg        = dperf::kAppTicksPerMsg;  // extra execution ticks of each message
+    };
+
+    struct load_config {
+        bool open_loop_             = false;    // closed loop unless an offered load is configured
+        double rate_                = 0;        // offered load of each client workspace, messages per second
+        uint8_t dist_               = 0;        // arrival distribution, see util/arrival_schedule.h
+        double on_us_               = 0;        // kArrivalOnOff: burst length
+        double off_us_              = 0;        // kArrivalOnOff: silence after a burst
+    };
+
+    struct credit_config {
+        uint32_t window_            = kInflyMessageBudget;  // initial credit window of each remote dispatcher
+        bool adaptive_              = false;    // adjust the windows from the observed RTT
+        double target_rtt_us_       = 0;        // adaptive: shrink a window when its RTT exceeds this
+        uint32_t max_window_        = kInflyMessageBudget;  // adaptive: largest window
+    };
+
+    struct steal_config {
+        bool enabled_               = false;    // server workers steal from siblings of the same group
+        uint32_t min_backlog_       = 0;        // smallest sibling backlog to steal from, 0 for two RX batches
+    };
+
+    struct elastic_config {
+        bool enabled_               = false;    // park idle server app workspaces, see util/elastic_controller.h
+        double interval_us_         = 100;      // control interval of each dispatcher
+        double park_util_           = 0.3;      // park one when the utilization of a group stays below this
+        double unpark_util_         = 0.8;      // unpark one when the utilization of a group exceeds this
+        uint32_t hold_              = 10;       // intervals below park_util_ before parking
+        uint32_t min_active_        = 1;        // app workspaces of a group that are never parked
+    };
+
+    struct footprint_config {
+        uint32_t rx_ring_size_      = 2048;     // RX descriptors per queue, a power of two
+        uint32_t tx_ring_size_      = 2048;     // TX descriptors per queue, a power of two
+        uint32_t mempool_size_      = 8192;     // mbufs per queue
+        size_t budget_bytes_        = 0;        // derive the sizes above from the buffer bytes per queue, 0 if off
+    };
+
+    struct instrument_config {
+        uint8_t level_              = kInstrumentFull;
+        uint32_t period_            = 16;   // kInstrumentSampled: loops per timed loop
+    };
+
+    struct pacing_config {
+        uint8_t policy_             = kPacingInterval;
+        double interval_us_         = 1.0;  // kPacingInterval: launch interval
+        uint32_t backoff_thresh_    = 64;   // kPacingBackoff: empty polls before backing off
+        double backoff_max_us_      = 8.0;  // kPacingBackoff: longest single wait
     };
 
 /**
@@ -92,6 +189,21 @@ public:
     uint8_t get_duration() {
         return server_config_->duration;
     }
+    bool is_daemon() {
+        return !server_config_->control_socket.empty();
+    }
+
+    /**
+     * @brief Parse the "key : value" lines of a daemon mode request
+     * 
+     * Only the keys that workspaces can apply between iterations are accepted,
+     * i.e., the app and dispatcher batch sizes, kBatchTargetUs, kAppTicksPerMsg,
+     * credit_window, iteration and duration. The values are parsed into copies,
+     * so a bad request changes nothing.
+     * @return An error message, empty if all lines are valid
+     */
+    std::string parse_live_config(std::vector<std::string> &lines, tunable_params *tune,
+                                  credit_config *credit, server_config *server);
 
 /**
  * ----------------------Internal Parameters----------------------
@@ -101,6 +213,14 @@ public:
     struct workloads_config *workloads_config_ = new workloads_config();
     struct server_config *server_config_ = new server_config();
     struct tunable_params *tune_params_ = new tunable_params();
+    struct load_config *load_config_ = new load_config();
+    struct credit_config *credit_config_ = new credit_config();
+    struct pacing_config *disp_pacing_ = new pacing_config();      // dispatcher and dispatcher+worker workspaces
+    struct pacing_config *worker_pacing_ = new pacing_config();    // worker workspaces
+    struct steal_config *steal_config_ = new steal_config();
+    struct elastic_config *elastic_config_ = new elastic_config();
+    struct instrument_config *instrument_config_ = new instrument_config();
+    struct footprint_config *footprint_config_ = new footprint_config();
 
 /**
  * ----------------------Internal Methods----------------------
@@ -133,6 +253,22 @@ private:
                     config_workload(infos);
                     continue;
                 }
+                if (key == "msg_size") {
+                    std::vector<std::string> infos;
+                    for (size_t i = 1; i < values.size(); ++i) {
+                        infos.push_back(trim(values[i]));
+                    }
+                    config_msg_size(infos);
+                    continue;
+                }
+                if (key == "rx_dispatch") {
+                    std::vector<std::string> infos;
+                    for (size_t i = 1; i < values.size(); ++i) {
+                        infos.push_back(trim(values[i]));
+                    }
+                    config_rx_dispatch(infos);
+                    continue;
+                }
                 for (size_t i = 1; i < values.size(); ++i) {
                     std::string value = trim(values[i]);
                     config_map_[key].push_back(value);
@@ -163,6 +299,16 @@ private:
     /// Config each parameters
     void config_workload(std::vector<std::string> values);
     void config_server();
+    void config_pacing(pacing_config *pacing, std::vector<std::string> &values);
+    void config_instrument(std::vector<std::string> &values);
+    void config_ring(std::vector<std::string> &values);
+    void config_load(std::vector<std::string> &values);
+    void config_credit(std::vector<std::string> &values);
+    void config_steal(std::vector<std::string> &values);
+    void config_elastic(std::vector<std::string> &values);
+    void config_msg_size(std::vector<std::string> values);
+    void config_size_dist(size_dist_spec *spec, std::string &value);
+    void config_rx_dispatch(std::vector<std::string> values);
     
 };
 
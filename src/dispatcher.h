@@ -14,6 +14,7 @@
 #include <netinet/ip.h>
 #include <netinet/udp.h>
 
+#include <algorithm>
 #include <functional>
 #include <unordered_map>
 
@@ -38,11 +39,13 @@ class Dispatcher {
   /**
    * ----------------------Parameters in dispatcher level----------------------
    */ 
+    /// Capacity of the per-queue ring arrays, the runtime ring sizes are at most this
     static constexpr size_t kNumRxRingEntries = 2048;
     static_assert(is_power_of_two<size_t>(kNumRxRingEntries), "The num of RX ring entries is not power of two.");
     static constexpr size_t kNumTxRingEntries = 2048;
     static_assert(is_power_of_two<size_t>(kNumTxRingEntries), "The num of TX ring entries is not power of two.");
-    static constexpr size_t kMemPoolSize = 8192;  // mbuf pool size
+    static constexpr size_t kMemPoolSize = 8192;  // default mbuf pool size
+    static constexpr size_t kMinRingEntries = 64; // smallest ring a footprint budget derives
     static constexpr size_t kMTU = 2048;
     static_assert(is_power_of_two<size_t>(kMTU), "The size of MTU is not power of two.");
     static constexpr size_t kMaxPayloadSize = kMTU - sizeof(iphdr) - sizeof(udphdr);
@@ -68,6 +71,7 @@ class Dispatcher {
       using set_payload_t = void(*)(T*, char*, char*, size_t);
       using extract_ws_hdr_t = ws_hdr*(*)(T*);
       using cp_payload_t = void(*)(T*, T*, char*, char*, size_t);
+      using local_mr_t = void*(*)(void*);
 
       alloc_t alloc_;
       de_alloc_t de_alloc_;
@@ -76,7 +80,8 @@ class Dispatcher {
       set_payload_t set_payload_;
       extract_ws_hdr_t extract_ws_hdr_;
       cp_payload_t cp_payload_;
-      
+      /// Derive a handle of dispatcher_mr_ private to one workspace (eg, a buffer cache)
+      local_mr_t local_mr_;
 
       // Constructor to initialize the function pointer
       mem_reg_info(
@@ -86,14 +91,22 @@ class Dispatcher {
         de_alloc_bulk_t de_alloc_bulk,
         set_payload_t set_payload,
         extract_ws_hdr_t extract_ws_hdr,
-        cp_payload_t cp_payload
+        cp_payload_t cp_payload,
+        local_mr_t local_mr
       ) 
         : dispatcher_mr_(mr), alloc_(alloc), de_alloc_(de_alloc), 
         alloc_bulk_(alloc_bulk), de_alloc_bulk_(de_alloc_bulk), set_payload_(set_payload),
-        extract_ws_hdr_(extract_ws_hdr), cp_payload_(cp_payload) {}
+        extract_ws_hdr_(extract_ws_hdr), cp_payload_(cp_payload), local_mr_(local_mr) {}
     };
 
 
+    /// Ring and pool sizes of one queue
+    struct queue_sizes {
+      size_t rx_ring_;        // RX descriptors
+      size_t tx_ring_;        // TX descriptors
+      size_t mempool_;        // mbufs
+    };
+
   /**
    * ----------------------Dispatcher methods----------------------
    */ 
@@ -116,6 +129,28 @@ class Dispatcher {
    * ----------------------Util methods----------------------
    */ 
   public:
+    /**
+     * @brief Sizes of a queue, from the ring config or, with a footprint
+     * budget, from the bytes of packet buffers the NIC may DMA into.
+     *
+     * A budget of B bytes allows B / \p buf_size buffers. Half of them, rounded
+     * down to a power of two, back the RX ring, and the TX ring has as many
+     * descriptors. The mempool holds the rest, or all of them if the RX ring
+     * takes its buffers from the mempool (\p rx_ring_in_pool, e.g., DPDK).
+     */
+    static queue_sizes derive_queue_sizes(const UserConfig::footprint_config *footprint, size_t buf_size, bool rx_ring_in_pool) {
+      if (footprint->budget_bytes_ == 0) 
+        return {footprint->rx_ring_size_, footprint->tx_ring_size_, footprint->mempool_size_};
+      size_t buf_num = footprint->budget_bytes_ / buf_size;
+      size_t ring = (buf_num >= 2) ? size_t(1) << (63 - __builtin_clzl(buf_num / 2)) : 1;
+      ring = std::min(std::max(ring, kMinRingEntries), std::min(kNumRxRingEntries, kNumTxRingEntries));
+      size_t mempool = rx_ring_in_pool ? buf_num : buf_num - std::min(buf_num, ring);
+      return {ring, ring, std::max(mempool, kMinRingEntries)};
+    }
+
+    /// Apply \p sizes to this queue, the rings must fit the ring arrays
+    void set_queue_sizes(const queue_sizes &sizes);
+
     static std::string get_name(DispatcherType transport_type) {
       switch (transport_type) {
         case DispatcherType::kDPDK: return "[DPDK]";
@@ -132,6 +167,12 @@ class Dispatcher {
     const uint8_t phy_port_;  ///< 0-based index among active fabric ports  
     const size_t numa_node_;
 
+    /// Runtime sizes of this queue, see derive_queue_sizes()
+    size_t rx_ring_size_ = kNumRxRingEntries;
+    size_t tx_ring_size_ = kNumTxRingEntries;
+    size_t mempool_size_ = kMemPoolSize;
+    size_t dma_footprint_ = 0;    ///< Bytes of packet buffers the NIC DMAs into/out of
+
 };
 }
 
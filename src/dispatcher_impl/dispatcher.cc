@@ -32,4 +32,14 @@ Dispatcher::Dispatcher(DispatcherType dispatcher_type, uint8_t ws_id,
 
 Dispatcher::~Dispatcher() {}
 
+void Dispatcher::set_queue_sizes(const queue_sizes &sizes) {
+  rt_assert(sizes.rx_ring_ <= kNumRxRingEntries && is_power_of_two(sizes.rx_ring_), 
+            "RX ring size must be a power of two up to " + std::to_string(kNumRxRingEntries));
+  rt_assert(sizes.tx_ring_ <= kNumTxRingEntries && is_power_of_two(sizes.tx_ring_), 
+            "TX ring size must be a power of two up to " + std::to_string(kNumTxRingEntries));
+  rx_ring_size_ = sizes.rx_ring_;
+  tx_ring_size_ = sizes.tx_ring_;
+  mempool_size_ = sizes.mempool_;
+}
+
 }
\ No newline at end of file
@@ -7,6 +7,7 @@ namespace dperf {
  */ 
 DpdkDispatcher::DpdkDispatcher(uint8_t ws_id, uint8_t phy_port, size_t numa_node, UserConfig *user_config)
   : Dispatcher(DispatcherType::kDPDK, ws_id, phy_port, numa_node, user_config) {
+  set_queue_sizes(derive_queue_sizes(user_config->footprint_config_, kDmaBufSize, kRxRingInPool));
   // The first thread to grab the lock initializes DPDK (as DPDK daemon process)
   g_dpdk_lock.lock();
   rte_thread_register();    // Register this thread with as an EAL thread to enable mempool cache
@@ -61,19 +62,19 @@ DpdkDispatcher::DpdkDispatcher(uint8_t ws_id, uint8_t phy_port, size_t numa_node
     drain_rx_queue();
 
     const size_t n_avail = rte_mempool_avail_count(mempool_);
-    if (n_avail < kDpdkMempoolSize) {
+    if (n_avail < mempool_->size) {
       DPERF_WARN(
           "DPDK dispatcher for Ws %u: Mempool has only %zu free mbufs "
-          "out of %zu. %zu mbufs have been leaked by previous processes that "
+          "out of %u. %zu mbufs have been leaked by previous processes that "
           "owned this mempool.\n",
-          ws_id, n_avail, kDpdkMempoolSize, (kDpdkMempoolSize - n_avail));
+          ws_id, n_avail, mempool_->size, (mempool_->size - n_avail));
     }
   } else {
     if (!g_port_initialized[phy_port]) {
       g_port_initialized[phy_port] = true;
       setup_phy_port(phy_port, numa_node, DpdkProcType::kPrimary, user_config->tune_params_->kDispQueueNum, 
       user_config->tune_params_->kNICTxPostSize,
-      user_config->tune_params_->kNICRxPostSize);
+      user_config->tune_params_->kNICRxPostSize, {rx_ring_size_, tx_ring_size_, mempool_size_});
     }
 
     mempool_ = rte_mempool_lookup(mempool_name.c_str());
@@ -82,6 +83,7 @@ DpdkDispatcher::DpdkDispatcher(uint8_t ws_id, uint8_t phy_port, size_t numa_node
         std::string("Failed to find self's mempool ") + mempool_name.c_str());
   }
   g_dpdk_lock.unlock();
+  dma_footprint_ = mempool_->size * (mempool_->header_size + mempool_->elt_size + mempool_->trailer_size);
 
   resolve_phy_port();
   dmac_ = new eth_addr;
@@ -366,11 +368,17 @@ void dpdk_mbuf_cp_payload(rte_mbuf *dst, rte_mbuf *src, char* uh, char* ws_heade
   rte_memcpy(payload_ptr, mbuf_ws_payload(src), payload_size);
 }
 
+/// The mempool already keeps a per-lcore cache, so every workspace shares it
+void* dpdk_mempool_local(void *mempool) {
+  return mempool;
+}
+
 void DpdkDispatcher::init_mem_reg_funcs() {
   mem_reg_info_ = new mem_reg_info<rte_mbuf>(
     mempool_, 
     &dpdk_mbuf_alloc, &dpdk_mbuf_de_alloc, &dpdk_mbuf_alloc_bulk, &dpdk_mbuf_de_alloc_bulk, 
-    &dpdk_set_mbuf_paylod, &dpdk_mbuf_extract_ws_hdr, &dpdk_mbuf_cp_payload
+    &dpdk_set_mbuf_paylod, &dpdk_mbuf_extract_ws_hdr, &dpdk_mbuf_cp_payload,
+    &dpdk_mempool_local
   );
 }
 
@@ -9,6 +9,7 @@
 #include "util/numautils.h"
 #include "util/lock_free_queue.h"
 #include "util/rule_table.h"
+#include "util/timer.h"
 #include "dispatcher_impl/ethhdr.h"
 #include "dispatcher_impl/iphdr.h"
 #include "dispatcher_impl/arphdr.h"
@@ -54,7 +55,10 @@ class DpdkDispatcher : public Dispatcher {
     static constexpr size_t kMbufSize =
         (static_cast<uint32_t>(sizeof(struct rte_mbuf)) + RTE_PKTMBUF_HEADROOM + kMTU); 
 
-    static constexpr size_t kDpdkMempoolSize = kMemPoolSize - 1;
+    /// Bytes of one mempool element, the rte_mbuf and its data room
+    static constexpr size_t kDmaBufSize = sizeof(struct rte_mbuf) + kMbufSize;
+    /// RX descriptors take their mbufs from the mempool of the queue
+    static constexpr bool kRxRingInPool = true;
 
     /// Maximum data bytes (i.e., non-header) in a packet
     // static constexpr size_t kMaxDataPerPkt = (kMTU - sizeof(pkthdr_t));
@@ -230,7 +234,8 @@ class DpdkDispatcher : public Dispatcher {
      * @brief Setup dpdk port and tx/rx rings
      */
     static void setup_phy_port(uint16_t phy_port, size_t numa_node,
-                              DpdkProcType proc_type, uint8_t enabled_queue_num, size_t tx_batch, size_t rx_batch);
+                              DpdkProcType proc_type, uint8_t enabled_queue_num, size_t tx_batch, size_t rx_batch,
+                              const queue_sizes &sizes);
 
     /* ----------------------Defined in dpdk_dispatcher_dataplane.cc---------------------- */
     /**
@@ -353,11 +358,21 @@ class DpdkDispatcher : public Dispatcher {
 
     void add_ws_rx_queue(uint8_t ws_id, lock_free_queue *queue) {
       ws_rx_queues_[ws_id] = queue;
+      rx_rule_table_->set_queue(ws_id, queue);
     }
 
-    void add_rx_rule(uint8_t workload_type, uint8_t ws_id) {
+    void add_rx_rule(uint8_t workload_type, uint8_t ws_id, uint8_t weight = 1) {
+      rx_rule_table_->set_weight(workload_type, ws_id, weight);
       rx_rule_table_->add_route(workload_type, ws_id);
     }
+
+    void set_rx_policy(uint8_t workload_type, uint8_t policy) {
+      rx_rule_table_->set_policy(workload_type, policy);
+    }
+
+    RuleTable *get_rx_rule_table() {
+      return rx_rule_table_;
+    }
   
     size_t get_used_mbuf_num() {
       return rte_mempool_in_use_count(mempool_);
@@ -152,6 +152,11 @@ size_t DpdkDispatcher::dispatch_rx_pkts() {
   // for (size_t i = 0; i < rx_queue_idx_; i++) {
   //   rte_prefetch0(rx_queue_[i]);
   // }
+#if PERF_LAT_BREAKDOWN == 1 && NODE_TYPE == SERVER
+  size_t rx_tsc = rdtsc();
+#endif
+  /// load-aware policies compare the worker queue depths at the start of the burst
+  rx_rule_table_->snapshot_depths();
   for (size_t i = 0; i < rx_queue_idx_; i++) {
     /// resolve pkt header to get workload_type
     // rte_prefetch0(rx_queue_[i+1]);
@@ -162,15 +167,29 @@ size_t DpdkDispatcher::dispatch_rx_pkts() {
       continue;
     }
     worload_type = resolve_pkt_hdr(rx_queue_[i]);
-    /// get corresponding workspace id
-    uint8_t ws_id = rx_rule_table_->rr_select(worload_type);
+  #if PERF_LAT_BREAKDOWN == 1 && NODE_TYPE == SERVER
+    /// stamp the requests for the latency breakdown
+    reinterpret_cast<ws_ts*>(mbuf_ws_payload(rx_queue_[i]))->server_ts_ = rx_tsc;
+  #endif
+    /// get corresponding workspace id, the segments of a message go to the same workspace
+    ws_hdr *wh = mbuf_ws_hdr(rx_queue_[i]);
+    uint16_t src_port = mbuf_udp_hdr(rx_queue_[i])->source;
+    uint8_t ws_id = likely(wh->segment_num_ <= 1) ? rx_rule_table_->select(worload_type, ws_flow_hash(src_port, wh))
+        : rx_rule_table_->hash_select(worload_type, ws_msg_hash(src_port, wh));
+  #if NODE_TYPE == CLIENT
+    /// return a response to its sender, so that it replenishes the sender's credits
+    if (likely(wh->src_ws_id_ < kWorkspaceMaxNum && ws_rx_queues_[wh->src_ws_id_] != nullptr))
+      ws_id = wh->src_ws_id_;
+  #endif
     /// get workspace rx queue
     worker_queue = ws_rx_queues_[ws_id];
     /// dispatch to worker rx queue
     if (unlikely(!worker_queue->enqueue((uint8_t*)rx_queue_[i]))) {
       /// drop the packet if the ws queue is full
+      rx_rule_table_->count(worload_type, true);
       break;
     }
+    rx_rule_table_->count(worload_type, false);
     // while(!worker_queue->enqueue((uint8_t*)rx_queue_[i]));
     dispatch_total++;
   }
@@ -230,6 +249,13 @@ size_t DpdkDispatcher::tx_flush(){
   /// flush the tx queue
   size_t nb_tx = 0, tx_total = 0;
   rte_mbuf **tx = &tx_queue_[0];
+#if PERF_LAT_BREAKDOWN == 1 && NODE_TYPE == CLIENT
+  /// stamp the requests for the latency breakdown
+  size_t tx_tsc = rdtsc();
+  for (size_t i = 0; i < tx_queue_idx_; i++) {
+    reinterpret_cast<ws_ts*>(mbuf_ws_payload(tx_queue_[i]))->client_tx_tsc_ = tx_tsc;
+  }
+#endif
   while(tx_total < tx_queue_idx_) {
     nb_tx = rte_eth_tx_burst(phy_port_, qp_id_, tx, tx_queue_idx_ - tx_total);
     tx += nb_tx;
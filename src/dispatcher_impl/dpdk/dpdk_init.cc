@@ -10,7 +10,8 @@
 namespace dperf {
 
 void DpdkDispatcher::setup_phy_port(uint16_t phy_port, size_t numa_node,
-                                   DpdkProcType proc_type, uint8_t enabled_queue_num, size_t tx_batch, size_t rx_batch) {
+                                   DpdkProcType proc_type, uint8_t enabled_queue_num, size_t tx_batch, size_t rx_batch,
+                                   const queue_sizes &sizes) {
   _unused(proc_type);
   uint16_t num_ports = rte_eth_dev_count_avail();
   if (phy_port >= num_ports) {
@@ -38,10 +39,11 @@ void DpdkDispatcher::setup_phy_port(uint16_t phy_port, size_t numa_node,
   rte_eth_dev_info_get(phy_port, &dev_info);
   printf("Max RX queues: %u, Max TX queues: %u\n", dev_info.max_rx_queues,
          dev_info.max_tx_queues);
-  rt_assert(dev_info.rx_desc_lim.nb_max >= kNumRxRingEntries,
+  rt_assert(dev_info.rx_desc_lim.nb_max >= sizes.rx_ring_,
             "Device RX ring too small");
-  rt_assert(dev_info.tx_desc_lim.nb_max >= kNumTxRingEntries,
+  rt_assert(dev_info.tx_desc_lim.nb_max >= sizes.tx_ring_,
             "Device TX ring too small");
+  rt_assert(sizes.mempool_ > sizes.rx_ring_, "Mempool must hold more mbufs than the RX ring");
   DPERF_INFO("Initializing port %u with driver %s\n", phy_port,
             dev_info.driver_name);
 
@@ -64,19 +66,28 @@ void DpdkDispatcher::setup_phy_port(uint16_t phy_port, size_t numa_node,
   // and reconfiguring the device.
   for (size_t i = 0; i < enabled_queue_num; i++) {
     const std::string pname = get_mempool_name(phy_port, i);
-    rte_mempool *mempool =
+    /// power-of-two minus one mbufs, and a cache that a small pool can still refill
+    const unsigned pool_size = sizes.mempool_ - 1;
     #if NODE_TYPE == CLIENT
-      rte_pktmbuf_pool_create(pname.c_str(), kDpdkMempoolSize, RTE_MEMPOOL_CACHE_MAX_SIZE/* cache */, 0 /* priv size */, kMbufSize, numa_node);
+      const unsigned cache_size = std::min<unsigned>(RTE_MEMPOOL_CACHE_MAX_SIZE, pool_size / 2);
     #else
-      rte_pktmbuf_pool_create(pname.c_str(), kDpdkMempoolSize, 0/* cache */, 0 /* priv size */, kMbufSize, numa_node);
+      const unsigned cache_size = 0;
     #endif
+    /// A LIFO stack hands out the most recently freed mbufs, which are still
+    /// in the LLC (DDIO ways), where the default ring cycles through the pool
+    rte_mempool *mempool = rte_pktmbuf_pool_create_by_ops(pname.c_str(), pool_size, cache_size, 0 /* priv size */, 
+                                                          kMbufSize, numa_node, "stack");
+    if (mempool == nullptr) {
+      DPERF_WARN("No stack mempool driver, mbufs of queue %zu are recycled FIFO\n", i);
+      mempool = rte_pktmbuf_pool_create(pname.c_str(), pool_size, cache_size, 0 /* priv size */, kMbufSize, numa_node);
+    }
     rt_assert(mempool != nullptr, "Mempool create failed: " + dpdk_strerror());
 
     rte_eth_rxconf eth_rx_conf;
     memset(&eth_rx_conf, 0, sizeof(eth_rx_conf));
     eth_rx_conf.rx_thresh.pthresh = rx_batch;   // Typically, 16 are sufficient to utilize the full PCIe bandwidth.
 
-    int ret = rte_eth_rx_queue_setup(phy_port, i, kNumRxRingEntries, numa_node,
+    int ret = rte_eth_rx_queue_setup(phy_port, i, sizes.rx_ring_, numa_node,
                                      &eth_rx_conf, mempool);
     rt_assert(ret == 0, "Failed to setup RX queue: " + std::to_string(i) +
                             ". Error " + strerror(-1 * ret));
@@ -86,7 +97,7 @@ void DpdkDispatcher::setup_phy_port(uint16_t phy_port, size_t numa_node,
     eth_tx_conf.tx_thresh.pthresh = tx_batch;
     eth_tx_conf.offloads = eth_conf.txmode.offloads;
 
-    ret = rte_eth_tx_queue_setup(phy_port, i, kNumTxRingEntries, numa_node,
+    ret = rte_eth_tx_queue_setup(phy_port, i, sizes.tx_ring_, numa_node,
                                  &eth_tx_conf);
     // ret = rte_eth_tx_queue_setup(phy_port, i, kNumTxRingEntries, numa_node,
     //                              NULL);
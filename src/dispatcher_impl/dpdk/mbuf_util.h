@@ -52,7 +52,7 @@ static void mbuf_print(struct rte_mbuf *m){
         iph = mbuf_ip_hdr(m); 
         uh = mbuf_udp_hdr(m);
         wsh = mbuf_ws_hdr(m);
-        sprintf(log, "muf: %s -> %s " IPV4_FMT ":%u ->" IPV4_FMT ":%u proto %u ws_type: %u ws_seg: %lu payload_size: %lu\n",
+        sprintf(log, "muf: %s -> %s " IPV4_FMT ":%u ->" IPV4_FMT ":%u proto %u ws_type: %u ws_seg: %u payload_size: %lu\n",
             smac, dmac, IPV4_STR(iph->saddr), ntohs(uh->source), IPV4_STR(iph->daddr), ntohs(uh->dest), iph->protocol, 
             wsh->workload_type_, wsh->segment_num_, strlen((char*)wsh + sizeof(struct ws_hdr)));
     } else if (eh->type == htons(ETHERTYPE_IPV6)) {
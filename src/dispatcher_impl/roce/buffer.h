@@ -37,7 +37,7 @@ class Buffer {
     uh = reinterpret_cast<udphdr*>(get_uh());
     wsh = reinterpret_cast<ws_hdr*>(get_ws_hdr());
     snprintf(log, sizeof(log),
-        "buffer: %u -> %u, ws_type: %u, ws_seg: %lu, payload_size: %lu\n",
+        "buffer: %u -> %u, ws_type: %u, ws_seg: %u, payload_size: %lu\n",
         ntohs(uh->source),
         ntohs(uh->dest),
         wsh->workload_type_,
@@ -21,6 +21,9 @@ class QPInfo {
     uint8_t gid[16];                  // Global Identifier (GID)
     uint8_t gid_table_index;          // GID Table Index
     uint32_t mtu;                     // Maximum Transmission Unit (MTU)
+    uint32_t psn;                     // Initial Packet Sequence Number
+    uint32_t rkey;                    // Remote key of the registered region (one-sided modes)
+    uint64_t mr_addr;                 // Base address of the registered region (one-sided modes)
     uint8_t mac_addr[6];              // MAC Address
     char hostname[MAX_HOSTNAME_LEN];  // Hostname
     char nic_name[MAX_NIC_NAME_LEN];  // Network Interface Name (e.g., rdma0)
@@ -34,6 +37,9 @@ class QPInfo {
           lid(lid),
           gid_table_index(0),
           mtu(mtu),
+          psn(0),
+          rkey(0),
+          mr_addr(0),
           is_initialized(false) {
         if (gid_ptr != nullptr) {
             std::memcpy(gid, gid_ptr, 16);
@@ -53,6 +59,9 @@ class QPInfo {
         qp_num = other.qp_num;
         lid = other.lid;
         mtu = other.mtu;
+        psn = other.psn;
+        rkey = other.rkey;
+        mr_addr = other.mr_addr;
         gid_table_index = other.gid_table_index;
         std::memcpy(gid, other.gid, 16);
         std::memcpy(mac_addr, other.mac_addr, 6);
@@ -66,6 +75,9 @@ class QPInfo {
             qp_num = other.qp_num;
             lid = other.lid;
             mtu = other.mtu;
+            psn = other.psn;
+            rkey = other.rkey;
+            mr_addr = other.mr_addr;
             gid_table_index = other.gid_table_index;
             std::memcpy(gid, other.gid, 16);
             std::memcpy(mac_addr, other.mac_addr, 6);
@@ -155,6 +167,9 @@ class QPInfo {
             serializedData += std::to_string(static_cast<int>(mac_addr[i])) + ",";
         }
         serializedData += ";mtu:" + std::to_string(mtu) + ";";
+        serializedData += "psn:" + std::to_string(psn) + ";";
+        serializedData += "rkey:" + std::to_string(rkey) + ";";
+        serializedData += "mr_addr:" + std::to_string(mr_addr) + ";";
         serializedData += "hostname:" + std::string(hostname) + ";";
         serializedData += "nic_name:" + std::string(nic_name) + ";";
         serializedData += "is_initialized:" + std::to_string(is_initialized);
@@ -196,6 +211,12 @@ class QPInfo {
                 }
             } else if (key == "mtu") {
                 mtu = static_cast<uint32_t>(std::stoi(value));
+            } else if (key == "psn") {
+                psn = static_cast<uint32_t>(std::stoul(value));
+            } else if (key == "rkey") {
+                rkey = static_cast<uint32_t>(std::stoul(value));
+            } else if (key == "mr_addr") {
+                mr_addr = static_cast<uint64_t>(std::stoull(value));
             } else if (key == "hostname") {
                 std::strncpy(hostname, value.c_str(), sizeof(hostname) - 1);
                 hostname[sizeof(hostname) - 1] = '\0'; // Ensure null termination
@@ -209,6 +230,29 @@ class QPInfo {
     }
 };
 
+// Serialize the QP info of all dispatchers on a host into one message,
+// one "<key>|<QPInfo>" entry per line
+inline std::string serialize_qp_info_batch(const std::map<uint16_t, QPInfo>& qp_infos) {
+    std::string serializedData;
+    for (const auto& entry : qp_infos) {
+        serializedData += std::to_string(static_cast<int>(entry.first)) + "|";
+        serializedData += entry.second.serialize() + "\n";
+    }
+    return serializedData;
+}
+
+inline void deserialize_qp_info_batch(const std::string& serializedData,
+                                      std::map<uint16_t, QPInfo>* qp_infos) {
+    std::istringstream iss(serializedData);
+    std::string line;
+    while (std::getline(iss, line, '\n')) {
+        size_t sep = line.find('|');
+        if (sep == std::string::npos) continue;
+        uint16_t key = static_cast<uint16_t>(std::stoi(line.substr(0, sep)));
+        (*qp_infos)[key].deserialize(line.substr(sep + 1));
+    }
+}
+
 // Global QP info collection function (commented out)
 // void collect_global_qp_info(
 //     const std::vector<QPInfo>& local_qp_info,
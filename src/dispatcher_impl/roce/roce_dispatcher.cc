@@ -19,7 +19,8 @@ static constexpr size_t kDefaultGIDIndex = 3;   // Currently, the GRH (ipv4 + ud
 // when the hugepage allocator is provided.
 
 RoceDispatcher::RoceDispatcher(uint8_t ws_id, uint8_t phy_port, size_t numa_node, UserConfig *user_config)
-  : Dispatcher(DispatcherType::kDPDK, ws_id, phy_port, numa_node, user_config) {
+  : Dispatcher(DispatcherType::kDPDK, ws_id, phy_port, numa_node, user_config), ws_id_(ws_id) {
+    set_queue_sizes(derive_queue_sizes(user_config->footprint_config_, kDmaBufSize, kRxRingInPool));
     common_resolve_phy_port(user_config->server_config_->device_name, phy_port, kMTU, resolve_);
     roce_resolve_phy_port();
 
@@ -29,6 +30,17 @@ RoceDispatcher::RoceDispatcher(uint8_t ws_id, uint8_t phy_port, size_t numa_node
     daddr_ = new ipaddr_t;
     ipaddr_init(daddr_, kRemoteIpStr);
 
+    // Peers are the remote dispatchers of every workload served by this dispatcher
+    auto *workloads_config = user_config->workloads_config_;
+    for (auto &workload : workloads_config->workload_dispatcher_map) {
+      if (std::find(workload.second.begin(), workload.second.end(), ws_id) == workload.second.end()) continue;
+      for (uint8_t peer : workloads_config->workload_remote_dispatcher_map[workload.first]) {
+        rt_assert(peer < kWorkspaceMaxNum, "Invalid remote dispatcher");
+        if (std::find(peer_ids_.begin(), peer_ids_.end(), peer) == peer_ids_.end()) peer_ids_.push_back(peer);
+      }
+    }
+    rt_assert(!peer_ids_.empty(), "Dispatcher has no remote dispatcher");
+
     init_verbs_structs(ws_id);
     /// register memory region and register mem alloc/dealloc function
     init_mem_reg_funcs(numa_node);
@@ -47,22 +59,27 @@ RoceDispatcher::~RoceDispatcher() {
   }
   DPERF_INFO("Deregistered %zu MB (lkey = %u)\n", mr_->length / MB(1), mr_->lkey);
   // delete Buffer in rx_queue_
-  for (size_t i = 0; i < kRQDepth; i++) {
+  for (size_t i = 0; i < rx_ring_size_; i++) {
     delete rx_ring_[i];
   }
-  // delete SHM
+  // delete slab and SHM
+  slab_->print_stats();
+  delete slab_;
   delete huge_alloc_;
 
   // Destroy QPs and CQs. QPs must be destroyed before CQs.
-  exit_assert(ibv_destroy_qp(qp_) == 0, "Failed to destroy send QP");
+  #if RoCE_TYPE == UD
+    exit_assert(ibv_destroy_qp(qp_) == 0, "Failed to destroy send QP");
+  #elif RoCE_TYPE == RC
+    for (uint8_t peer : peer_ids_) {
+      exit_assert(ibv_destroy_qp(peers_[peer].qp_) == 0, "Failed to destroy send QP");
+    }
+    exit_assert(ibv_destroy_srq(srq_) == 0, "Failed to destroy SRQ");
+  #endif
   exit_assert(ibv_destroy_cq(send_cq_) == 0, "Failed to destroy send CQ");
   exit_assert(ibv_destroy_cq(recv_cq_) == 0, "Failed to destroy recv CQ");
 
   exit_assert(ibv_destroy_ah(self_ah_) == 0, "Failed to destroy self AH");
-  if (remote_ah_ != nullptr) {
-      exit_assert(ibv_destroy_ah(remote_ah_) == 0,
-                  "Failed to destroy remote AH");
-  }
   for (auto *_ah : ah_to_free_vec) {
     exit_assert(ibv_destroy_ah(_ah) == 0, "Failed to destroy AH");
   }
@@ -97,21 +114,30 @@ void RoceDispatcher::fill_local_routing_info(routing_info_t *routing_info) const
   ib_routing_info->gid = resolve_.gid;
 }
 
-void RoceDispatcher::set_local_qp_info(QPInfo *qp_info) {
-  qp_info->qp_num = qp_id_;
+void RoceDispatcher::set_local_qp_info(QPInfo *qp_info, struct ibv_qp *qp) {
+  qp_info->qp_num = qp->qp_num;
   qp_info->lid = resolve_.port_lid;
   for (size_t i = 0; i < 16; i++) {
     qp_info->gid[i] = resolve_.gid.raw[i];
   }
   qp_info->gid_table_index = resolve_.gid_index;
   qp_info->mtu = kMTU;
+  qp_info->psn = local_psn(qp);
+  qp_info->rkey = mr_->rkey;
+  qp_info->mr_addr = reinterpret_cast<uint64_t>(mr_->addr);
   memcpy(qp_info->nic_name, resolve_.ib_ctx->device->name, MAX_NIC_NAME_LEN);
   memcpy(qp_info->mac_addr, resolve_.mac_addr, 6);
   qp_info->is_initialized = true;
 }
 
-bool RoceDispatcher::set_remote_qp_info(QPInfo *qp_info) {
-  remote_qp_id_ = qp_info->qp_num;
+void RoceDispatcher::publish_qp_info(std::map<uint16_t, QPInfo> *qp_infos) {
+  for (uint8_t peer : peer_ids_) {
+    set_local_qp_info(&(*qp_infos)[qp_key(ws_id_, peer)], peers_[peer].qp_);
+  }
+}
+
+bool RoceDispatcher::set_remote_qp_info(uint8_t peer, QPInfo *qp_info) {
+  peers_[peer].qpn_ = qp_info->qp_num;
   struct ibv_ah_attr ah_attr = {};
             ah_attr.sl = 0;
             ah_attr.src_path_bits = 0;
@@ -123,9 +149,10 @@ bool RoceDispatcher::set_remote_qp_info(QPInfo *qp_info) {
             ah_attr.grh.hop_limit = 2;
             ah_attr.grh.traffic_class = 0;
 
-            remote_ah_ = ibv_create_ah(pd_, &ah_attr);
+            peers_[peer].ah_ = ibv_create_ah(pd_, &ah_attr);
 
-  rt_assert(remote_ah_ != nullptr, "Failed to create remote AH.");
+  rt_assert(peers_[peer].ah_ != nullptr, "Failed to create remote AH.");
+  ah_to_free_vec.push_back(peers_[peer].ah_);
   return true;
 }
 
@@ -163,12 +190,43 @@ void RoceDispatcher::init_verbs_structs(uint8_t ws_id) {
   pd_ = ibv_alloc_pd(resolve_.ib_ctx);
   rt_assert(pd_ != nullptr, "Failed to allocate PD");
 
-  send_cq_ = ibv_create_cq(resolve_.ib_ctx, kSQDepth, nullptr, nullptr, 0);
+  send_cq_ = ibv_create_cq(resolve_.ib_ctx, tx_ring_size_, nullptr, nullptr, 0);
   rt_assert(send_cq_ != nullptr, "Failed to create SEND CQ. Forgot hugepages?");
 
-  recv_cq_ = ibv_create_cq(resolve_.ib_ctx, kRQDepth, nullptr, nullptr, 0);
+  recv_cq_ = ibv_create_cq(resolve_.ib_ctx, rx_ring_size_, nullptr, nullptr, 0);
   rt_assert(recv_cq_ != nullptr, "Failed to create SEND CQ");
 
+  #if RoCE_TYPE == UD
+    // One UD QP reaches every peer through per-peer address handles
+    qp_ = create_qp();
+    for (uint8_t peer : peer_ids_) peers_[peer].qp_ = qp_;
+  #elif RoCE_TYPE == RC
+    // One RC QP per peer. All of them share one RECV queue, so the RX ring
+    // is the same as with a single QP.
+    struct ibv_srq_init_attr srq_attr;
+    memset(static_cast<void *>(&srq_attr), 0, sizeof(struct ibv_srq_init_attr));
+    srq_attr.attr.max_wr = rx_ring_size_;
+    srq_attr.attr.max_sge = 1;
+    srq_ = ibv_create_srq(pd_, &srq_attr);
+    rt_assert(srq_ != nullptr, "Failed to create SRQ");
+    for (uint8_t peer : peer_ids_) peers_[peer].qp_ = create_qp();
+    qp_ = peers_[peer_ids_[0]].qp_;
+  #endif
+  qp_id_ = qp_->qp_num;
+
+  // Create self address handle. We use local routing info for convenience,
+  // so this must be done after creating the QP.
+  routing_info_t self_routing_info;
+  fill_local_routing_info(&self_routing_info);
+  self_ah_ =
+      create_ah(reinterpret_cast<ib_routing_info_t *>(&self_routing_info));
+  rt_assert(self_ah_ != nullptr, "Failed to create self AH.");
+
+  // RECVs can be posted in INIT state. RTR and RTS need the remote QP info,
+  // see connect_qps().
+}
+
+struct ibv_qp *RoceDispatcher::create_qp() {
   // Initialize QP creation attributes
   struct ibv_qp_init_attr create_attr;
   memset(static_cast<void *>(&create_attr), 0, sizeof(struct ibv_qp_init_attr));
@@ -176,42 +234,19 @@ void RoceDispatcher::init_verbs_structs(uint8_t ws_id) {
   create_attr.recv_cq = recv_cq_;
   #if RoCE_TYPE == UD
     create_attr.qp_type = IBV_QPT_UD;
+    create_attr.cap.max_recv_wr = rx_ring_size_;
   #elif RoCE_TYPE == RC
     create_attr.qp_type = IBV_QPT_RC;
+    create_attr.srq = srq_;
   #endif
 
-  create_attr.cap.max_send_wr = kSQDepth;
-  create_attr.cap.max_recv_wr = kRQDepth;
+  create_attr.cap.max_send_wr = tx_ring_size_;
   create_attr.cap.max_send_sge = 1;
   create_attr.cap.max_recv_sge = 1;
   create_attr.cap.max_inline_data = kMaxInline;
 
-  qp_ = ibv_create_qp(pd_, &create_attr);
-  rt_assert(qp_ != nullptr, "Failed to create QP");
-  qp_id_ = qp_->qp_num;
-
-  /// create management TCP connection
-  struct QPInfo qp_info;
-  struct QPInfo remote_qp_info;
-  set_local_qp_info(&qp_info);
-  #if NODE_TYPE == SERVER
-    TCPServer mgnt_server(kDefaultMngtPort + ws_id);
-    // DPERF_INFO("Waiting for connection, port %d\n", kDefaultMngtPort + ws_id);
-    mgnt_server.acceptConnection();
-    mgnt_server.sendMsg(qp_info.serialize());
-    remote_qp_info.deserialize(mgnt_server.receiveMsg());
-    mgnt_server.disconnect();
-  #elif NODE_TYPE == CLIENT
-    TCPClient mgnt_client;
-    mgnt_client.connectToServer(kRemoteIpStr, kDefaultMngtPort + ws_id);
-    mgnt_client.sendMsg(qp_info.serialize());
-    remote_qp_info.deserialize(mgnt_client.receiveMsg());
-    mgnt_client.disconnect();
-  #endif
-
-  #if RoCE_TYPE == UD
-    set_remote_qp_info(&remote_qp_info);
-  #endif
+  struct ibv_qp *qp = ibv_create_qp(pd_, &create_attr);
+  rt_assert(qp != nullptr, "Failed to create QP");
 
   // Transition QP to INIT state
   struct ibv_qp_attr init_attr;
@@ -227,16 +262,39 @@ void RoceDispatcher::init_verbs_structs(uint8_t ws_id) {
     int attr_mask = IBV_QP_STATE | IBV_QP_PKEY_INDEX | IBV_QP_PORT | IBV_QP_ACCESS_FLAGS;
   #endif
 
-  if (ibv_modify_qp(qp_, &init_attr, attr_mask) != 0) {
+  if (ibv_modify_qp(qp, &init_attr, attr_mask) != 0) {
     throw std::runtime_error("Failed to modify QP to init");
   }
+  return qp;
+}
+
+void RoceDispatcher::connect_qps(std::map<uint16_t, QPInfo> *remote_qp_info) {
+  for (uint8_t peer : peer_ids_) {
+    auto it = remote_qp_info->find(qp_key(peer, ws_id_));
+    if (it == remote_qp_info->end()) {
+      DPERF_ERROR("Remote dispatcher %u has no QP for local dispatcher %u, check the remote workload config\n",
+                  peer, ws_id_);
+      throw std::runtime_error("Missing remote QP info");
+    }
+  #if RoCE_TYPE == UD
+    set_remote_qp_info(peer, &it->second);
+  #elif RoCE_TYPE == RC
+    connect_qp(peers_[peer].qp_, &it->second);
+  #endif
+  }
+  #if RoCE_TYPE == UD
+    connect_qp(qp_, nullptr);
+  #endif
+  DPERF_INFO("Dispatcher %u connected to %zu remote dispatchers\n", ws_id_, peer_ids_.size());
+}
 
+void RoceDispatcher::connect_qp(struct ibv_qp *qp, QPInfo *remote_qp_info) {
   // RTR state
   struct ibv_qp_attr rtr_attr;
   memset(static_cast<void *>(&rtr_attr), 0, sizeof(struct ibv_qp_attr));
   rtr_attr.qp_state = IBV_QPS_RTR;
   #if RoCE_TYPE == UD
-    if (ibv_modify_qp(qp_, &rtr_attr, IBV_QP_STATE)) {
+    if (ibv_modify_qp(qp, &rtr_attr, IBV_QP_STATE)) {
       throw std::runtime_error("Failed to modify QP to RTR");
     }
   #elif RoCE_TYPE == RC
@@ -253,22 +311,22 @@ void RoceDispatcher::init_verbs_structs(uint8_t ws_id) {
       default:
         DPERF_ERROR("Invalid MTU when setting RDMA QP's RTR state: %zu\n", kMTU);
     }
-    rtr_attr.dest_qp_num = remote_qp_info.qp_num;
-    rtr_attr.rq_psn = 0;
+    rtr_attr.dest_qp_num = remote_qp_info->qp_num;
+    rtr_attr.rq_psn = remote_qp_info->psn;
     rtr_attr.max_dest_rd_atomic = 1;
     rtr_attr.min_rnr_timer = 12;
 
     rtr_attr.ah_attr.sl = 0;
     rtr_attr.ah_attr.src_path_bits = 0;
     rtr_attr.ah_attr.port_num = 1;
-    rtr_attr.ah_attr.dlid = remote_qp_info.lid;
-    memcpy(&rtr_attr.ah_attr.grh.dgid, remote_qp_info.gid, 16);
+    rtr_attr.ah_attr.dlid = remote_qp_info->lid;
+    memcpy(&rtr_attr.ah_attr.grh.dgid, remote_qp_info->gid, 16);
     rtr_attr.ah_attr.is_global = 1;
     rtr_attr.ah_attr.grh.sgid_index = kDefaultGIDIndex;
     rtr_attr.ah_attr.grh.hop_limit = 2;
     rtr_attr.ah_attr.grh.traffic_class = 0;
 
-    if (ibv_modify_qp(qp_, &rtr_attr,
+    if (ibv_modify_qp(qp, &rtr_attr,
                       IBV_QP_STATE | IBV_QP_AV | IBV_QP_PATH_MTU |
                           IBV_QP_DEST_QPN | IBV_QP_RQ_PSN |
                           IBV_QP_MAX_DEST_RD_ATOMIC | IBV_QP_MIN_RNR_TIMER)) {
@@ -276,20 +334,12 @@ void RoceDispatcher::init_verbs_structs(uint8_t ws_id) {
     }
   #endif
 
-  // Create self address handle. We use local routing info for convenience,
-  // so this must be done after creating the QP.
-  routing_info_t self_routing_info;
-  fill_local_routing_info(&self_routing_info);
-  self_ah_ =
-      create_ah(reinterpret_cast<ib_routing_info_t *>(&self_routing_info));
-  rt_assert(self_ah_ != nullptr, "Failed to create self AH.");
-
   // Reuse rtr_attr for RTS
   rtr_attr.qp_state = IBV_QPS_RTS;
-  rtr_attr.sq_psn = 0;  // PSN does not matter for UD QPs
+  rtr_attr.sq_psn = local_psn(qp);  // PSN does not matter for UD QPs
 
   #if RoCE_TYPE == UD
-    if (ibv_modify_qp(qp_, &rtr_attr, IBV_QP_STATE | IBV_QP_SQ_PSN)) {
+    if (ibv_modify_qp(qp, &rtr_attr, IBV_QP_STATE | IBV_QP_SQ_PSN)) {
       throw std::runtime_error("Failed to modify QP to RTS");
     }
   #elif RoCE_TYPE == RC
@@ -298,7 +348,7 @@ void RoceDispatcher::init_verbs_structs(uint8_t ws_id) {
     rtr_attr.rnr_retry = 7;
     rtr_attr.max_rd_atomic = 1;
 
-    if (ibv_modify_qp(qp_, &rtr_attr,
+    if (ibv_modify_qp(qp, &rtr_attr,
                       IBV_QP_STATE | IBV_QP_TIMEOUT | IBV_QP_RETRY_CNT |
                           IBV_QP_RNR_RETRY | IBV_QP_SQ_PSN | IBV_QP_MAX_QP_RD_ATOMIC)) {
         throw std::runtime_error("Failed to modify QP to RTS");
@@ -320,38 +370,59 @@ void RoceDispatcher::init_verbs_structs(uint8_t ws_id) {
   // }
 }
 
+void RoceDispatcher::exchange_qp_info(const char *remote_ip,
+                                      const std::map<uint16_t, QPInfo> &local_qp_info,
+                                      std::map<uint16_t, QPInfo> *remote_qp_info) {
+  auto start = std::chrono::steady_clock::now();
+  std::string local_msg = serialize_qp_info_batch(local_qp_info);
+  std::string remote_msg;
+  #if NODE_TYPE == SERVER
+    TCPServer mgnt_server(kDefaultMngtPort);
+    mgnt_server.acceptConnection();
+    mgnt_server.sendFrameMsg(local_msg);
+    remote_msg = mgnt_server.receiveFrameMsg();
+    mgnt_server.disconnect();
+  #elif NODE_TYPE == CLIENT
+    TCPClient mgnt_client;
+    mgnt_client.connectToServer(remote_ip, kDefaultMngtPort, kMngtConnectTimeoutMs);
+    mgnt_client.sendFrameMsg(local_msg);
+    remote_msg = mgnt_client.receiveFrameMsg();
+    mgnt_client.disconnect();
+  #endif
+  deserialize_qp_info_batch(remote_msg, remote_qp_info);
+  DPERF_INFO("Exchanged QP info of %zu local / %zu remote QPs in %.3f ms\n",
+             local_qp_info.size(), remote_qp_info->size(),
+             std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+}
+
 /// Mbuf allocation function
-Buffer * roce_mbuf_alloc(void *huge_alloc) {
-  Buffer * mbuf = ((HugeAlloc*)huge_alloc)->alloc(RoceDispatcher::kMbufSize); // Currently only support fixed size mbuf
-  return mbuf;
+Buffer * roce_mbuf_alloc(void *cache) {
+  return ((SlabAlloc::Cache*)cache)->alloc();
 }
 
 /// Mbuf bulk allocation function
-uint8_t roce_mbuf_alloc_bulk(void *huge_alloc, Buffer **mbufs, size_t num) {
-  for (size_t i = 0; i < num; i++) {
-    mbufs[i] = ((HugeAlloc*)huge_alloc)->alloc(RoceDispatcher::kMbufSize); // Currently only support fixed size mbuf
-    if (mbufs[i]->buf_ == nullptr) {
-      for (size_t j = 0; j < i; j++) {
-        ((HugeAlloc*)huge_alloc)->free_buf(mbufs[j]);
-      }
-      return -1;
-    }
-  }
-  return 0;
+uint8_t roce_mbuf_alloc_bulk(void *cache, Buffer **mbufs, size_t num) {
+  return ((SlabAlloc::Cache*)cache)->alloc_bulk(mbufs, num);
 }
 
-/// Mbuf de-allocation function
-void roce_mbuf_de_alloc(Buffer *mbuf, void *huge_alloc) { 
-  mbuf->state_ = Buffer::kFREE_BUF;
-  return;
+/// Mbuf de-allocation function, RX ring entries go back to the RX ring
+void roce_mbuf_de_alloc(Buffer *mbuf, void *cache) { 
+  SlabAlloc::Cache *c = (SlabAlloc::Cache*)cache;
+  if (likely(c->get_slab()->owns(mbuf))) {
+    c->free(mbuf);
+  } else {
+    mbuf->state_ = Buffer::kFREE_BUF;
+  }
 }
 
 /// Mbuf bulk de-allocation function
-void roce_mbuf_de_alloc_bulk(Buffer **mbufs, size_t num, void *huge_alloc) {
-  for (size_t i = 0; i < num; i++) {
-    mbufs[i]->state_ = Buffer::kFREE_BUF;
-  }
-  return;
+void roce_mbuf_de_alloc_bulk(Buffer **mbufs, size_t num, void *cache) {
+  ((SlabAlloc::Cache*)cache)->release(mbufs, num);
+}
+
+/// Every workspace allocates through its own cache of the dispatcher's slab
+void* roce_mbuf_local_cache(void *cache) {
+  return ((SlabAlloc::Cache*)cache)->get_slab()->new_cache();
 }
 
 /// Set mbuf payload
@@ -384,34 +455,41 @@ void roce_cp_payload(Buffer *dst, Buffer *src, char* uh, char* ws_header, size_t
 void RoceDispatcher::init_mem_reg_funcs(uint8_t numa_node) {
   std::ostringstream xmsg;  // The exception message
 
+  /// the region holds the RX ring and the TX slab, sized per queue
+  const size_t rx_ring_region_size = rx_ring_size_ * kMbufSize;
+  const size_t mem_region_size = rx_ring_region_size + mempool_size_ * kMbufSize;
+  dma_footprint_ = mem_region_size;
   /// create huge page allocator
-  huge_alloc_ = new HugeAlloc(kMemRegionSize, numa_node);
+  huge_alloc_ = new HugeAlloc(mem_region_size, numa_node);
   /// alloc and register memory region
-  Buffer raw_mr = huge_alloc_->alloc_raw(kMemRegionSize, DoRegister::kTrue);
+  Buffer raw_mr = huge_alloc_->alloc_raw(mem_region_size, DoRegister::kTrue);
   if (raw_mr.buf_ == nullptr) {
     xmsg << "Failed to allocate " << std::setprecision(2)
-         << 1.0 * kMemRegionSize / MB(1) << "MB for ring buffers. "
+         << 1.0 * mem_region_size / MB(1) << "MB for ring buffers. "
          << HugeAlloc::kAllocFailHelpStr;
     throw std::runtime_error(xmsg.str());
   }
-  mr_ = ibv_reg_mr(pd_, raw_mr.buf_, kMemRegionSize, IBV_ACCESS_LOCAL_WRITE | IBV_ACCESS_REMOTE_WRITE | IBV_ACCESS_REMOTE_READ | IBV_ACCESS_REMOTE_ATOMIC);
+  mr_ = ibv_reg_mr(pd_, raw_mr.buf_, mem_region_size, IBV_ACCESS_LOCAL_WRITE | IBV_ACCESS_REMOTE_WRITE | IBV_ACCESS_REMOTE_READ | IBV_ACCESS_REMOTE_ATOMIC);
   rt_assert(mr_ != nullptr, "Failed to register mr.");
   raw_mr.set_lkey(mr_->lkey);
-  /// split the raw buffer to freelist
-  huge_alloc_->add_raw_buffer(raw_mr, kMemRegionSize);
+  /// the head of the region backs the RX ring, the rest is a fixed-size slab for TX mbufs
+  huge_alloc_->add_raw_buffer(raw_mr, rx_ring_region_size);
+  Buffer slab_region(raw_mr.buf_ + rx_ring_region_size, mempool_size_ * kMbufSize, raw_mr.lkey_);
+  slab_ = new SlabAlloc(huge_alloc_, slab_region, mempool_size_, kMbufSize);
+  tx_cache_ = slab_->new_cache();
 
   /// init rx / tx ring
   init_recvs();
   init_sends();
   /// register memory region and register mem alloc/dealloc function
-  mem_reg_info_ = new mem_reg_info<Buffer>(huge_alloc_, &roce_mbuf_alloc, &roce_mbuf_de_alloc, &roce_mbuf_alloc_bulk, &roce_mbuf_de_alloc_bulk, &roce_set_mbuf_paylod, &roce_extracr_ws_hdr, &roce_cp_payload);
+  mem_reg_info_ = new mem_reg_info<Buffer>(tx_cache_, &roce_mbuf_alloc, &roce_mbuf_de_alloc, &roce_mbuf_alloc_bulk, &roce_mbuf_de_alloc_bulk, &roce_set_mbuf_paylod, &roce_extracr_ws_hdr, &roce_cp_payload, &roce_mbuf_local_cache);
 }
 
 void RoceDispatcher::init_recvs() {
   std::ostringstream xmsg;  // The exception message
 
   // Initialize the memory region for RECVs
-  const size_t ring_extent_size = kRQDepth * kMbufSize;
+  const size_t ring_extent_size = rx_ring_size_ * kMbufSize;
   assert(ring_extent_size <= HugeAlloc::k_max_class_size); // Currently the max memory size for rx ring is k_max_class_size
 
   Buffer * ring_extent = huge_alloc_->alloc(ring_extent_size);
@@ -423,7 +501,7 @@ void RoceDispatcher::init_recvs() {
   }
 
   // Initialize constant fields of RECV descriptors
-  for (size_t i = 0; i < kRQDepth; i++) {
+  for (size_t i = 0; i < rx_ring_size_; i++) {
     uint8_t *buf = ring_extent->buf_;
     // Break down the memory space into fixed-length (kMbufSize) chunks
   #if RoCE_TYPE == UD
@@ -450,37 +528,43 @@ void RoceDispatcher::init_recvs() {
     rx_ring_[i]->state_ = Buffer::kPOSTED;
 
     // Circular link
-    recv_wr[i].next = (i < kRQDepth - 1) ? &recv_wr[i + 1] : &recv_wr[0];
+    recv_wr[i].next = (i < rx_ring_size_ - 1) ? &recv_wr[i + 1] : &recv_wr[0];
   }
 
   // Curcular link rx ring
-  for (size_t i = 0; i < kRQDepth; i++) {
-    rx_ring_[i]->next_ = (i < kRQDepth - 1) ? rx_ring_[i + 1] : rx_ring_[0];
+  for (size_t i = 0; i < rx_ring_size_; i++) {
+    rx_ring_[i]->next_ = (i < rx_ring_size_ - 1) ? rx_ring_[i + 1] : rx_ring_[0];
   }
 
   // Fill the RECV queue. post_recvs() can use fast RECV and therefore not
   // actually fill the RQ, so post_recvs() isn't usable here.
   struct ibv_recv_wr *bad_wr;
-  recv_wr[kRQDepth - 1].next = nullptr;  // Breaker of chains, mother of dragons
+  recv_wr[rx_ring_size_ - 1].next = nullptr;  // Breaker of chains, mother of dragons
 
-  int ret = ibv_post_recv(qp_, &recv_wr[0], &bad_wr);
+  #if RoCE_TYPE == UD
+    int ret = ibv_post_recv(qp_, &recv_wr[0], &bad_wr);
+  #elif RoCE_TYPE == RC
+    int ret = ibv_post_srq_recv(srq_, &recv_wr[0], &bad_wr);
+  #endif
   rt_assert(ret == 0, "Failed to fill RECV queue.");
 
-  recv_wr[kRQDepth - 1].next = &recv_wr[0];  // Restore circularity
+  recv_wr[rx_ring_size_ - 1].next = &recv_wr[0];  // Restore circularity
 }
 
 void RoceDispatcher::init_sends() {
-  for (size_t i = 0; i < kSQDepth; i++) {
+  free_send_wr_num_ = tx_ring_size_;
+  for (size_t i = 0; i < tx_ring_size_; i++) {
     #if RoCE_TYPE == UD
       send_wr[i].wr.ud.remote_qkey = kQKey;
     #endif
+    send_wr[i].wr_id = i;
     send_wr[i].opcode = IBV_WR_SEND;
     send_wr[i].send_flags = IBV_SEND_SIGNALED;
     send_wr[i].sg_list = &send_sgl[i];
     send_wr[i].num_sge = 1;
 
     // Curcular link send wr
-    send_wr[i].next = (i < kSQDepth - 1) ? &send_wr[i + 1] : &send_wr[0];
+    send_wr[i].next = (i < tx_ring_size_ - 1) ? &send_wr[i + 1] : &send_wr[0];
   }
 }
 
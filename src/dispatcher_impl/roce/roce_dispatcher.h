@@ -9,11 +9,13 @@
 #include "verbs_common.h"
 #include "qpinfo.hh"
 #include "huge_alloc.h"
+#include "slab_alloc.h"
 #include "buffer.h"
 
 #include "util/lock_free_queue.h"
 #include "util/rule_table.h"
 #include "util/logger.h"
+#include "util/timer.h"
 #include "util/mgnt_connection.h"
 
 
@@ -29,12 +31,14 @@ class RoceDispatcher : public Dispatcher {
     static constexpr size_t kInvalidQpId = SIZE_MAX;
     static constexpr size_t kMaxRoutingInfoSize = 48;  ///< Space for routing info
 
-    static constexpr size_t kRQDepth = kNumRxRingEntries;   ///< RECV queue depth
-    static constexpr size_t kSQDepth = kNumTxRingEntries;   ///< Send queue depth
+    static constexpr size_t kRQDepth = kNumRxRingEntries;   ///< Max RECV queue depth, the depth is rx_ring_size_
+    static constexpr size_t kSQDepth = kNumTxRingEntries;   ///< Max send queue depth, the depth is tx_ring_size_
     static constexpr size_t kMbufSize = 4096;    ///< RECV size (if UD, make sure GRH is included in first 64B, where kMbufSize = kMTU + GRH)
-    static constexpr size_t kMemRegionSize = (kMemPoolSize) * kMbufSize;  ///< Memory region size
+    static constexpr size_t kDmaBufSize = kMbufSize;        ///< Bytes of one buffer in the registered region
+    static constexpr bool kRxRingInPool = false;            ///< RECV buffers have their own region, the slab only backs TX
 
     static constexpr size_t kMaxInline = 60;   ///< Maximum send wr inline data
+    static constexpr size_t kMngtConnectTimeoutMs = 60000;  ///< How long a client waits for the server's control plane
 
     /// Ideally, the connection handshake should establish a secure queue key.
     /// For now, anything outside 0xffff0000..0xffffffff (reserved by CX3) works.
@@ -85,6 +89,13 @@ class RoceDispatcher : public Dispatcher {
     struct ibv_ah *ah;
   };
 
+  /// Connection state toward one remote dispatcher
+  struct peer_t {
+    struct ibv_qp *qp_ = nullptr;   ///< QP used to reach this peer (shared by all peers in UD)
+    struct ibv_ah *ah_ = nullptr;   ///< UD only: address handle of this peer
+    uint32_t qpn_ = 0;              ///< UD only: remote QPN
+  };
+
   /**
    * ----------------------RoceDispatcher methods----------------------
    */ 
@@ -98,6 +109,33 @@ class RoceDispatcher : public Dispatcher {
     RoceDispatcher(uint8_t ws_id, uint8_t phy_port, size_t numa_node, UserConfig *user_config);
     ~RoceDispatcher();
 
+    /**
+     * @brief Exchange the QP info of all dispatchers on this host with the
+     * remote host over a single control-plane connection
+     * @param remote_ip The IP address of the remote host
+     * @param local_qp_info Map local dispatcher ws_id to its QP info
+     * @param remote_qp_info Filled with the remote dispatchers' QP info
+     */
+    static void exchange_qp_info(const char *remote_ip,
+                                 const std::map<uint16_t, QPInfo> &local_qp_info,
+                                 std::map<uint16_t, QPInfo> *remote_qp_info);
+
+    /// Key of the QP from local dispatcher \p src to remote dispatcher \p dst
+    static constexpr uint16_t qp_key(uint8_t src, uint8_t dst) {
+      return (static_cast<uint16_t>(src) << 8) | dst;
+    }
+
+    /// Add the QP info of every peer of this dispatcher to \p qp_infos
+    void publish_qp_info(std::map<uint16_t, QPInfo> *qp_infos);
+
+    /**
+     * @brief Bring the QPs of all peers from INIT to RTS, and build the
+     * per-peer address handle table in UD mode
+     * @param remote_qp_info QP info published by the remote host
+     * @throw runtime_error if a peer is missing or the transitions fail
+     */
+    void connect_qps(std::map<uint16_t, QPInfo> *remote_qp_info);
+
     /* ----------------------Defined in roce_dispatcher_dataplane.cc---------------------- */
     /**
      * @brief This method will iterate all workspaces in the workspace context 
@@ -142,6 +180,16 @@ class RoceDispatcher : public Dispatcher {
     template<pkt_handler_type_t handler>
     size_t pkt_handler_server();
 
+    /**
+     *  \note     echo behavior:
+     *            [1] swap the IP and MAC address, address the UDP header to the sender's dispatcher;
+     *            [2] insert the RX ring buffers to tx queue as they are (zero copy);
+     *            [3] drop packets if the tx queue is full;
+     *            the buffers go back to the RECV queue once their SENDs complete
+     *  \example  l2_reflector, e.g., OvS simple action
+     */
+    size_t echo_handler();
+
   /**
    * ----------------------Util methods----------------------
    */ 
@@ -167,15 +215,24 @@ class RoceDispatcher : public Dispatcher {
 
     void add_ws_rx_queue(uint8_t ws_id, lock_free_queue *queue) {
       ws_rx_queues_[ws_id] = queue;
+      rx_rule_table_->set_queue(ws_id, queue);
     }
 
-    void add_rx_rule(uint8_t workload_type, uint8_t ws_id) {
+    void add_rx_rule(uint8_t workload_type, uint8_t ws_id, uint8_t weight = 1) {
+      rx_rule_table_->set_weight(workload_type, ws_id, weight);
       rx_rule_table_->add_route(workload_type, ws_id);
     }
 
+    void set_rx_policy(uint8_t workload_type, uint8_t policy) {
+      rx_rule_table_->set_policy(workload_type, policy);
+    }
+
+    RuleTable *get_rx_rule_table() {
+      return rx_rule_table_;
+    }
+
     size_t get_used_mbuf_num() {
-      /// TODO
-      return 0;
+      return slab_->get_in_use();
     }
 
     size_t get_rx_used_desc() {
@@ -187,6 +244,9 @@ class RoceDispatcher : public Dispatcher {
     }
   
   private:
+    /// Initial PSN of the QP, distinct per QP
+    static uint32_t local_psn(struct ibv_qp *qp) { return qp->qp_num & 0xffffff; }
+
     /// Create an address handle using this routing info
     struct ibv_ah *create_ah(const ib_routing_info_t *) const;
     void fill_local_routing_info(routing_info_t *routing_info) const;
@@ -195,11 +255,14 @@ class RoceDispatcher : public Dispatcher {
    * ----------------------Internal Parameters----------------------
    */ 
   private:
+    const uint8_t ws_id_;            ///< The workspace that owns this dispatcher
     size_t qp_id_ = kInvalidQpId;    ///< The RX/TX queue pair for this Transport
     mem_reg_info<Buffer> *mem_reg_info_;
 
     /// The hugepage allocator for this dispatcher
     HugeAlloc *huge_alloc_ = nullptr;    /// Huge page allocator for RDMA buffers
+    SlabAlloc *slab_ = nullptr;          /// Fixed-size slab for TX mbufs
+    SlabAlloc::Cache *tx_cache_ = nullptr;  /// Dispatcher's own cache, used to recycle sent mbufs
     ibv_mr *mr_;
 
     /// Info resolved from \p phy_port, must be filled by constructor.
@@ -215,12 +278,13 @@ class RoceDispatcher : public Dispatcher {
     /// parameters for qp init
     struct ibv_pd *pd_ = nullptr;   /// protection domain
     struct ibv_cq *send_cq_ = nullptr, *recv_cq_ = nullptr;
-    struct ibv_qp *qp_ = nullptr;
+    struct ibv_qp *qp_ = nullptr;   /// UD: the only QP; RC: QP of the first peer
+    struct ibv_srq *srq_ = nullptr; /// RC: RECV queue shared by the QPs of all peers
 
     /// An address handle for this endpoint's port. Used for tx_flush().
     struct ibv_ah *self_ah_ = nullptr;
-    size_t remote_qp_id_ = kInvalidQpId;  ///< The remote QP ID
-    struct ibv_ah *remote_ah_ = nullptr;  ///< An address handle for the remote endpoint's port.
+    peer_t peers_[kWorkspaceMaxNum];      ///< Per-peer QP / AH table, indexed by remote dispatcher ws_id
+    std::vector<uint8_t> peer_ids_;       ///< Remote dispatchers this dispatcher talks to
     /// Address handles that we must free in the destructor
     std::vector<ibv_ah *> ah_to_free_vec;
     ipaddr_t *daddr_ = nullptr;  ///< Destination IP address
@@ -233,7 +297,9 @@ class RoceDispatcher : public Dispatcher {
     size_t send_head_ = 0;      ///< Index of current posted SEND buffer
     size_t send_tail_ = 0;      ///< Index of current un-posted SEND buffer
     size_t free_send_wr_num_ = kSQDepth;  ///< Number of free send wr
-    Buffer *sw_ring_[kSQDepth];  ///< TX ring entries
+    Buffer *sw_ring_[kSQDepth] = {nullptr};  ///< TX ring entries, nullptr once the SEND completes
+    Buffer *tx_grouped_[kSQDepth];  ///< Scratch space to group a burst by destination
+    Buffer *tx_sent_[kSQDepth];     ///< Scratch space to recycle completed SENDs in bulk
     Buffer *tx_queue_[kSQDepth];
     size_t tx_queue_idx_ = 0;
     // RECV
@@ -243,6 +309,7 @@ class RoceDispatcher : public Dispatcher {
     size_t recv_head_ = 0;      ///< Index of current un-posted RECV buffer
 
     Buffer *rx_ring_[kRQDepth];  ///< RX ring entries
+    uint8_t rx_src_peer_[kRQDepth];  ///< Peer that sent each RX ring entry, only tracked for the echo handler
     size_t ring_head_ = 0;      ///< Index of rx ring
     size_t wait_for_disp_ = 0;  ///< Number of RECVs to batch before dispatching
 
@@ -291,13 +358,18 @@ class RoceDispatcher : public Dispatcher {
 
     void init_sends();  ///< Initialize constant fields of SEND work requests
 
-    void set_local_qp_info(QPInfo *qp_info);  ///< Set local QP info
-    bool set_remote_qp_info(QPInfo *qp_info);  ///< Set remote QP info
+    void set_local_qp_info(QPInfo *qp_info, struct ibv_qp *qp);  ///< Set local QP info
+    bool set_remote_qp_info(uint8_t peer, QPInfo *qp_info);  ///< Set remote QP info (UD)
+    struct ibv_qp *create_qp();   ///< Create a QP and move it to INIT
+    void connect_qp(struct ibv_qp *qp, QPInfo *remote_qp_info);  ///< Move a QP from INIT to RTS
 
     // roce_dispatcher_dataplane.cc
     void post_recvs(size_t num_recvs);
     uint8_t resolve_pkt_hdr(Buffer *m);
     size_t tx_burst(Buffer **tx, size_t nb_tx);
+    uint8_t resolve_src_peer(const struct ibv_wc *wc);
+    void poll_send_cq();
+    void post_sends(ibv_qp *qp, size_t first, size_t num);
 };
 
 }
\ No newline at end of file
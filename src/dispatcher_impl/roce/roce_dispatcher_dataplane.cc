@@ -15,7 +15,7 @@ void RoceDispatcher::post_recvs(size_t num_recvs) {
   int ret;
   size_t first_wr_i = recv_head_;
   size_t last_wr_i = first_wr_i + (num_recvs - 1);
-  if (last_wr_i >= kRQDepth) last_wr_i -= kRQDepth;
+  if (last_wr_i >= rx_ring_size_) last_wr_i -= rx_ring_size_;
 
   first_wr = &recv_wr[first_wr_i];
   last_wr = &recv_wr[last_wr_i];
@@ -23,7 +23,11 @@ void RoceDispatcher::post_recvs(size_t num_recvs) {
 
   last_wr->next = nullptr;  // Breaker of chains, queen of the First Men
 
+#if RoCE_TYPE == UD
   ret = ibv_post_recv(qp_, first_wr, &bad_wr);
+#elif RoCE_TYPE == RC
+  ret = ibv_post_srq_recv(srq_, first_wr, &bad_wr);
+#endif
   if (unlikely(ret != 0)) {
     fprintf(stderr, "eRPC IBTransport: Post RECV (normal) error %d\n", ret);
     exit(-1);
@@ -33,7 +37,7 @@ void RoceDispatcher::post_recvs(size_t num_recvs) {
 
   // Update RECV head: go to the last wr posted and take 1 more step
   recv_head_ = last_wr_i;
-  recv_head_ = (recv_head_ + 1) % kRQDepth;
+  recv_head_ = (recv_head_ + 1) & (rx_ring_size_ - 1);
 }
 
 uint8_t RoceDispatcher::resolve_pkt_hdr(Buffer *m) {
@@ -48,6 +52,17 @@ uint8_t RoceDispatcher::resolve_pkt_hdr(Buffer *m) {
   return wh->workload_type_;
 }
 
+uint8_t RoceDispatcher::resolve_src_peer(const struct ibv_wc *wc) {
+  for (uint8_t peer : peer_ids_) {
+  #if RoCE_TYPE == UD
+    if (peers_[peer].qpn_ == wc->src_qp) return peer;
+  #elif RoCE_TYPE == RC
+    if (peers_[peer].qp_->qp_num == wc->qp_num) return peer;
+  #endif
+  }
+  return peer_ids_[0];
+}
+
 size_t RoceDispatcher::collect_tx_pkts() {
   size_t remain_ring_size = kNumTxRingEntries - tx_queue_idx_;
   uint8_t nb_collect_queue = 0;
@@ -70,66 +85,106 @@ size_t RoceDispatcher::collect_tx_pkts() {
   return nb_collect_num;
 }
 
-size_t RoceDispatcher::tx_burst(Buffer **tx, size_t nb_tx) {
-  // Mount buffers to send wr, generate corresponding sge
-  size_t nb_tx_res = 0;   // total number of mounted wr for this burst tx
-  /// post send cq first
-  int ret = ibv_poll_cq(send_cq_, kSQDepth, send_wc);
+void RoceDispatcher::poll_send_cq() {
+  int ret = ibv_poll_cq(send_cq_, tx_ring_size_, send_wc);
   assert(ret >= 0);
-  free_send_wr_num_ += ret;
-#if ApplyNewMbuf || NODE_TYPE == CLIENT
+  if (ret == 0) return;
+  // SENDs of different QPs may complete out of order, so look up each
+  // buffer by wr_id and recycle the completed buffers in bulk. Sent mbufs are
+  // either slab mbufs or RX ring entries reused for responses.
   for (int i = 0; i < ret; i++) {
-    huge_alloc_->free_buf(sw_ring_[send_head_]);
-    send_head_ = (send_head_ + 1) % kSQDepth;
+    size_t slot = send_wc[i].wr_id;
+    tx_sent_[i] = sw_ring_[slot];
+    sw_ring_[slot] = nullptr;
   }
-#else
-  for (int i = 0; i < ret; i++) {
-    sw_ring_[send_head_]->state_ = Buffer::kFREE_BUF;
-    send_head_ = (send_head_ + 1) % kSQDepth;
+  tx_cache_->release(tx_sent_, ret);
+  // Reclaim the contiguous run of completed slots
+  while (free_send_wr_num_ < tx_ring_size_ && sw_ring_[send_head_] == nullptr) {
+    send_head_ = (send_head_ + 1) & (tx_ring_size_ - 1);
+    free_send_wr_num_++;
   }
-#endif
-  /// post send wr
-  struct ibv_send_wr* first_wr = &send_wr[send_tail_];
-  struct ibv_send_wr* tail_wr = nullptr;
-  while (free_send_wr_num_ > 0 && nb_tx_res < nb_tx) {
-    tail_wr = &send_wr[send_tail_];
+}
+
+void RoceDispatcher::post_sends(ibv_qp *qp, size_t first, size_t num) {
+  struct ibv_send_wr* first_wr = &send_wr[first];
+  struct ibv_send_wr* tail_wr = &send_wr[(first + num - 1) & (tx_ring_size_ - 1)];
+  struct ibv_send_wr* bad_send_wr;
+  struct ibv_send_wr* temp_wr = tail_wr->next;
+  tail_wr->next = nullptr; // Breaker of chains
+  int ret = ibv_post_send(qp, first_wr, &bad_send_wr);
+  if (unlikely(ret != 0)) {
+    fprintf(stderr, "dPerf: Fatal error. ibv_post_send failed. ret = %d\n", ret);
+    assert(ret == 0);
+    exit(-1);
+  }
+  tail_wr->next = temp_wr;  // Restore circularity
+}
+
+size_t RoceDispatcher::tx_burst(Buffer **tx, size_t nb_tx) {
+  poll_send_cq();
+  if (nb_tx > free_send_wr_num_) nb_tx = free_send_wr_num_;
+  if (unlikely(nb_tx == 0)) return 0;
+
+  /// group the burst by destination (stable counting sort), so each peer
+  /// gets one contiguous chain of WRs
+  size_t group_begin[kWorkspaceMaxNum + 1] = {0};
+  for (size_t i = 0; i < nb_tx; i++) {
+    uint8_t dst = reinterpret_cast<udphdr*>(tx[i]->get_uh())->dest;
+    assert(dst < kWorkspaceMaxNum && peers_[dst].qp_ != nullptr);
+    group_begin[dst + 1]++;
+  }
+  for (size_t d = 0; d < kWorkspaceMaxNum; d++) group_begin[d + 1] += group_begin[d];
+  size_t group_fill[kWorkspaceMaxNum];
+  memcpy(group_fill, group_begin, sizeof(group_fill));
+  for (size_t i = 0; i < nb_tx; i++) {
+    uint8_t dst = reinterpret_cast<udphdr*>(tx[i]->get_uh())->dest;
+    tx_grouped_[group_fill[dst]++] = tx[i];
+  }
+
+  /// mount buffers to send wr, generate corresponding sge
+  size_t first = send_tail_;
+  for (size_t i = 0; i < nb_tx; i++) {
     struct ibv_sge* sgl = &send_sgl[send_tail_];
-    Buffer *m = tx[nb_tx_res];
+    Buffer *m = tx_grouped_[i];
     m->state_ = Buffer::kPOSTED;
     sgl->addr = reinterpret_cast<uint64_t>(m->get_buf());
     sgl->length = m->length_;
     sgl->lkey = m->lkey_;
   #if RoCE_TYPE == UD
-    tail_wr->wr.ud.ah = remote_ah_;
-    tail_wr->wr.ud.remote_qpn = remote_qp_id_;
+    uint8_t dst = reinterpret_cast<udphdr*>(m->get_uh())->dest;
+    send_wr[send_tail_].wr.ud.ah = peers_[dst].ah_;
+    send_wr[send_tail_].wr.ud.remote_qpn = peers_[dst].qpn_;
   #endif
-
     /// mount buffer to sw_ring
     sw_ring_[send_tail_] = m;
-
-    send_tail_ = (send_tail_ + 1) % kSQDepth;
-    free_send_wr_num_--;
-    nb_tx_res++;
+    send_tail_ = (send_tail_ + 1) & (tx_ring_size_ - 1);
   }
+  free_send_wr_num_ -= nb_tx;
 
-  if (nb_tx_res > 0) {
-    struct ibv_send_wr* bad_send_wr;
-    struct ibv_send_wr* temp_wr = tail_wr->next;
-    tail_wr->next = nullptr; // Breaker of chains
-    ret = ibv_post_send(qp_, first_wr, &bad_send_wr);
-    if (unlikely(ret != 0)) {
-      fprintf(stderr, "dPerf: Fatal error. ibv_post_send failed. ret = %d\n", ret);
-      assert(ret == 0);
-      exit(-1);
-    }
-    tail_wr->next = temp_wr;  // Restore circularity
+  /// post send wr
+#if RoCE_TYPE == UD
+  // A single QP serves all peers, one doorbell for the whole burst
+  post_sends(qp_, first, nb_tx);
+#elif RoCE_TYPE == RC
+  for (size_t d = 0; d < kWorkspaceMaxNum; d++) {
+    size_t num = group_begin[d + 1] - group_begin[d];
+    if (num == 0) continue;
+    post_sends(peers_[d].qp_, (first + group_begin[d]) & (tx_ring_size_ - 1), num);
   }
-  return nb_tx_res;
+#endif
+  return nb_tx;
 }
 
 size_t RoceDispatcher::tx_flush() {
   size_t nb_tx = 0, tx_total = 0;
   Buffer **tx = &tx_queue_[0];
+#if PERF_LAT_BREAKDOWN == 1 && NODE_TYPE == CLIENT
+  /// stamp the requests for the latency breakdown
+  size_t tx_tsc = rdtsc();
+  for (size_t i = 0; i < tx_queue_idx_; i++) {
+    reinterpret_cast<ws_ts*>(tx_queue_[i]->get_ws_payload())->client_tx_tsc_ = tx_tsc;
+  }
+#endif
   while(tx_total < tx_queue_idx_) {
     nb_tx = tx_burst(tx, tx_queue_idx_ - tx_total);
     tx += nb_tx;
@@ -156,7 +211,11 @@ size_t RoceDispatcher::rx_burst() {
   int ret = ibv_poll_cq(recv_cq_, kDispRxBatchSize, recv_wc);
   /// set buffer's length
   for (int i = 0; i < ret; i++) {
-    rx_ring_[(ring_head_ + wait_for_disp_ + i) % kRQDepth]->length_ = recv_wc[i].byte_len;
+    size_t slot = (ring_head_ + wait_for_disp_ + i) & (rx_ring_size_ - 1);
+    rx_ring_[slot]->length_ = recv_wc[i].byte_len;
+    if constexpr (kRxPktHandler == kRxPktHandler_Echo) {
+      rx_src_peer_[slot] = resolve_src_peer(&recv_wc[i]);
+    }
   }
   wait_for_disp_ += ret;
   return static_cast<size_t>(ret);
@@ -168,27 +227,46 @@ size_t RoceDispatcher::dispatch_rx_pkts() {
   lock_free_queue *worker_queue = nullptr;
   uint8_t worload_type = 0;
   Buffer *ring_entry = rx_ring_[ring_head_];    // the first un-dispatched buffer
+  /// load-aware policies compare the worker queue depths at the start of the burst
+  rx_rule_table_->snapshot_depths();
+#if PERF_LAT_BREAKDOWN == 1 && NODE_TYPE == SERVER
+  size_t rx_tsc = rdtsc();
+#endif
   for (size_t i = 0; i < wait_for_disp_; i++) {
     // printf("rx buf: %s\n", ring_entry->buffer_print().c_str());
+  #if PERF_LAT_BREAKDOWN == 1 && NODE_TYPE == SERVER
+    /// stamp the requests for the latency breakdown
+    reinterpret_cast<ws_ts*>(ring_entry->get_ws_payload())->server_ts_ = rx_tsc;
+  #endif
     /// resolve pkt header to get workload_type
     worload_type = resolve_pkt_hdr(ring_entry);
-    /// get corresponding workspace id
-    uint8_t ws_id = rx_rule_table_->rr_select(worload_type);
+    /// get corresponding workspace id, the segments of a message go to the same workspace
+    ws_hdr *wh = reinterpret_cast<ws_hdr *>(ring_entry->get_ws_hdr());
+    uint16_t src_port = reinterpret_cast<udphdr *>(ring_entry->get_uh())->source;
+    uint8_t ws_id = likely(wh->segment_num_ <= 1) ? rx_rule_table_->select(worload_type, ws_flow_hash(src_port, wh))
+        : rx_rule_table_->hash_select(worload_type, ws_msg_hash(src_port, wh));
+  #if NODE_TYPE == CLIENT
+    /// return a response to its sender, so that it replenishes the sender's credits
+    if (likely(wh->src_ws_id_ < kWorkspaceMaxNum && ws_rx_queues_[wh->src_ws_id_] != nullptr))
+      ws_id = wh->src_ws_id_;
+  #endif
     /// get workspace rx queue
     worker_queue = ws_rx_queues_[ws_id];
     /// dispatch to worker rx queue
     if (unlikely(!worker_queue->enqueue((uint8_t*)ring_entry))) {
       /// drop the packet if the ws queue is full
+      rx_rule_table_->count(worload_type, true);
       ring_entry->state_ = Buffer::kFREE_BUF;
       ring_entry = ring_entry->next_;
       continue;
     }
+    rx_rule_table_->count(worload_type, false);
     ring_entry->state_ = Buffer::kAPP_OWNED_BUF;
     ring_entry = ring_entry->next_;
     dispatch_total++;
   }
   /// update ring_head_
-  ring_head_ = (ring_head_ + wait_for_disp_) % kRQDepth;
+  ring_head_ = (ring_head_ + wait_for_disp_) & (rx_ring_size_ - 1);
   wait_for_disp_ = 0;
   return dispatch_total;
 }
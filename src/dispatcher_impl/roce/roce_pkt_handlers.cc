@@ -4,12 +4,66 @@
 #include "roce_dispatcher.h"
 
 namespace dperf {
+  /**
+   * @brief packet handler kernel
+   */
+    size_t RoceDispatcher::echo_handler() {
+      size_t pre_dispatch_total = 0;
+      Buffer *ring_entry = rx_ring_[ring_head_];    // the first un-dispatched buffer
+      struct eth_hdr *eth = NULL;
+      struct iphdr *iph = NULL;
+      struct udphdr *uh = NULL;
+
+      uint32_t tmp_ip_addr = 0;
+
+      size_t remain_tx_queue_size = (kNumTxRingEntries - tx_queue_idx_ > wait_for_disp_) 
+                                        ? wait_for_disp_ : kNumTxRingEntries - tx_queue_idx_;
+      for (size_t i = 0; i < remain_tx_queue_size; i++) {
+        eth = reinterpret_cast<eth_hdr *>(ring_entry->get_buf());
+        iph = reinterpret_cast<iphdr *>(ring_entry->get_iph());
+        uh = reinterpret_cast<udphdr *>(ring_entry->get_uh());
+
+        // swap IP address
+        tmp_ip_addr = iph->daddr;
+        iph->daddr = iph->saddr;
+        iph->saddr = tmp_ip_addr;
+
+        // swap MAC address
+        eth_addr_swap(eth);
+
+        // reply to the dispatcher that sent the packet
+        uh->source = ws_id_;
+        uh->dest = rx_src_peer_[(ring_head_ + i) & (rx_ring_size_ - 1)];
+
+      #if RoCE_TYPE == UD
+        // byte_len of a UD RECV counts the GRH in front of the frame
+        ring_entry->length_ -= kGRHBytes;
+      #endif
+
+        // insert the buffer to tx queue as it is, it returns to the RECV
+        // queue when the SEND completes
+        ring_entry->state_ = Buffer::kAPP_OWNED_BUF;
+        tx_queue_[tx_queue_idx_] = ring_entry;
+        tx_queue_idx_++;
+
+        ring_entry = ring_entry->next_;
+        pre_dispatch_total++;
+      }
+      for (size_t i = pre_dispatch_total; i < wait_for_disp_; i++) {
+        ring_entry->state_ = Buffer::kFREE_BUF;
+        ring_entry = ring_entry->next_;
+      }
+      ring_head_ = (ring_head_ + wait_for_disp_) & (rx_ring_size_ - 1);
+      wait_for_disp_ = 0;
+      return pre_dispatch_total;
+    }
   /**
    * @brief packet handler wrapper
    */
   template <pkt_handler_type_t handler>
   size_t RoceDispatcher::pkt_handler_server() {
     if constexpr (handler == kRxPktHandler_Empty) { return 0; }
+    else if (handler == kRxPktHandler_Echo){ return echo_handler(); }
     else {DPERF_ERROR("Invalid packet handler type!"); return 0;} 
   }
 
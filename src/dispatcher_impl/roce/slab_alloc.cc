@@ -0,0 +1,70 @@
+#include "slab_alloc.h"
+
+#include <new>
+
+namespace dperf {
+
+SlabAlloc::SlabAlloc(HugeAlloc *huge_alloc, Buffer region, size_t num_bufs, size_t buf_size)
+    : num_bufs_(num_bufs), buf_size_(buf_size) {
+  rt_assert(region.buf_ != nullptr, "SlabAlloc: invalid memory region");
+  rt_assert(num_bufs > 0, "SlabAlloc: empty slab");
+  rt_assert(region.class_size_ >= num_bufs * buf_size, "SlabAlloc: memory region is too small");
+
+  // Keep the descriptor array on hugepages as well, so walking descriptors
+  // does not thrash the TLB
+  Buffer desc_region = huge_alloc->alloc_raw(num_bufs * sizeof(Buffer), DoRegister::kFalse);
+  if (desc_region.buf_ == nullptr) {
+    std::ostringstream xmsg;
+    xmsg << "SlabAlloc: Failed to allocate descriptors for " << num_bufs
+         << " buffers. " << HugeAlloc::kAllocFailHelpStr;
+    throw std::runtime_error(xmsg.str());
+  }
+  descs_ = reinterpret_cast<Buffer *>(desc_region.buf_);
+  free_stack_ = new Buffer *[num_bufs];
+
+  for (size_t i = 0; i < num_bufs; i++) {
+    new (&descs_[i]) Buffer(region.buf_ + i * buf_size, buf_size, region.lkey_);
+    descs_[i].next_ = nullptr;
+    // Push in reverse order so that the first allocations hand out the
+    // lowest addresses
+    free_stack_[num_bufs - 1 - i] = &descs_[i];
+  }
+  free_top_ = num_bufs;
+}
+
+SlabAlloc::~SlabAlloc() {
+  // Descriptors live in SHM owned by the HugeAlloc
+  for (Cache *cache : caches_) delete cache;
+  delete[] free_stack_;
+}
+
+SlabAlloc::Cache *SlabAlloc::new_cache() {
+  std::lock_guard<std::mutex> lock(lock_);
+  Cache *cache = new Cache(this);
+  caches_.push_back(cache);
+  return cache;
+}
+
+size_t SlabAlloc::get_in_use() const {
+  size_t free_num = free_top_;
+  for (const Cache *cache : caches_) free_num += cache->get_len();
+  return free_num > num_bufs_ ? 0 : num_bufs_ - free_num;
+}
+
+size_t SlabAlloc::get_alloc_fails() const {
+  size_t fails = 0;
+  for (const Cache *cache : caches_) fails += cache->get_alloc_fails();
+  return fails;
+}
+
+void SlabAlloc::print_stats() const {
+  fprintf(stderr, "SlabAlloc stats:\n");
+  fprintf(stderr, "Capacity = %zu Buffers of %zu B (%.2f MB)\n", num_bufs_,
+          buf_size_, 1.0 * num_bufs_ * buf_size_ / MB(1));
+  fprintf(stderr, "In use = %zu, peak = %zu, failed allocations = %zu\n",
+          get_in_use(), get_peak_in_use(), get_alloc_fails());
+  fprintf(stderr, "%zu caches, %zu Buffers in shared stack\n", caches_.size(),
+          free_top_);
+}
+
+}  // namespace dperf
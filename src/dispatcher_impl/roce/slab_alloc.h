@@ -0,0 +1,234 @@
+/**
+ * @file slab_alloc.h
+ * @brief A fixed-size slab allocator for MTU-sized RDMA buffers
+ */
+#pragma once
+
+#include <algorithm>
+#include <mutex>
+#include <vector>
+
+#include "common.h"
+#include "buffer.h"
+#include "huge_alloc.h"
+#include "util/logger.h"
+
+namespace dperf {
+
+/**
+ * A fixed-size slab allocator for the mbufs of a RoceDispatcher, modeled
+ * after DPDK's mempool.
+ *
+ * The slab carves a registered hugepage region into \p num_bufs chunks of
+ * \p buf_size bytes. All Buffer descriptors live in one contiguous array that
+ * is itself hugepage-backed, so descriptor i always describes chunk i and no
+ * descriptor is ever created or destroyed after construction.
+ *
+ * Free descriptors are kept on a LIFO stack shared by every workspace that
+ * uses this slab. Workspaces never touch the shared stack directly: each one
+ * owns a SlabAlloc::Cache, which is refilled from / flushed to the shared
+ * stack in bulk under the slab lock, so the common path of alloc and free is
+ * a lock-free memcpy of descriptor pointers.
+ */
+class SlabAlloc {
+ public:
+  static constexpr size_t kCacheSize = 512;  ///< Max nominal size of a per-workspace cache
+  /// Capacity bound of a cache, see Cache::flush_thresh_ for the runtime threshold
+  static constexpr size_t kCacheFlushThresh = kCacheSize * 3 / 2;
+  /// A slab of N Buffers gives each cache at most N / kCacheShare, so that a
+  /// few full caches cannot hold every Buffer of a small slab
+  static constexpr size_t kCacheShare = 8;
+
+  /**
+   * @brief A per-workspace LIFO cache in front of the shared slab. A cache
+   * must only be used by the thread that owns it.
+   */
+  class Cache {
+   public:
+    explicit Cache(SlabAlloc *slab)
+        : slab_(slab), size_(slab->get_cache_size()), flush_thresh_(slab->get_cache_size() * 3 / 2) {}
+
+    /// Allocate one Buffer, return nullptr if the slab is exhausted
+    inline Buffer *alloc() {
+      if (unlikely(len_ == 0)) {
+        /// refill a whole cache, or a single Buffer if the slab is running low
+        if (slab_->get_bulk(objs_, size_)) {
+          len_ = size_;
+        } else if (slab_->get_bulk(objs_, 1)) {
+          len_ = 1;
+        } else {
+          alloc_fails_++;
+          return nullptr;
+        }
+      }
+      return objs_[--len_];
+    }
+
+    /**
+     * @brief Allocate exactly \p n Buffers, all or nothing
+     * @return 0 on success, and -1 if the slab cannot provide \p n Buffers
+     */
+    inline int alloc_bulk(Buffer **bufs, size_t n) {
+      if (unlikely(n > size_)) {
+        // Too large for the cache, go to the shared stack directly
+        if (!slab_->get_bulk(bufs, n)) {
+          alloc_fails_++;
+          return -1;
+        }
+        return 0;
+      }
+      if (unlikely(len_ < n)) {
+        // Refill up to size_ on top of this request, or at least enough
+        // for this request if the slab is running low
+        size_t want = size_ + n - len_;
+        if (!slab_->get_bulk(&objs_[len_], want)) {
+          want = n - len_;
+          if (!slab_->get_bulk(&objs_[len_], want)) {
+            alloc_fails_++;
+            return -1;
+          }
+        }
+        len_ += want;
+      }
+      len_ -= n;
+      memcpy(bufs, &objs_[len_], n * sizeof(Buffer *));
+      return 0;
+    }
+
+    /// Return one Buffer owned by the slab
+    inline void free(Buffer *buf) {
+      assert(slab_->owns(buf));
+      objs_[len_++] = buf;
+      if (unlikely(len_ >= flush_thresh_)) flush();
+    }
+
+    /// Return \p n Buffers owned by the slab
+    inline void free_bulk(Buffer **bufs, size_t n) {
+      if (unlikely(n > size_)) {
+        slab_->put_bulk(bufs, n);
+        return;
+      }
+      memcpy(&objs_[len_], bufs, n * sizeof(Buffer *));
+      len_ += n;
+      if (unlikely(len_ >= flush_thresh_)) flush();
+    }
+
+    /**
+     * @brief Return \p n Buffers that may or may not be owned by the slab.
+     * Runs of slab Buffers are freed in bulk; other Buffers (i.e., RX ring
+     * entries) are handed back to the RX ring by marking them free.
+     */
+    inline void release(Buffer **bufs, size_t n) {
+      size_t run = 0;
+      for (size_t i = 0; i < n; i++) {
+        if (likely(slab_->owns(bufs[i]))) {
+          run++;
+          continue;
+        }
+        if (run) free_bulk(&bufs[i - run], run);
+        run = 0;
+        bufs[i]->state_ = Buffer::kFREE_BUF;
+      }
+      if (run) free_bulk(&bufs[n - run], run);
+    }
+
+    inline SlabAlloc *get_slab() { return slab_; }
+    inline size_t get_len() const { return len_; }
+    inline size_t get_alloc_fails() const { return alloc_fails_; }
+
+   private:
+    /// Move everything above size_ back to the shared stack
+    inline void flush() {
+      slab_->put_bulk(&objs_[size_], len_ - size_);
+      len_ = size_;
+    }
+
+    SlabAlloc *slab_;
+    const size_t size_;         ///< Nominal size, see SlabAlloc::get_cache_size()
+    const size_t flush_thresh_; ///< A cache holding this many Buffers flushes back to size_
+    size_t len_ = 0;            ///< Number of cached Buffers
+    size_t alloc_fails_ = 0;    ///< Number of failed allocations
+    /// Cached Buffers, the top of the LIFO is objs_[len_ - 1]. A free_bulk()
+    /// of up to size_ may land on a cache just below the flush threshold.
+    Buffer *objs_[kCacheFlushThresh + kCacheSize];
+  };
+
+  /**
+   * @brief Construct the slab on top of a registered memory region
+   * @param huge_alloc The allocator used to back the descriptor array
+   * @param region The registered region to carve, with a valid lkey
+   * @param num_bufs The number of Buffers in the slab
+   * @param buf_size The size of each Buffer
+   * @throw runtime_error if the descriptor array cannot be allocated
+   */
+  SlabAlloc(HugeAlloc *huge_alloc, Buffer region, size_t num_bufs, size_t buf_size);
+  ~SlabAlloc();
+
+  /// Create a cache for a new user of this slab. The slab owns the cache.
+  Cache *new_cache();
+
+  /// Return true if \p buf is one of this slab's descriptors
+  inline bool owns(const Buffer *buf) const {
+    return buf >= descs_ && buf < descs_ + num_bufs_;
+  }
+
+  /**
+   * @brief Pop exactly \p n Buffers from the shared stack, all or nothing
+   * @return false if fewer than \p n Buffers are free
+   */
+  inline bool get_bulk(Buffer **bufs, size_t n) {
+    std::lock_guard<std::mutex> lock(lock_);
+    if (unlikely(n > free_top_)) return false;
+    free_top_ -= n;
+    memcpy(bufs, &free_stack_[free_top_], n * sizeof(Buffer *));
+    if (num_bufs_ - free_top_ > stats_.peak_in_use_) {
+      stats_.peak_in_use_ = num_bufs_ - free_top_;
+    }
+    return true;
+  }
+
+  /// Push \p n Buffers back to the shared stack
+  inline void put_bulk(Buffer **bufs, size_t n) {
+    std::lock_guard<std::mutex> lock(lock_);
+    assert(free_top_ + n <= num_bufs_);
+    memcpy(&free_stack_[free_top_], bufs, n * sizeof(Buffer *));
+    free_top_ += n;
+  }
+
+  inline size_t get_capacity() const { return num_bufs_; }
+  /// Nominal size of the caches of this slab, kCacheSize unless the slab is small
+  inline size_t get_cache_size() const { return std::max<size_t>(1, std::min(kCacheSize, num_bufs_ / kCacheShare)); }
+  inline size_t get_buf_size() const { return buf_size_; }
+
+  /**
+   * @brief Return the number of Buffers held by the application, i.e., not
+   * in the shared stack and not in any cache. This is a racy snapshot meant
+   * for statistics only.
+   */
+  size_t get_in_use() const;
+
+  /// Return the peak number of Buffers that left the shared stack
+  inline size_t get_peak_in_use() const { return stats_.peak_in_use_; }
+
+  /// Return the total number of failed allocations over all caches
+  size_t get_alloc_fails() const;
+
+  /// Print a summary of this slab
+  void print_stats() const;
+
+ private:
+  const size_t num_bufs_;
+  const size_t buf_size_;
+  Buffer *descs_ = nullptr;        ///< Contiguous descriptor array
+  Buffer **free_stack_ = nullptr;  ///< Shared LIFO stack of free descriptors
+  size_t free_top_ = 0;            ///< Number of descriptors in the stack
+  std::mutex lock_;                ///< Protects the shared stack and caches_
+  std::vector<Cache *> caches_;    ///< Caches created by new_cache()
+
+  // Stats
+  struct {
+    size_t peak_in_use_ = 0;
+  } stats_;
+};
+
+}  // namespace dperf
@@ -1,12 +1,49 @@
 #include <sys/types.h>
+#include <signal.h>
 #include <stdio.h>
 #include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <exception>
 #include <thread>
 #include "util/barrier.h"
 
 #include "workspace.h"
 #include "config.h"
 #include "datapath_pipeline.h"
+#include "ws_impl/stats_monitor.h"
+#include "util/results_writer.h"
+
+/// cpufreq policy of the workspace cores before the run, restored once however the process ends
+static std::vector<dperf::cpufreq_state> saved_cpufreq;
+static std::atomic<bool> cpufreq_restored(false);
+static volatile sig_atomic_t stop_signal = 0;
+
+static void restore_saved_cpufreq() {
+  if (saved_cpufreq.empty() || cpufreq_restored.exchange(true)) return;
+  dperf::restore_cpu_freq(saved_cpufreq);
+}
+
+/// Only raise the flag, the main thread does the sysfs writes
+static void on_stop_signal(int sig) {
+  stop_signal = sig;
+}
+
+/// rt_assert() exits, an uncaught exception of a workspace terminates
+static void install_cpufreq_restore() {
+  std::atexit(restore_saved_cpufreq);
+  std::set_terminate([]() {
+    restore_saved_cpufreq();
+    std::abort();
+  });
+  struct sigaction sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = on_stop_signal;
+  sigemptyset(&sa.sa_mask);
+  sigaction(SIGINT, &sa, nullptr);
+  sigaction(SIGTERM, &sa, nullptr);
+}
 
 void ws_main(dperf::WsContext* context, uint8_t ws_id, uint8_t ws_type, std::vector<dperf::phase_t> *ws_loop, dperf::UserConfig *user_config) {
   if (ws_type == 0) {
@@ -51,6 +88,27 @@ int main(int argc, char **argv) {
   /// Init workspace context based on datapath pipeline
   dperf::ThreadBarrier *barrier = new dperf::ThreadBarrier(total_thread_num);
   dperf::WsContext *context = new dperf::WsContext(barrier);
+  if (user_config->is_daemon()) 
+    context->control_socket_ = new dperf::ControlSocket(user_config->server_config_->control_socket);
+  dperf::StatsShm *stats_shm = nullptr;
+  if (!user_config->server_config_->stats_shm.empty()) {
+    dperf::rt_assert(user_config->server_config_->stats_interval_ms > 0, "stats_shm needs stats_interval");
+    stats_shm = new dperf::StatsShm(user_config->server_config_->stats_shm, user_config->server_config_->stats_interval_ms);
+  }
+  if (user_config->server_config_->stats_interval_ms > 0) 
+    context->monitor_ = new dperf::StatsMonitor(context, user_config->server_config_->stats_interval_ms, total_thread_num, stats_shm);
+  if (!user_config->server_config_->result_file.empty()) 
+    context->results_writer_ = new dperf::ResultsWriter(user_config->server_config_->result_file);
+
+  /// Pin the frequency of all workspace cores at once, restored at exit
+  std::vector<size_t> cores;
+  for (uint8_t i = 0; i < dperf::kWorkspaceMaxNum; i++) {
+    if (pipeline->get_workload_type(i) != dperf::kInvalidWorkloadType)
+      cores.push_back(dperf::get_global_index(user_config->get_numa(), i));
+  }
+  saved_cpufreq = dperf::set_cpu_freq_max(cores);
+  context->cpufreq_set_ = !saved_cpufreq.empty();
+  install_cpufreq_restore();
 
   /// Init and launch workspaces
   dperf::clear_affinity_for_process();
@@ -66,6 +124,25 @@ int main(int argc, char **argv) {
     size_t core = dperf::bind_to_core(workspaces[i], user_config->get_numa(), i);
     context->cpu_core[i] = core;
   }
-  for (auto &workspace : workspaces) workspace.join();
+  if (context->monitor_ != nullptr) context->monitor_->start();
+  /// join in the background, so that the main thread can serve a stop signal
+  std::atomic<bool> joined(false);
+  std::thread joiner([&]() {
+    for (auto &workspace : workspaces) workspace.join();
+    joined = true;
+  });
+  while (!joined && stop_signal == 0) std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  if (stop_signal != 0) {
+    DPERF_WARN("Stopped by signal %d, restore cpufreq and exit\n", (int)stop_signal);
+    restore_saved_cpufreq();
+    /// die of the signal as if it had no handler
+    signal(stop_signal, SIG_DFL);
+    raise(stop_signal);
+  }
+  joiner.join();
+  restore_saved_cpufreq();
+  delete context->control_socket_;
+  delete context->results_writer_;
+  delete stats_shm;
   return 0;
 }
@@ -0,0 +1,108 @@
+/**
+ * @file arrival_schedule.h
+ * @brief Precomputed message arrival schedules for the open-loop client
+ */
+#pragma once
+
+#include "common.h"
+#include "util/rand.h"
+#include <cmath>
+#include <vector>
+
+namespace dperf {
+
+/// Arrival distributions of an open-loop client
+#define kArrivalConstant  0   // evenly spaced messages
+#define kArrivalPoisson   1   // exponential inter-arrival gaps
+#define kArrivalOnOff     2   // evenly spaced bursts followed by silence
+
+/**
+ * An open-loop arrival schedule in TSC cycles.
+ *
+ * The inter-arrival gaps are drawn once at init and replayed cyclically, so
+ * the datapath only adds a gap to the last scheduled TSC. Gaps are rounded from
+ * the cumulative arrival time rather than one by one, so the long-run rate is
+ * exact even if a single gap is only a few cycles.
+ */
+class ArrivalSchedule {
+ public:
+  static constexpr size_t kScheduleLen = 65536;   ///< Max number of precomputed gaps
+
+  /**
+   * @brief Precompute the schedule
+   * @param rate The offered load in messages per second
+   * @param dist kArrivalConstant, kArrivalPoisson, or kArrivalOnOff
+   * @param on_us Length of a burst (kArrivalOnOff only)
+   * @param off_us Silence after a burst (kArrivalOnOff only). The rate within a
+   * burst is rate * (on_us + off_us) / on_us, so the average stays at rate
+   * @param freq_ghz The TSC frequency
+   */
+  void init(double rate, uint8_t dist, double on_us, double off_us, double freq_ghz) {
+    rt_assert(rate > 0, "Offered load must be positive");
+    const double gap = freq_ghz * 1e9 / rate;     // average gap in cycles
+    std::vector<double> gaps;
+    if (dist == kArrivalConstant) {
+      gaps.assign(kScheduleLen, gap);
+    }
+    else if (dist == kArrivalPoisson) {
+      /// Inverse transform sampling of the exponential distribution
+      FastRand rand;
+      for (size_t i = 0; i < kScheduleLen; i++) {
+        double u = (rand.next_u32() + 1.0) / 4294967297.0;    // (0, 1)
+        gaps.push_back(-std::log(u) * gap);
+      }
+    }
+    else if (dist == kArrivalOnOff) {
+      rt_assert(on_us > 0 && off_us >= 0, "Invalid on/off period");
+      const double period = us_cycles(on_us + off_us, freq_ghz);
+      const double burst_gap = gap * on_us / (on_us + off_us);
+      size_t burst_len = static_cast<size_t>(std::round(period / gap));
+      burst_len = burst_len == 0 ? 1 : burst_len;
+      rt_assert(burst_len <= kScheduleLen, "Too many messages in one burst");
+      /// Keep whole bursts only, so the schedule wraps at a period boundary
+      for (size_t burst = 0; burst < kScheduleLen / burst_len; burst++) {
+        for (size_t i = 0; i < burst_len - 1; i++) gaps.push_back(burst_gap);
+        gaps.push_back(period - burst_gap * (burst_len - 1));
+      }
+    }
+    else {
+      rt_assert(false, "Invalid arrival distribution");
+    }
+
+    gaps_.clear();
+    double sum = 0;
+    size_t last = 0;
+    for (double g : gaps) {
+      sum += g;
+      size_t cur = static_cast<size_t>(std::llround(sum));
+      rt_assert(cur - last <= UINT32_MAX, "Offered load is too low");
+      gaps_.push_back(static_cast<uint32_t>(cur - last));
+      last = cur;
+    }
+    idx_ = 0;
+  }
+
+  /// Restart the schedule, the first message is due at \p now_tsc
+  inline void start(size_t now_tsc) {
+    next_tsc_ = now_tsc;
+    idx_ = 0;
+  }
+
+  /// Return the TSC at which the next message is due
+  inline size_t peek() const { return next_tsc_; }
+
+  /// Move on to the following message
+  inline void advance() {
+    next_tsc_ += gaps_[idx_];
+    idx_ = (idx_ + 1 == gaps_.size()) ? 0 : idx_ + 1;
+  }
+
+ private:
+  static double us_cycles(double us, double freq_ghz) { return us * 1000 * freq_ghz; }
+
+  std::vector<uint32_t> gaps_;    ///< Inter-arrival gaps in cycles
+  size_t idx_ = 0;                ///< Gap following the next message
+  size_t next_tsc_ = 0;           ///< Scheduled TSC of the next message
+};
+
+}  // namespace dperf
@@ -1,30 +1,54 @@
 #pragma once
-#include <mutex>
-#include <condition_variable>
+#include <atomic>
+#include <stdint.h>
+#include <immintrin.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
 
 namespace dperf {
+/**
+ * A barrier that spins before it sleeps.
+ *
+ * At most synchronization points, e.g., the start of an iteration, workspaces
+ * arrive within microseconds of each other, and spinning avoids the syscalls
+ * and wakeup latency of a mutex and condition variable. A workspace that waits
+ * longer, e.g., for a daemon mode request, sleeps on a futex so that it does
+ * not hold its core.
+ */
 class ThreadBarrier {
 public:
-    explicit ThreadBarrier(int numThreads) : count(0), totalThreads(numThreads), generation(0) {}
+    static constexpr size_t kSpinNum = 1 << 16;     // PAUSEs before sleeping, a few ms
 
-    void wait() {
-        std::unique_lock<std::mutex> lock(mutex);
-        int gen = generation;
+    explicit ThreadBarrier(int numThreads) : totalThreads(numThreads) {}
 
-        if (++count < totalThreads) {
-            condition.wait(lock, [this, gen]() { return gen != generation; });
-        } else {
-            count = 0;
-            generation++;
-            condition.notify_all();
+    void wait() {
+        uint32_t gen = generation.load(std::memory_order_acquire);
+        if (count.fetch_add(1, std::memory_order_acq_rel) + 1 == totalThreads) {
+            /// the last one releases the others, count is reset before they can see the new generation
+            count.store(0, std::memory_order_relaxed);
+            generation.store(gen + 1, std::memory_order_seq_cst);
+            if (sleepers.load(std::memory_order_seq_cst) > 0) futex(FUTEX_WAKE_PRIVATE, INT32_MAX);
+            return;
+        }
+        for (size_t i = 0; i < kSpinNum; i++) {
+            if (generation.load(std::memory_order_acquire) != gen) return;
+            _mm_pause();
         }
+        sleepers.fetch_add(1, std::memory_order_seq_cst);
+        /// the futex only sleeps if the generation is still gen
+        while (generation.load(std::memory_order_acquire) == gen) futex(FUTEX_WAIT_PRIVATE, gen);
+        sleepers.fetch_sub(1, std::memory_order_relaxed);
     }
 
 private:
-    int count;
-    int totalThreads;
-    int generation;
-    std::mutex mutex;
-    std::condition_variable condition;
+    long futex(int op, uint32_t val) {
+        return syscall(SYS_futex, reinterpret_cast<uint32_t*>(&generation), op, val, nullptr, nullptr, 0);
+    }
+
+    std::atomic<int> count{0};
+    const int totalThreads;
+    std::atomic<uint32_t> generation{0};
+    std::atomic<int> sleepers{0};
 };
-}
\ No newline at end of file
+}
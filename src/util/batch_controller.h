@@ -0,0 +1,88 @@
+/**
+ * @file batch_controller.h
+ * @brief AIMD control of the batch size a pipeline stage waits for
+ */
+#pragma once
+
+#include "common.h"
+
+namespace dperf {
+
+/**
+ * The batch size of a stage that waits for a full batch before it runs, e.g.,
+ * app_handler() for kAppRxMsgBatchSize messages, or nic_tx() for
+ * kDispTxBatchSize packets.
+ *
+ * A large batch amortizes the per-batch cost at saturation, but at low load the
+ * first message of a batch waits for the rest. The controller tracks how long
+ * the stage has been holding a non-empty queue below its batch size:
+ *  - if that exceeds the latency target, the batch size is halved, at most once
+ *    per target interval (multiplicative decrease);
+ *  - if a full batch builds up within half the target, the batch size grows by
+ *    one (additive increase).
+ * The batch size stays within [1, the configured size].
+ */
+class BatchController {
+ public:
+  struct batch_stats {
+    size_t run_num_ = 0;        ///< Times the stage ran
+    size_t batch_sum_ = 0;      ///< Sum of the batch sizes the stage ran with
+    size_t min_ = SIZE_MAX;
+    size_t max_ = 0;
+  };
+
+  /**
+   * @param max_batch The configured batch size, i.e., the upper bound
+   * @param target_tsc The latency target, 0 to keep the batch size at \p max_batch
+   */
+  void init(size_t max_batch, size_t target_tsc) {
+    max_ = max_batch;
+    target_tsc_ = target_tsc;
+    if (batch_ == 0 || batch_ > max_ || target_tsc_ == 0) batch_ = max_;
+    wait_start_tsc_ = 0;
+    stats_ = batch_stats();
+  }
+
+  /// Return the batch size the stage currently waits for
+  inline size_t get() const { return batch_; }
+
+  /**
+   * @brief The stage polled its queue
+   * @param depth Messages or packets waiting in the queue
+   * @return true if the stage should run
+   */
+  inline bool ready(size_t depth, size_t now_tsc) {
+    if (depth == 0) {
+      wait_start_tsc_ = 0;
+      return false;
+    }
+    if (wait_start_tsc_ == 0) wait_start_tsc_ = now_tsc;
+    size_t waited = now_tsc - wait_start_tsc_;
+    if (depth < batch_) {
+      if (target_tsc_ != 0 && waited > target_tsc_ && batch_ > 1) {
+        batch_ = batch_ / 2;
+        wait_start_tsc_ = now_tsc;    // give the smaller batch a target interval
+      }
+      if (depth < batch_) return false;
+    } else if (target_tsc_ != 0 && waited < target_tsc_ / 2 && batch_ < max_) {
+      batch_++;
+    }
+    wait_start_tsc_ = 0;
+    stats_.run_num_++;
+    stats_.batch_sum_ += batch_;
+    stats_.min_ = batch_ < stats_.min_ ? batch_ : stats_.min_;
+    stats_.max_ = batch_ > stats_.max_ ? batch_ : stats_.max_;
+    return true;
+  }
+
+  inline const batch_stats &get_stats() const { return stats_; }
+
+ private:
+  size_t batch_ = 0;
+  size_t max_ = 0;
+  size_t target_tsc_ = 0;
+  size_t wait_start_tsc_ = 0;   ///< When the queue became non-empty, 0 if empty
+  batch_stats stats_;
+};
+
+}  // namespace dperf
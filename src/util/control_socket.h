@@ -0,0 +1,106 @@
+/**
+ * @file control_socket.h
+ * @brief Local control socket of the daemon mode
+ */
+#pragma once
+
+#include "common.h"
+#include "util/logger.h"
+#include <string>
+#include <vector>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace dperf {
+
+/**
+ * A Unix domain stream socket that takes one request per connection.
+ *
+ * A request is lines of "key : value" in the config file syntax, ended by a
+ * line with a command, i.e., "run" or "quit". The reply is a single JSON
+ * object, after which the connection is closed, e.g.,
+ *   printf 'kAppRxMsgBatchSize : 16\nrun\n' | socat - UNIX-CONNECT:/tmp/axio.sock
+ */
+class ControlSocket {
+ public:
+  explicit ControlSocket(const std::string &path) : path_(path) {
+    struct sockaddr_un addr;
+    rt_assert(path.size() < sizeof(addr.sun_path), "Control socket path is too long");
+    fd_ = socket(AF_UNIX, SOCK_STREAM, 0);
+    rt_assert(fd_ >= 0, "Failed to create the control socket");
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path.c_str());
+    unlink(path.c_str());
+    rt_assert(bind(fd_, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) == 0,
+              "Failed to bind the control socket");
+    rt_assert(listen(fd_, 1) == 0, "Failed to listen on the control socket");
+    DPERF_INFO("Daemon mode: waiting for requests on %s\n", path.c_str());
+  }
+
+  ~ControlSocket() {
+    close(fd_);
+    unlink(path_.c_str());
+  }
+
+  /**
+   * @brief Block until a client sends a complete request
+   * @param lines Receives the "key : value" lines of the request
+   * @param cmd Receives the command that ends the request
+   * @return The connection to reply on
+   */
+  int accept_request(std::vector<std::string> *lines, std::string *cmd) {
+    while (true) {
+      int conn = accept(fd_, nullptr, nullptr);
+      if (conn < 0) continue;
+      lines->clear();
+      cmd->clear();
+      std::string buf;
+      char chunk[512];
+      ssize_t n;
+      while (cmd->empty() && (n = read(conn, chunk, sizeof(chunk))) > 0) {
+        buf.append(chunk, n);
+        size_t eol;
+        while (cmd->empty() && (eol = buf.find('\n')) != std::string::npos) {
+          std::string line = buf.substr(0, eol);
+          buf.erase(0, eol + 1);
+          if (!line.empty() && line.back() == '\r') line.pop_back();
+          if (line == "run" || line == "quit") *cmd = line;
+          else if (!line.empty()) lines->push_back(line);
+        }
+      }
+      if (!cmd->empty()) return conn;
+      reply_error(conn, "request is not ended by run or quit");
+    }
+  }
+
+  /// Send \p msg and close the connection
+  void reply(int conn, const std::string &msg) {
+    std::string out = msg + "\n";
+    const char *p = out.c_str();
+    size_t len = out.size();
+    while (len > 0) {
+      ssize_t n = send(conn, p, len, MSG_NOSIGNAL);    // the client may be gone
+      if (n <= 0) break;
+      p += n;
+      len -= n;
+    }
+    close(conn);
+  }
+
+  void reply_error(int conn, const std::string &err) {
+    std::string escaped;
+    for (char c : err) {
+      if (c == '"' || c == '\\') escaped.push_back('\\');
+      if (static_cast<unsigned char>(c) >= 0x20) escaped.push_back(c);
+    }
+    reply(conn, "{\"status\": \"error\", \"error\": \"" + escaped + "\"}");
+  }
+
+ private:
+  std::string path_;
+  int fd_ = -1;
+};
+
+}  // namespace dperf
@@ -0,0 +1,84 @@
+/**
+ * @file elastic_controller.h
+ * @brief Hysteresis control of how many app workspaces of a group are active
+ */
+#pragma once
+
+#include "common.h"
+
+namespace dperf {
+
+/**
+ * Decides, once per control interval, whether a group of app workspaces should
+ * park one of its active workspaces or unpark a parked one.
+ *
+ * The inputs are the utilization of the active workspaces, i.e., the fraction
+ * of the interval their loops moved messages, and their RX backlog:
+ *  - a workspace is unparked as soon as the utilization exceeds \p unpark_util,
+ *    or the backlog exceeds \p high_backlog messages per active workspace;
+ *  - a workspace is parked once the utilization stayed below \p park_util for
+ *    \p hold intervals, and the remaining workspaces would still stay below
+ *    \p unpark_util with its load, so that parking does not trigger an unpark.
+ */
+class ElasticController {
+ public:
+  struct elastic_stats {
+    size_t parks_ = 0;
+    size_t unparks_ = 0;
+    size_t min_active_ = SIZE_MAX;
+    size_t max_active_ = 0;
+    size_t active_tsc_ = 0;     ///< Sum of active workspaces times the interval length
+    size_t elapsed_tsc_ = 0;
+  };
+
+  void init(double park_util, double unpark_util, size_t hold, size_t high_backlog) {
+    park_util_ = park_util;
+    unpark_util_ = unpark_util;
+    hold_ = hold;
+    high_backlog_ = high_backlog;
+    calm_ = 0;
+    stats_ = elastic_stats();
+  }
+
+  /**
+   * @brief Observe an interval of the group
+   * @param util Utilization of the active workspaces, in [0, 1]
+   * @param backlog Messages queued at the active workspaces
+   * @param active Active workspaces during the interval
+   * @param min_active, max_active Bounds of the active workspaces
+   * @param elapsed_tsc Length of the interval
+   * @return 1 to unpark a workspace, -1 to park one, 0 to keep the group as is
+   */
+  int step(double util, size_t backlog, size_t active, size_t min_active, size_t max_active, size_t elapsed_tsc) {
+    stats_.active_tsc_ += active * elapsed_tsc;
+    stats_.elapsed_tsc_ += elapsed_tsc;
+    stats_.min_active_ = active < stats_.min_active_ ? active : stats_.min_active_;
+    stats_.max_active_ = active > stats_.max_active_ ? active : stats_.max_active_;
+
+    if (active < max_active && (util > unpark_util_ || backlog > high_backlog_ * active)) {
+      calm_ = 0;
+      stats_.unparks_++;
+      return 1;
+    }
+    if (active > min_active && util < park_util_ && util * active / (active - 1) < unpark_util_) {
+      if (++calm_ < hold_) return 0;
+      calm_ = 0;
+      stats_.parks_++;
+      return -1;
+    }
+    calm_ = 0;
+    return 0;
+  }
+
+  inline const elastic_stats &get_stats() const { return stats_; }
+
+ private:
+  double park_util_ = 0;
+  double unpark_util_ = 1;
+  size_t hold_ = 1;
+  size_t high_backlog_ = 0;
+  size_t calm_ = 0;             ///< Consecutive intervals below park_util_
+  elastic_stats stats_;
+};
+
+}  // namespace dperf
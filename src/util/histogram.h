@@ -0,0 +1,105 @@
+/**
+ * @file histogram.h
+ * @brief A fixed-memory log-linear (HDR-style) histogram
+ */
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include "common.h"
+
+namespace dperf {
+
+/**
+ * A log-linear histogram of uint64_t values, e.g., TSC cycles.
+ *
+ * Values below 2^kSubBucketBits are counted exactly. Above that, each power of
+ * two is split into 2^kSubBucketBits linear sub-buckets, so a recorded value
+ * is off by at most 1 / 2^kSubBucketBits of itself (~3% by default). The
+ * counters are a flat array, and record() is a clz, two shifts, and an add.
+ */
+template <size_t kSubBucketBits = 5>
+class LogLinearHistogram {
+ public:
+  static constexpr size_t kSubBuckets = 1ull << kSubBucketBits;
+  static constexpr size_t kBucketNum = (64 - kSubBucketBits + 1) * kSubBuckets;
+
+  LogLinearHistogram() { reset(); }
+
+  inline void reset() {
+    memset(counts_, 0, sizeof(counts_));
+    total_ = 0;
+    sum_ = 0;
+    min_ = UINT64_MAX;
+    max_ = 0;
+  }
+
+  /// Record \p n occurrences of \p value
+  inline void record(uint64_t value, uint64_t n = 1) {
+    counts_[bucket_index(value)] += n;
+    total_ += n;
+    sum_ += value * n;
+    min_ = value < min_ ? value : min_;
+    max_ = value > max_ ? value : max_;
+  }
+
+  /// Add all values recorded by \p other
+  void merge(const LogLinearHistogram &other) {
+    for (size_t i = 0; i < kBucketNum; i++) counts_[i] += other.counts_[i];
+    total_ += other.total_;
+    sum_ += other.sum_;
+    min_ = other.min_ < min_ ? other.min_ : min_;
+    max_ = other.max_ > max_ ? other.max_ : max_;
+  }
+
+  /**
+   * @brief Return the value at percentile \p p (0 - 100), as the highest value
+   * of the bucket holding it. Return 0 if nothing has been recorded.
+   */
+  uint64_t percentile(double p) const {
+    if (total_ == 0) return 0;
+    uint64_t rank = static_cast<uint64_t>(p / 100.0 * total_ + 0.5);
+    rank = rank == 0 ? 1 : (rank > total_ ? total_ : rank);
+    uint64_t seen = 0;
+    for (size_t i = 0; i < kBucketNum; i++) {
+      seen += counts_[i];
+      if (seen >= rank) {
+        uint64_t high = bucket_high(i);
+        return high > max_ ? max_ : high;
+      }
+    }
+    return max_;
+  }
+
+  inline uint64_t get_count() const { return total_; }
+  inline uint64_t get_min() const { return total_ ? min_ : 0; }
+  inline uint64_t get_max() const { return max_; }
+  inline double get_mean() const { return total_ ? static_cast<double>(sum_) / total_ : 0.0; }
+
+ private:
+  static inline size_t bucket_index(uint64_t value) {
+    if (value < kSubBuckets) return value;
+    size_t exp = 63 - __builtin_clzll(value);      // exp >= kSubBucketBits
+    size_t shift = exp - kSubBucketBits;
+    return ((shift + 1) << kSubBucketBits) + ((value >> shift) & (kSubBuckets - 1));
+  }
+
+  /// Return the highest value that falls into bucket \p idx
+  static inline uint64_t bucket_high(size_t idx) {
+    if (idx < kSubBuckets) return idx;
+    size_t shift = (idx >> kSubBucketBits) - 1;
+    uint64_t low = (kSubBuckets + (idx & (kSubBuckets - 1))) << shift;
+    return low + ((1ull << shift) - 1);
+  }
+
+  uint64_t counts_[kBucketNum];
+  uint64_t total_;
+  uint64_t sum_;
+  uint64_t min_;
+  uint64_t max_;
+};
+
+/// The default histogram, ~3% relative error in 15 KB
+using Histogram = LogLinearHistogram<>;
+
+}  // namespace dperf
@@ -1,5 +1,6 @@
 #pragma once
 #include "common.h"
+#include "util/math_utils.h"
 
 namespace dperf {
 /**
@@ -14,6 +15,8 @@ namespace dperf {
 
 struct lock_free_queue {
     uint8_t* queue_[kWsQueueSize];
+    /// Free-running indices, masked only on access. They never wrap in practice (64 bits), so a
+    /// consumer's CAS on head_ cannot succeed on an index another consumer already took (no ABA)
     volatile size_t head_ = 0;
     volatile size_t tail_ = 0;
     const size_t mask_ = kWsQueueSize - 1;  // Assuming kWsQueueSize is a power of 2
@@ -23,18 +26,36 @@ struct lock_free_queue {
         memset(queue_, 0, sizeof(queue_));
     }
     inline bool enqueue(uint8_t *pkt) {
-        size_t next_tail = (tail_ + 1) & mask_;
-        if (next_tail == head_) return false;
-        queue_[tail_] = pkt;
-        tail_ = next_tail;
+        /// one slot stays empty, as before the indices were free-running
+        if (tail_ - head_ >= mask_) return false;
+        queue_[tail_ & mask_] = pkt;
+        tail_ = tail_ + 1;
         return true;
     }
     inline uint8_t* dequeue() {
         if (head_ == tail_) return nullptr;
-        uint8_t* ret = queue_[head_];
-        head_ = (head_ + 1) & mask_;
+        uint8_t* ret = queue_[head_ & mask_];
+        head_ = head_ + 1;
         return ret;
     }
+    /**
+     * @brief Dequeue up to \p max entries into \p pkts. Unlike dequeue(), it is safe
+     * against other consumers that also use it, e.g., siblings stealing work, as the
+     * entries are only taken once head_ is moved past them by a CAS.
+     * @return The number of entries taken
+     */
+    inline size_t dequeue_burst(uint8_t **pkts, size_t max) {
+        size_t head, num;
+        do {
+            head = __atomic_load_n(&head_, __ATOMIC_ACQUIRE);
+            num = __atomic_load_n(&tail_, __ATOMIC_ACQUIRE) - head;
+            num = num < max ? num : max;
+            for (size_t i = 0; i < num; i++) pkts[i] = queue_[(head + i) & mask_];
+        } while (num != 0 && !__atomic_compare_exchange_n(&head_, &head, head + num, 
+                                                          false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+        return num;
+    }
+    /// Only on an idle queue, and together with reset_tail()
     inline void reset_head() {
         head_ = 0;
     }
@@ -42,7 +63,9 @@ struct lock_free_queue {
         tail_ = 0;
     }
     inline size_t get_size() {
-        return (tail_ - head_) & mask_;
+        /// head_ first, so that a concurrent consumer cannot move it past the tail_ we read
+        size_t head = head_;
+        return tail_ - head;
     }
 };
 } // namespace dperf
\ No newline at end of file
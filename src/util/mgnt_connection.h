@@ -4,8 +4,58 @@
 #include <cstring>
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <arpa/inet.h>
 #include <unistd.h>
+#include <cstdint>
+#include <chrono>
+#include <thread>
+
+/// Write the whole buffer, return false if the peer is gone
+inline bool sendAll(int fd, const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = send(fd, buf, len, 0);
+        if (n <= 0) return false;
+        buf += n;
+        len -= n;
+    }
+    return true;
+}
+
+/// Read exactly len bytes, return false if the peer is gone
+inline bool recvAll(int fd, char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = read(fd, buf, len);
+        if (n <= 0) return false;
+        buf += n;
+        len -= n;
+    }
+    return true;
+}
+
+/// Send a length-prefixed message of arbitrary size
+inline void sendFrame(int fd, const std::string &msg) {
+    uint32_t len = htonl(static_cast<uint32_t>(msg.length()));
+    if (!sendAll(fd, (const char *)&len, sizeof(len)) || !sendAll(fd, msg.c_str(), msg.length())) {
+        std::cerr << "Failed to send frame." << std::endl;
+        exit(1);
+    }
+}
+
+/// Receive a length-prefixed message sent by sendFrame()
+inline std::string receiveFrame(int fd) {
+    uint32_t len = 0;
+    if (!recvAll(fd, (char *)&len, sizeof(len))) {
+        std::cerr << "Failed to receive frame header." << std::endl;
+        exit(1);
+    }
+    std::string msg(ntohl(len), '\0');
+    if (!recvAll(fd, &msg[0], msg.length())) {
+        std::cerr << "Failed to receive frame." << std::endl;
+        exit(1);
+    }
+    return msg;
+}
 
     
 class TCPClient {
@@ -15,6 +65,10 @@ private:
 
 public:
     TCPClient() {
+        createSocket();
+    }
+
+    void createSocket() {
         sockfd = socket(AF_INET, SOCK_STREAM, 0);
         if (sockfd < 0) {
             std::cerr << "Error creating socket." << std::endl;
@@ -30,6 +84,30 @@ public:
         // 允许地址重用
         int opt = 1;
         setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, (const char *)&opt, sizeof(opt));
+        // Control messages are small, do not wait for Nagle
+        setsockopt(sockfd, IPPROTO_TCP, TCP_NODELAY, (const char *)&opt, sizeof(opt));
+    }
+
+    /// Connect to a server that may not be listening yet, retrying every
+    /// millisecond for at most timeout_ms
+    void connectToServer(const char* ip, int port, size_t timeout_ms) {
+        serverAddr.sin_family = AF_INET;
+        serverAddr.sin_port = htons(port);
+        inet_pton(AF_INET, ip, &serverAddr.sin_addr);
+
+        auto start = std::chrono::steady_clock::now();
+        while (connect(sockfd, (struct sockaddr*)&serverAddr, sizeof(serverAddr)) < 0) {
+            auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now() - start).count();
+            if (static_cast<size_t>(elapsed) >= timeout_ms) {
+                std::cerr << "Connection failed after " << elapsed << " ms." << std::endl;
+                exit(1);
+            }
+            // A failed connect() leaves the socket unusable
+            close(sockfd);
+            createSocket();
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
     }
 
     void connectToServer(const char* ip, int port) {
@@ -54,6 +132,14 @@ public:
         return std::string(buffer, valread);
     }
 
+    void sendFrameMsg(const std::string& msg) {
+        sendFrame(sockfd, msg);
+    }
+
+    std::string receiveFrameMsg() {
+        return receiveFrame(sockfd);
+    }
+
     void disconnect() {
         close(sockfd);
         // std::cout << "Disconnected from server." << std::endl;
@@ -108,6 +194,8 @@ public:
             std::cerr << "Accept failed." << std::endl;
             exit(1);
         }
+        int opt = 1;
+        setsockopt(new_socket, IPPROTO_TCP, TCP_NODELAY, (const char *)&opt, sizeof(opt));
         // std::cout << "Connection accepted." << std::endl;
     }
 
@@ -121,6 +209,14 @@ public:
         return std::string(buffer, valread);
     }
 
+    void sendFrameMsg(const std::string& msg) {
+        sendFrame(new_socket, msg);
+    }
+
+    std::string receiveFrameMsg() {
+        return receiveFrame(new_socket);
+    }
+
     void disconnect() {
         close(new_socket);
         // std::cout << "Client disconnected." << std::endl;
@@ -20,14 +20,74 @@
 
 #pragma once
 #include "common.h"
+#include "util/histogram.h"
+#if PERF_HW_COUNTERS == 1
+#include "util/perf_counters.h"
+#endif
 #include <iostream>
 #include <iomanip>
 
 namespace dperf {
+/**
+ * ----------------------Phases of the event loop----------------------
+ * In the bit order of kPhase*, plus the whole loop of an interpreted loop,
+ * which is not timed per phase.
+ */ 
+static constexpr size_t kLoopPhaseNum = 8;
+static constexpr size_t kLoopPhaseInterpreted = 7;
+static const char *const kLoopPhaseName[kLoopPhaseNum] = {
+    "nic_rx", "bursted_rx", "app_handler", "apply_mbufs", "generate_pkts", "bursted_tx", "nic_tx", "loop",
+};
+
+/**
+ * ----------------------Per-stage histograms (PERF_STATS_HIST)----------------------
+ */ 
+enum stage_hist_t : uint8_t {
+    kHistAppTxMsgs = 0,     // messages generated per batch
+    kHistAppTxCycles,       // cycles per generated batch
+    kHistAppTxStall,        // cycles stalled per mbuf allocation
+    kHistAppRxMsgs,         // messages handled per batch
+    kHistAppRxCycles,       // cycles per handled batch
+    kHistAppRxStall,        // cycles stalled per handled batch
+    kHistAppDrops,          // packets dropped per full tx queue
+    kHistDispTxPkts,        // packets collected per collect_tx_pkts
+    kHistDispTxCycles,      // cycles per collect_tx_pkts
+    kHistDispTxStall,       // cycles per tx_flush
+    kHistNicTxPkts,         // packets per tx_flush
+    kHistNicRxPkts,         // RX descriptors used between two nic_rx
+    kHistNicRxCpt,          // cycles per RX descriptor
+    kHistDispRxPkts,        // packets dispatched per batch
+    kHistDispRxCycles,      // cycles per dispatched batch
+    kHistDispRxStall,       // cycles per non-empty rx_burst
+    kHistDispDrops,         // packets dropped per full worker queue
+    kHistMbufUsage,         // mbufs in use
+    kHistLoopCycles,        // cycles per event loop
+    kStageHistNum
+};
+
+struct stage_hist_info {
+    const char *name_;
+    bool is_cycles_;        // cycles are printed in ns
+};
+
+static const stage_hist_info kStageHistInfo[kStageHistNum] = {
+    {"app_tx_msgs", false}, {"app_tx_cycles", true}, {"app_tx_stall", true},
+    {"app_rx_msgs", false}, {"app_rx_cycles", true}, {"app_rx_stall", true}, {"app_drops", false},
+    {"disp_tx_pkts", false}, {"disp_tx_cycles", true}, {"disp_tx_stall", true}, {"nic_tx_pkts", false},
+    {"nic_rx_pkts", false}, {"nic_rx_cpt", true},
+    {"disp_rx_pkts", false}, {"disp_rx_cycles", true}, {"disp_rx_stall", true}, {"disp_drops", false},
+    {"mbuf_usage", false}, {"loop_cycles", true},
+};
+
 struct net_stats {
     /* App level */
     uint64_t app_tx_msg_num = 0;
     uint64_t app_rx_msg_num = 0;
+    uint64_t app_tx_late_num = 0;     // open loop: messages generated later than scheduled
+    uint64_t app_steal_attempts = 0;  // work stealing: a sibling had a backlog to steal from
+    uint64_t app_steal_successes = 0;
+    uint64_t app_stolen_msg_num = 0;
+    uint64_t app_park_duration = 0;   // elastic mode: cycles parked
 
     uint64_t app_tx_invoke_times = 0;
     uint64_t app_tx_avg_duration = 0;
@@ -74,6 +134,89 @@ struct net_stats {
     uint32_t mbuf_alloc_times = 0;
     uint64_t mbuf_usage = 0;
     uint64_t disp_enqueue_drops = 0;
+
+    /* Event loop */
+    uint64_t loop_num = 0;
+    uint64_t loop_duration = 0;
+    uint64_t idle_loop_num = 0;       // loops that moved no packet
+    uint64_t idle_loop_duration = 0;
+    uint64_t backoff_duration = 0;    // cycles spent waiting in backoff
+
+    /* Cycle accounting (PERF_CYCLE_ACCOUNTING), all cycles between the start and the timeout */
+    uint64_t phase_busy_duration[kLoopPhaseNum] = {};     // calls that moved packets
+    uint64_t phase_empty_duration[kLoopPhaseNum] = {};    // empty polls
+    uint64_t phase_calls[kLoopPhaseNum] = {};
+    uint64_t pacing_duration = 0;     // spinning for the next loop of kPacingInterval
+    uint64_t housekeeping_duration = 0;   // elastic steps and publishing stats, incl. parked time
+    uint64_t window_duration = 0;     // from the start of the loop to the timeout
+    uint64_t probe_loop_num = 0;      // loops with probes, all of them unless sampled
+    double probe_cycles = 0;          // measured cost of one duration probe
+
+    /* Distributions of the stages above, kept across resets */
+    Histogram *hists = nullptr;
+
+#if PERF_HW_COUNTERS == 1
+    /* Hardware events of each phase */
+    uint64_t hw_[kLoopPhaseNum][kHwEventNum] = {};
+#endif
+};
+
+/// Messages or packets a phase moved, a phase that moved none was an empty poll
+static inline uint64_t phase_pkts(const struct net_stats *stats, size_t phase) {
+    static const uint64_t net_stats::*kPhasePkts[kLoopPhaseNum] = {
+        &net_stats::nic_rx_pkt_num, &net_stats::disp_rx_pkt_num, &net_stats::app_rx_msg_num,
+        &net_stats::app_tx_msg_num, &net_stats::app_tx_msg_num, &net_stats::disp_tx_pkt_num,
+        &net_stats::nic_tx_pkt_num, &net_stats::loop_num,
+    };
+    return stats->*kPhasePkts[phase];
+}
+
+#if PERF_HW_COUNTERS == 1
+/// Print the events of each phase as IPC and events per packet
+static inline void print_hw_phases(const char *prefix, const uint64_t (*hw)[kHwEventNum], const struct net_stats *stats) {
+    for (size_t phase = 0; phase < kLoopPhaseNum; phase++) {
+        const uint64_t *ev = hw[phase];
+        if (ev[kHwCycles] == 0) continue;
+        double pkts = std::max<uint64_t>(phase_pkts(stats, phase), 1);
+        printf("%s %-13s IPC %.2f, %.1f cycles, %.1f instructions, %.3f LLC misses (%.1f%% of loads), %.3f dTLB misses, %.3f branch misses /%s\n",
+               prefix, kLoopPhaseName[phase], ev[kHwCycles] ? (double)ev[kHwInstructions] / ev[kHwCycles] : 0.0,
+               ev[kHwCycles] / pkts, ev[kHwInstructions] / pkts, ev[kHwLlcMisses] / pkts,
+               ev[kHwLlcLoads] ? 100.0 * ev[kHwLlcMisses] / ev[kHwLlcLoads] : 0.0,
+               ev[kHwDtlbMisses] / pkts, ev[kHwBranchMisses] / pkts, phase == kLoopPhaseInterpreted ? "loop" : "pkt");
+    }
+}
+#endif
+
+/// The scalar fields of net_stats, written to the result file
+#define NET_STATS_FIELDS(X)                                                                         \
+    X(app_tx_msg_num) X(app_rx_msg_num) X(app_tx_late_num)                                         \
+    X(app_steal_attempts) X(app_steal_successes) X(app_stolen_msg_num) X(app_park_duration)        \
+    X(app_tx_invoke_times) X(app_tx_avg_duration) X(app_tx_max_duration) X(app_tx_min_duration)    \
+    X(app_tx_stall_avg_duration) X(app_tx_stall_max_duration) X(app_tx_stall_min_duration)         \
+    X(app_tx_mbuf_reuse_interval) X(app_tx_nb_traced_mbuf)                                         \
+    X(app_rx_invoke_times) X(app_rx_avg_duration) X(app_rx_max_duration) X(app_rx_min_duration)    \
+    X(app_rx_stall_avg_duration) X(app_rx_stall_max_duration) X(app_rx_stall_min_duration)         \
+    X(disp_tx_pkt_num) X(disp_rx_pkt_num) X(disp_tx_duration) X(disp_tx_stall_duration)            \
+    X(disp_rx_duration) X(disp_rx_stall_duration)                                                  \
+    X(nic_tx_pkt_num) X(nic_rx_pkt_num) X(nic_tx_duration) X(nic_rx_duration)                      \
+    X(nic_rx_cpt) X(nic_rx_times)                                                                  \
+    X(app_apply_mbuf_stalls) X(app_enqueue_drops) X(mbuf_alloc_times) X(mbuf_usage)                \
+    X(disp_enqueue_drops)                                                                          \
+    X(loop_num) X(loop_duration) X(idle_loop_num) X(idle_loop_duration) X(backoff_duration)      \
+    X(pacing_duration) X(housekeeping_duration) X(window_duration) X(probe_loop_num) X(probe_cycles)
+
+/// Counters a workspace publishes while it runs, read by the stats monitor
+struct stats_sample {
+    uint64_t epoch = 0;               // iteration of the workspace, the counters restart in each
+    uint64_t app_tx_msg_num = 0;
+    uint64_t app_rx_msg_num = 0;
+    uint64_t disp_tx_pkt_num = 0;
+    uint64_t disp_rx_pkt_num = 0;
+    uint64_t nic_tx_pkt_num = 0;
+    uint64_t nic_rx_pkt_num = 0;
+    uint64_t drops = 0;               // app and dispatcher enqueue drops
+    uint64_t loop_num = 0;
+    uint64_t idle_loop_num = 0;
 };
 
 struct perf_stats {
@@ -109,12 +252,26 @@ struct perf_stats {
     double disp_rx_stall_ = 0;
 
     double disp_mbuf_usage = 0;
+    double disp_dma_footprint_ = 0;     // KB of packet buffers of all dispatcher queues
 
     double nic_tx_throughput_ = 0;
     double nic_rx_throughput_ = 0;
     double nic_tx_compl_ = 0;
     double nic_rx_compl_ = 0;
 
+    double app_cores_ = 0;      // app workspaces in use, less than the workers if some were parked
+
+/// The fields of perf_stats, written to the result file
+#define PERF_STATS_FIELDS(X)                                                                        \
+    X(e2e_throughput_) X(e2e_compl_) X(app_tx_throughput_) X(app_rx_throughput_)                   \
+    X(app_tx_compl_) X(app_tx_compl_max_) X(app_tx_compl_min_) X(app_tx_compl_avg_)                \
+    X(app_tx_stall_) X(app_tx_stall_avg_) X(app_tx_stall_min_) X(app_tx_stall_max_)                \
+    X(app_rx_compl_) X(app_rx_compl_max_) X(app_rx_compl_min_) X(app_rx_compl_avg_)                \
+    X(app_rx_stall_) X(app_rx_stall_avg_) X(app_rx_stall_min_) X(app_rx_stall_max_)                \
+    X(disp_tx_throughput_) X(disp_rx_throughput_) X(disp_tx_compl_) X(disp_tx_stall_)              \
+    X(disp_rx_compl_) X(disp_rx_stall_) X(disp_mbuf_usage) X(disp_dma_footprint_)                  \
+    X(nic_tx_throughput_) X(nic_rx_throughput_) X(nic_tx_compl_) X(nic_rx_compl_) X(app_cores_)
+
     
 
     public:
@@ -210,65 +367,117 @@ struct perf_stats {
                         << std::setw(20) << nic_rx_throughput_
                         << std::setw(15) << nic_rx_compl_
                         << std::endl;
+            std::cout << std::left
+                        << std::setw(20) << "dma_footprint (MB)"
+                        << std::setw(20) << disp_dma_footprint_ / 1024
+                        << std::endl;
             std::cout   << "---------------------------------------------------------------------"
                         << "---------------------------------------------------------------------"
                         << "---------------------------------------------------------------------"
                         << std::endl;
             std::cout   << std::endl;
         }
+
+        /// The stats of print_perf_stats() as a JSON object, call it after print_perf_stats()
+        std::string to_json() const {
+            /// idle stages divide by zero, JSON has no inf or nan
+            auto __num = [](double v) { return std::isfinite(v) ? v : 0.0; };
+            char buf[1024];
+            snprintf(buf, sizeof(buf), 
+                "{\"e2e\": {\"mpps\": %.3f, \"compl\": %.3f}, "
+                "\"app_tx\": {\"mpps\": %.3f, \"compl\": %.3f, \"stall\": %.3f}, "
+                "\"app_rx\": {\"mpps\": %.3f, \"compl\": %.3f, \"stall\": %.3f}, "
+                "\"disp_tx\": {\"mpps\": %.3f, \"compl\": %.3f, \"stall\": %.3f}, "
+                "\"disp_rx\": {\"mpps\": %.3f, \"compl\": %.3f, \"stall\": %.3f}, "
+                "\"nic_tx\": {\"mpps\": %.3f, \"compl\": %.3f}, "
+                "\"nic_rx\": {\"mpps\": %.3f, \"compl\": %.3f}, "
+                "\"app_cores\": %.3f, \"dma_footprint_kb\": %.1f}",
+                __num(e2e_throughput_), __num(e2e_compl_),
+                __num(app_tx_throughput_), __num(app_tx_compl_ + app_tx_stall_), __num(app_tx_stall_),
+                __num(app_rx_throughput_), __num(app_rx_compl_ + app_rx_stall_), __num(app_rx_stall_),
+                __num(disp_tx_throughput_), __num(disp_tx_compl_ + disp_tx_stall_), __num(disp_tx_stall_),
+                __num(disp_rx_throughput_), __num(disp_rx_compl_ + disp_rx_stall_), __num(disp_rx_stall_),
+                __num(nic_tx_throughput_), __num(nic_tx_compl_), __num(nic_rx_throughput_), __num(nic_rx_compl_),
+                __num(app_cores_), __num(disp_dma_footprint_));
+            return std::string(buf);
+        }
 };
 
-#define net_stats_app_tx(n)      do {stats_->app_tx_msg_num += (n);} while (0)
-#define net_stats_app_rx(n)     do {stats_->app_rx_msg_num += (n);} while (0)
+#if PERF_STATS_HIST == 1
+#define net_stats_hist(stage, n) do {stats_->hists[stage].record(n);} while (0)
+#else
+#define net_stats_hist(stage, n) do { /* do nothing */ } while (0)
+#endif
+
+#define net_stats_app_tx(n)      do {stats_->app_tx_msg_num += (n); net_stats_hist(kHistAppTxMsgs, n);} while (0)
+#define net_stats_app_rx(n)     do {stats_->app_rx_msg_num += (n); net_stats_hist(kHistAppRxMsgs, n);} while (0)
+#define net_stats_app_tx_late(n) do {stats_->app_tx_late_num += (n);} while (0)
 
+/**
+ * Duration probes only run in the loops a workspace instruments (probe_), see
+ * the instrument config. In sampled loops the sums are scaled by probe_scale_,
+ * so averages stay per packet, while min, max and histograms take the samples.
+ */
 #if PERF_TEST_LAT == 1 && PERF_TEST_LAT_MIN_MAX == 1
-#define net_stats_app_tx_duration(n) do {                                       \
+#define net_stats_app_tx_duration(n) do { if (!probe_) break;                   \
     uint64_t duration_tick = rdtsc() - n;                                       \
-    stats_->app_tx_invoke_times += 1;                                           \
-    stats_->app_tx_avg_duration += duration_tick;                               \
+    stats_->app_tx_invoke_times += probe_scale_;                                \
+    stats_->app_tx_avg_duration += duration_tick * probe_scale_;                \
     stats_->app_tx_min_duration = stats_->app_tx_min_duration > duration_tick   \
                                 ? duration_tick : stats_->app_tx_min_duration;  \
     stats_->app_tx_max_duration = stats_->app_tx_max_duration < duration_tick   \
                                 ? duration_tick : stats_->app_tx_max_duration;  \
+    net_stats_hist(kHistAppTxCycles, duration_tick);                            \
 } while (0)
-#define net_stats_app_tx_stall_duration(n) do {                                             \
+#define net_stats_app_tx_stall_duration(n) do { if (!probe_) break;                         \
     uint64_t duration_tick = rdtsc() - n;                                                   \
-    stats_->app_tx_stall_avg_duration += duration_tick;                                     \
+    stats_->app_tx_stall_avg_duration += duration_tick * probe_scale_;                      \
     stats_->app_tx_stall_max_duration = stats_->app_tx_stall_max_duration < duration_tick   \
                                     ? duration_tick : stats_->app_tx_stall_max_duration;    \
     stats_->app_tx_stall_min_duration = stats_->app_tx_stall_min_duration > duration_tick   \
                                     ? duration_tick : stats_->app_tx_stall_min_duration;    \
+    net_stats_hist(kHistAppTxStall, duration_tick);                                         \
 } while (0)
 
-#define net_stats_app_rx_duration(n) do {                                       \
+#define net_stats_app_rx_duration(n) do { if (!probe_) break;                   \
     uint64_t duration_tick = rdtsc() - n;                                       \
-    stats_->app_rx_invoke_times += 1;                                           \
-    stats_->app_rx_avg_duration += duration_tick;                               \
+    stats_->app_rx_invoke_times += probe_scale_;                                \
+    stats_->app_rx_avg_duration += duration_tick * probe_scale_;                \
     stats_->app_rx_min_duration = stats_->app_rx_min_duration > duration_tick   \
                                 ? duration_tick : stats_->app_rx_min_duration;  \
     stats_->app_rx_max_duration = stats_->app_rx_max_duration < duration_tick   \
                                 ? duration_tick : stats_->app_rx_max_duration;  \
+    net_stats_hist(kHistAppRxCycles, duration_tick);                            \
 } while (0)
-#define net_stats_app_rx_stall_duration(n) do {                                             \
+#define net_stats_app_rx_stall_duration(n) do { if (!probe_) break;                         \
     uint64_t duration_tick = rdtsc() - n;                                                   \
-    stats_->app_rx_stall_avg_duration += duration_tick;                                     \
+    stats_->app_rx_stall_avg_duration += duration_tick * probe_scale_;                      \
     stats_->app_rx_stall_max_duration = stats_->app_rx_stall_max_duration < duration_tick   \
                                     ? duration_tick : stats_->app_rx_stall_max_duration;    \
     stats_->app_rx_stall_min_duration = stats_->app_rx_stall_min_duration > duration_tick   \
                                     ? duration_tick : stats_->app_rx_stall_min_duration;    \
+    net_stats_hist(kHistAppRxStall, duration_tick);                                         \
 } while (0)
 #elif PERF_TEST_LAT == 1 && PERF_TEST_LAT_MIN_MAX == 0
-#define net_stats_app_tx_duration(n) do {                                       \
-    stats_->app_tx_avg_duration += rdtsc() - n;                                \
+#define net_stats_app_tx_duration(n) do { if (!probe_) break;                   \
+    uint64_t duration_tick = rdtsc() - n;                                       \
+    stats_->app_tx_avg_duration += duration_tick * probe_scale_;                \
+    net_stats_hist(kHistAppTxCycles, duration_tick);                            \
 } while (0)
-#define net_stats_app_tx_stall_duration(n) do {                                 \
-    stats_->app_tx_stall_avg_duration += rdtsc() - n;                          \
+#define net_stats_app_tx_stall_duration(n) do { if (!probe_) break;             \
+    uint64_t duration_tick = rdtsc() - n;                                       \
+    stats_->app_tx_stall_avg_duration += duration_tick * probe_scale_;          \
+    net_stats_hist(kHistAppTxStall, duration_tick);                             \
 } while (0)
-#define net_stats_app_rx_duration(n) do {                                       \
-    stats_->app_rx_avg_duration += rdtsc() - n;                                \
+#define net_stats_app_rx_duration(n) do { if (!probe_) break;                   \
+    uint64_t duration_tick = rdtsc() - n;                                       \
+    stats_->app_rx_avg_duration += duration_tick * probe_scale_;                \
+    net_stats_hist(kHistAppRxCycles, duration_tick);                            \
 } while (0)
-#define net_stats_app_rx_stall_duration(n) do {                                 \
-    stats_->app_rx_stall_avg_duration += rdtsc() - n;                          \
+#define net_stats_app_rx_stall_duration(n) do { if (!probe_) break;             \
+    uint64_t duration_tick = rdtsc() - n;                                       \
+    stats_->app_rx_stall_avg_duration += duration_tick * probe_scale_;          \
+    net_stats_hist(kHistAppRxStall, duration_tick);                             \
 } while (0)
 #endif
 
@@ -291,27 +500,66 @@ struct perf_stats {
 #define net_stats_app_tx_mbuf_reuse_interval(mbuf_addr) do { /* do nothing */ } while (0)
 #endif
 
-#define net_stats_disp_tx(n)    do {stats_->disp_tx_pkt_num += (n);} while (0)
-#define net_stats_disp_rx(n)    do {stats_->disp_rx_pkt_num += (n);} while (0)
-#define net_stats_disp_tx_duration(n) do {stats_->disp_tx_duration += rdtsc() - (n);} while (0)
-#define net_stats_disp_tx_stall_duration(n) do {stats_->disp_tx_stall_duration += rdtsc() - (n);} while (0)
-#define net_stats_disp_rx_duration(n) do {stats_->disp_rx_duration += rdtsc() - (n);} while (0)
-#define net_stats_disp_rx_stall_duration(n) do {stats_->disp_rx_stall_duration += rdtsc() - (n);} while (0)
+#define net_stats_disp_tx(n)    do {stats_->disp_tx_pkt_num += (n); net_stats_hist(kHistDispTxPkts, n);} while (0)
+#define net_stats_disp_rx(n)    do {stats_->disp_rx_pkt_num += (n); net_stats_hist(kHistDispRxPkts, n);} while (0)
+#define net_stats_disp_tx_duration(n) do { if (!probe_) break;                  \
+    uint64_t duration_tick = rdtsc() - (n);                                     \
+    stats_->disp_tx_duration += duration_tick * probe_scale_;                   \
+    net_stats_hist(kHistDispTxCycles, duration_tick);                           \
+} while (0)
+#define net_stats_disp_tx_stall_duration(n) do { if (!probe_) break;            \
+    uint64_t duration_tick = rdtsc() - (n);                                     \
+    stats_->disp_tx_stall_duration += duration_tick * probe_scale_;             \
+    net_stats_hist(kHistDispTxStall, duration_tick);                            \
+} while (0)
+#define net_stats_disp_rx_duration(n) do { if (!probe_) break;                  \
+    uint64_t duration_tick = rdtsc() - (n);                                     \
+    stats_->disp_rx_duration += duration_tick * probe_scale_;                   \
+    net_stats_hist(kHistDispRxCycles, duration_tick);                           \
+} while (0)
+#define net_stats_disp_rx_stall_duration(n) do { if (!probe_) break;            \
+    uint64_t duration_tick = rdtsc() - (n);                                     \
+    stats_->disp_rx_stall_duration += duration_tick * probe_scale_;             \
+    net_stats_hist(kHistDispRxStall, duration_tick);                            \
+} while (0)
 
-#define net_stats_nic_tx(n)     do {stats_->nic_tx_pkt_num += (n);} while (0)
-#define net_stats_nic_rx(m, n)     do {stats_->nic_rx_pkt_num += (m) - (n);} while (0)
-#define net_stats_nic_tx_duration() do {stats_->nic_tx_duration += rdtsc() - stats_->nic_tx_start_tick;} while (0)
-#define net_stats_nic_rx_duration(m, n) do {stats_->nic_rx_duration += (m) - (n);} while (0)
-#define net_stats_nic_rx_cpt(n) do {stats_->nic_rx_cpt += (n); stats_->nic_rx_times++;} while (0)
+#define net_stats_nic_tx(n)     do {stats_->nic_tx_pkt_num += (n); net_stats_hist(kHistNicTxPkts, n);} while (0)
+#define net_stats_nic_rx(m, n)     do {stats_->nic_rx_pkt_num += (m) - (n); net_stats_hist(kHistNicRxPkts, (m) - (n));} while (0)
+#define net_stats_nic_tx_duration() do { if (!probe_) break; stats_->nic_tx_duration += rdtsc() - stats_->nic_tx_start_tick;} while (0)
+#define net_stats_nic_rx_duration(m, n) do { if (!probe_) break; stats_->nic_rx_duration += (m) - (n);} while (0)
+#define net_stats_nic_rx_cpt(n) do { if (!probe_) break; stats_->nic_rx_cpt += (n); stats_->nic_rx_times++; net_stats_hist(kHistNicRxCpt, static_cast<uint64_t>(n));} while (0)
 
 /* Diagnose */
 #define net_stats_app_apply_mbuf_stalls() do {stats_->app_apply_mbuf_stalls++;} while (0)
-#define net_stats_app_drops(n)    do {stats_->app_enqueue_drops += n;} while (0)
-#define net_stats_mbuf_usage(n) do{stats_->mbuf_alloc_times++; stats_->mbuf_usage += n;} while(0)
-#define net_stats_disp_enqueue_drops(n) do {stats_->disp_enqueue_drops += n;} while (0)
+#define net_stats_app_park(n)     do {stats_->app_park_duration += (n);} while (0)
+#define net_stats_app_steal(n)    do {stats_->app_steal_attempts++; stats_->app_steal_successes += ((n) != 0); stats_->app_stolen_msg_num += (n);} while (0)
+#define net_stats_app_drops(n)    do {stats_->app_enqueue_drops += n; if (n) net_stats_hist(kHistAppDrops, n);} while (0)
+#define net_stats_mbuf_usage(n) do{stats_->mbuf_alloc_times++; stats_->mbuf_usage += n; net_stats_hist(kHistMbufUsage, n);} while(0)
+#define net_stats_disp_enqueue_drops(n) do {stats_->disp_enqueue_drops += n; if (n) net_stats_hist(kHistDispDrops, n);} while (0)
+
+#define net_stats_loop(idle, n) do {                                            \
+    stats_->loop_num++; stats_->loop_duration += (n);                           \
+    if (idle) {stats_->idle_loop_num++; stats_->idle_loop_duration += (n);}     \
+    net_stats_hist(kHistLoopCycles, n);                                         \
+} while (0)
+#define net_stats_backoff(n) do {stats_->backoff_duration += (n);} while (0)
+#if PERF_CYCLE_ACCOUNTING == 1
+#define net_stats_pacing(n) do {stats_->pacing_duration += (n);} while (0)
+#define net_stats_housekeeping(n) do {stats_->housekeeping_duration += (n);} while (0)
+#else
+#define net_stats_pacing(n) do { /* do nothing */ } while (0)
+#define net_stats_housekeeping(n) do { /* do nothing */ } while (0)
+#endif
 
 static inline void net_stats_init(struct net_stats *stats) {
+    Histogram *hists = stats->hists;
     *stats = {};
+#if PERF_STATS_HIST == 1
+    stats->hists = (hists != nullptr) ? hists : new Histogram[kStageHistNum];
+    for (size_t i = 0; i < kStageHistNum; i++) stats->hists[i].reset();
+#else
+    stats->hists = hists;
+#endif
     stats->app_tx_min_duration = std::numeric_limits<uint64_t>::max();
     stats->app_rx_min_duration = std::numeric_limits<uint64_t>::max();
     stats->app_tx_stall_min_duration = std::numeric_limits<uint64_t>::max();
@@ -7,24 +7,10 @@
 #include "util/numautils.h"
 #include <iostream>
 #include <fstream>
-#include <sys/stat.h>
+#include <cmath>
 
 namespace dperf {
 
-void wait_duration(size_t wait_sec){
-  auto start = std::chrono::high_resolution_clock::now();  // 记录开始时间
-
-  while (true) {
-      auto current = std::chrono::high_resolution_clock::now();  // 获取当前时间
-      auto duration = std::chrono::duration_cast<std::chrono::seconds>(current - start);  // 计算经过的时间
-      size_t sec = duration.count();
-
-      if (sec >= wait_sec) {
-          break;  // 如果经过的时间达到1秒，则退出循环
-      }
-  }
-}
-
 size_t num_lcores_per_numa_node() {
   return static_cast<size_t>(numa_num_configured_cpus() /
                              numa_num_configured_nodes());
@@ -179,66 +165,88 @@ bool is_cpu_freq_max(size_t core_idx) {
   return get_cpu_freq_ghz(core_idx) == get_cpu_freq_max_ghz(core_idx);
 }
 
-bool pathExists(const std::string& path) {
-  struct stat buffer;
-  return (stat(path.c_str(), &buffer) == 0);
-}
-
-void set_cpu_freq_max(size_t core_idx) {
-  std::string cpuPath = "/sys/devices/system/cpu/cpu0/cpufreq";
-  if (pathExists(cpuPath)) {
-    std::string cmd = "sudo cpufreq-set -c" + std::to_string(core_idx) + " -g performance";
-    int res = system(cmd.c_str());
-    wait_duration(2);
-    // std::string cmd = "sudo cpufreq-set -c " + std::to_string(core_idx) + " -g userspace";
-    // int res = system(cmd.c_str());
-    // wait_duration(2);
-    // cmd = "sudo cpufreq-set -c " + std::to_string(core_idx) + " -f 2000000";
-    // res = system(cmd.c_str());
-    // wait_duration(2);
-    // int target_freq = get_cpu_freq_max_hz(core_idx);
-    // double max_fluc = 0.2; // the max fluctuation is +- 0.2GHz
-    // uint8_t retry_time = 0;
-    // while (true) {
-    //   printf("[Core %lu] Try to set cpu freq to %u\n", core_idx, target_freq);
-    //   if (target_freq <= 0) {
-    //     DPERF_ERROR("Cannot set CPU frequency to a stable state, please check your bios or grub setting~\n");
-    //     std::runtime_error("dPerf: Set CPU frequency error");
-    //   }
-    //   cmd = "sudo cpufreq-set -c " + std::to_string(core_idx) + " -f " + std::to_string(target_freq);
-    //   res = system(cmd.c_str());
-    //   wait_duration(2);
-    //   double cur_freq = get_cpu_freq_ghz(core_idx);
-    //   double tar_g_greq = (double)target_freq / 1000.0 / 1000.0;
-    //   if (cur_freq > tar_g_greq || std::abs(cur_freq - tar_g_greq) <= max_fluc) {
-    //     break;
-    //   }
-    //   else {
-    //     retry_time++;
-    //     if (retry_time == 3) {
-    //       target_freq -= 100000;  // -= 0.1GHz
-    //       retry_time = 0;
-    //     }
-    //   }
-    // }
+/// Read the first line of a sysfs file, empty if it cannot be read
+static std::string read_sysfs(const std::string &path) {
+  std::ifstream file(path);
+  std::string line;
+  if (file.is_open()) std::getline(file, line);
+  return line;
+}
+
+/// Write a sysfs file, false if the kernel rejected it
+static bool write_sysfs(const std::string &path, const std::string &value) {
+  std::ofstream file(path);
+  if (!file.is_open()) return false;
+  file << value;
+  file.flush();
+  return file.good();
+}
+
+/// Write the policy of one core, min after max if raising, the kernel rejects min > max
+static bool write_cpu_freq(const cpufreq_state &state) {
+  std::string cpufreq = "/sys/devices/system/cpu/cpu" + std::to_string(state.core_idx_) + "/cpufreq/";
+  bool ok = write_sysfs(cpufreq + "scaling_governor", state.governor_);
+  /// an unreadable file (core offline, no permission) fails the write as a whole
+  std::string cur_min_freq = read_sysfs(cpufreq + "scaling_min_freq");
+  if (cur_min_freq.empty() || state.min_freq_.empty()) return false;
+  bool raise = std::stoul(state.min_freq_) >= std::stoul(cur_min_freq);
+  if (raise) {
+    ok &= write_sysfs(cpufreq + "scaling_max_freq", state.max_freq_);
+    ok &= write_sysfs(cpufreq + "scaling_min_freq", state.min_freq_);
   } else {
-      DPERF_WARN("Cannot leverage cpufreq-set to set CPU frequency to max, try to warm up.\n");
-      const int iterations = 10000000;
-      double result = 0.0;
-      for (int i = 0; i < iterations; ++i) {
-          result += std::sin(i) * std::cos(i);
-      }
+    ok &= write_sysfs(cpufreq + "scaling_min_freq", state.min_freq_);
+    ok &= write_sysfs(cpufreq + "scaling_max_freq", state.max_freq_);
   }
+  return ok;
 }
 
-void set_cpu_freq_normal(size_t core_idx) {
-  std::string cpuPath = "/sys/devices/system/cpu/cpu0/cpufreq";
-  if (pathExists(cpuPath)) {
-    std::string cmd = "sudo cpufreq-set -c" + std::to_string(core_idx) + " -g ondemand";
-    int res = system(cmd.c_str());
+/// Apply \p states to their cores, one thread per core, as a governor change can take milliseconds
+static bool write_cpu_freq(const std::vector<cpufreq_state> &states) {
+  std::vector<std::thread> threads;
+  std::vector<char> ok(states.size(), 0);
+  for (size_t i = 0; i < states.size(); i++) {
+    threads.emplace_back([&, i]() { ok[i] = write_cpu_freq(states[i]); });
   }
-  else {
-    DPERF_WARN("Cannot leverage cpufreq-set to set CPU frequency to normal, skip.\n");
+  for (auto &thread : threads) thread.join();
+  for (auto &res : ok) {
+    if (!res) return false;
+  }
+  return true;
+}
+
+std::vector<cpufreq_state> set_cpu_freq_max(const std::vector<size_t> &cores) {
+  std::vector<cpufreq_state> prev, target;
+  for (auto &core_idx : cores) {
+    std::string cpufreq = "/sys/devices/system/cpu/cpu" + std::to_string(core_idx) + "/cpufreq/";
+    cpufreq_state state = {core_idx, read_sysfs(cpufreq + "scaling_governor"),
+                           read_sysfs(cpufreq + "scaling_min_freq"), read_sysfs(cpufreq + "scaling_max_freq")};
+    std::string max_freq = read_sysfs(cpufreq + "cpuinfo_max_freq");
+    if (state.governor_.empty() || state.min_freq_.empty() || max_freq.empty()) {
+      DPERF_WARN("Core %lu has no cpufreq in sysfs, CPU frequency is not set\n", core_idx);
+      return {};
+    }
+    prev.push_back(state);
+    target.push_back({core_idx, "performance", max_freq, max_freq});
+  }
+  if (!write_cpu_freq(target)) {
+    DPERF_WARN("Cannot write cpufreq in sysfs (needs root), CPU frequency is not set\n");
+    write_cpu_freq(prev);
+    return {};
+  }
+  return prev;
+}
+
+void restore_cpu_freq(const std::vector<cpufreq_state> &states) {
+  if (!write_cpu_freq(states)) {
+    DPERF_WARN("Failed to restore the cpufreq policy of some cores\n");
+  }
+}
+
+void warm_up_cpu() {
+  const int iterations = 10000000;
+  volatile double result = 0.0;
+  for (int i = 0; i < iterations; ++i) {
+    result += std::sin(i) * std::cos(i);
   }
 }
 
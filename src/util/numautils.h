@@ -1,4 +1,5 @@
 #pragma once
+#include <string>
 #include <vector>
 #include <stdlib.h>
 #include <thread>
@@ -22,7 +23,21 @@ void clear_affinity_for_process();
 size_t get_global_index(size_t numa_node, size_t numa_local_index);
 double get_cpu_freq_ghz(size_t core_idx);
 bool is_cpu_freq_max(size_t core_idx);
-void set_cpu_freq_max(size_t core_idx);
-void set_cpu_freq_normal(size_t core_idx);
+
+/// cpufreq policy of a core, the values of its sysfs files
+struct cpufreq_state {
+  size_t core_idx_;
+  std::string governor_;
+  std::string min_freq_;    // kHz
+  std::string max_freq_;    // kHz
+};
+
+/// Pin \p cores to their max frequency with the performance governor, through
+/// sysfs and in parallel. Return the previous policies to restore, empty if
+/// cpufreq is unavailable or not writable
+std::vector<cpufreq_state> set_cpu_freq_max(const std::vector<size_t> &cores);
+void restore_cpu_freq(const std::vector<cpufreq_state> &states);
+/// Ramp up the calling core with some work, without cpufreq
+void warm_up_cpu();
 
 }  // namespace dperf
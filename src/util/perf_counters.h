@@ -0,0 +1,133 @@
+/**
+ * @file perf_counters.h
+ * @brief Hardware performance counters of the calling thread (PERF_HW_COUNTERS)
+ */
+#pragma once
+
+#include "common.h"
+#include "util/logger.h"
+#include <linux/perf_event.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace dperf {
+
+enum hw_event_t : uint8_t {
+  kHwCycles = 0,
+  kHwInstructions,
+  kHwLlcLoads,
+  kHwLlcMisses,
+  kHwDtlbMisses,
+  kHwBranchMisses,
+  kHwEventNum
+};
+
+static const char *const kHwEventName[kHwEventNum] = {
+  "cycles", "instructions", "llc_loads", "llc_misses", "dtlb_misses", "branch_misses",
+};
+
+/**
+ * A group of counters opened by a workspace thread on itself, so that they
+ * count only this thread, on whichever core it runs.
+ *
+ * read() uses RDPMC from user space when the kernel allows it (see
+ * /sys/bus/event_source/devices/cpu/rdpmc), tens of cycles per counter, and
+ * falls back to a read() syscall of the group otherwise. Events the PMU does
+ * not have, e.g., LLC events in most VMs, are skipped and read as 0.
+ */
+class PerfCounters {
+ public:
+  PerfCounters() {
+    static const std::pair<uint32_t, uint64_t> kEvents[kHwEventNum] = {
+      {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+      {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+      {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_LL | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_ACCESS << 16)},
+      {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_LL | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+      {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+      {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+    };
+    for (size_t i = 0; i < kHwEventNum; i++) {
+      struct perf_event_attr attr;
+      memset(&attr, 0, sizeof(attr));
+      attr.size = sizeof(attr);
+      attr.type = kEvents[i].first;
+      attr.config = kEvents[i].second;
+      attr.exclude_kernel = 1;
+      attr.exclude_hv = 1;
+      attr.read_format = PERF_FORMAT_GROUP;
+      int group_fd = (i == kHwCycles) ? -1 : fd_[kHwCycles];
+      fd_[i] = syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, 0);
+      if (fd_[i] < 0) {
+        if (i == kHwCycles) {
+          DPERF_WARN("Failed to open hardware counters, check /proc/sys/kernel/perf_event_paranoid\n");
+          return;
+        }
+        continue;
+      }
+      slot_[event_num_++] = i;
+      void *page = mmap(nullptr, sysconf(_SC_PAGESIZE), PROT_READ, MAP_SHARED, fd_[i], 0);
+      page_[i] = (page == MAP_FAILED) ? nullptr : static_cast<struct perf_event_mmap_page *>(page);
+    }
+    rdpmc_ = true;
+    for (size_t i = 0; i < kHwEventNum; i++) {
+      if (fd_[i] >= 0 && (page_[i] == nullptr || !page_[i]->cap_user_rdpmc)) rdpmc_ = false;
+    }
+  }
+
+  ~PerfCounters() {
+    for (size_t i = 0; i < kHwEventNum; i++) {
+      if (page_[i] != nullptr) munmap(page_[i], sysconf(_SC_PAGESIZE));
+      if (fd_[i] >= 0) close(fd_[i]);
+    }
+  }
+
+  inline bool enabled() const { return fd_[kHwCycles] >= 0; }
+  inline bool use_rdpmc() const { return rdpmc_; }
+
+  /// Read the current values of all counters into \p values
+  inline void read(uint64_t *values) {
+    if (likely(rdpmc_)) {
+      for (size_t i = 0; i < kHwEventNum; i++) values[i] = (fd_[i] >= 0) ? read_rdpmc(page_[i]) : 0;
+      return;
+    }
+    uint64_t buf[1 + kHwEventNum] = {0};
+    if (!enabled() || ::read(fd_[kHwCycles], buf, sizeof(buf)) <= 0) {
+      for (size_t i = 0; i < kHwEventNum; i++) values[i] = 0;
+      return;
+    }
+    /// the group is read in the order the events were opened
+    for (size_t i = 0; i < kHwEventNum; i++) values[i] = 0;
+    for (size_t i = 0; i < event_num_; i++) values[slot_[i]] = buf[1 + i];
+  }
+
+ private:
+  static inline uint64_t read_rdpmc(volatile struct perf_event_mmap_page *pc) {
+    uint32_t seq, idx;
+    uint64_t count;
+    do {
+      seq = pc->lock;
+      asm volatile("" ::: "memory");
+      idx = pc->index;
+      count = pc->offset;
+      if (likely(idx != 0)) {
+        uint32_t lo, hi;
+        asm volatile("rdpmc" : "=a"(lo), "=d"(hi) : "c"(idx - 1));
+        uint64_t pmc = (static_cast<uint64_t>(hi) << 32) | lo;
+        /// sign extend the counter width, the offset makes up for the wraps
+        pmc <<= 64 - pc->pmc_width;
+        count += static_cast<int64_t>(pmc) >> (64 - pc->pmc_width);
+      }
+      asm volatile("" ::: "memory");
+    } while (pc->lock != seq);
+    return count;
+  }
+
+  int fd_[kHwEventNum] = {-1, -1, -1, -1, -1, -1};
+  struct perf_event_mmap_page *page_[kHwEventNum] = {nullptr};
+  uint8_t slot_[kHwEventNum] = {0};     // event of each value in the group read
+  size_t event_num_ = 0;
+  bool rdpmc_ = false;
+};
+
+}  // namespace dperf
@@ -0,0 +1,155 @@
+/**
+ * @file reassembly_table.h
+ * @brief A bounded table that reassembles multi-packet messages
+ */
+#pragma once
+
+#include "common.h"
+#include <string.h>
+
+namespace dperf {
+
+/**
+ * Reassembles the segments of multi-packet messages that may arrive interleaved
+ * with the segments of other messages, e.g., from several clients.
+ *
+ * The table has kSlotNum slots of at most kMaxSegs segment pointers each, and a
+ * message probes up to kMaxProbe slots from the hash of its key. A complete
+ * message is handed out as its segment pointers in segment order, the
+ * packets themselves are never copied. Segments of a message that cannot
+ * complete are freed by expire() after a timeout, or when a probe finds no
+ * free slot and evicts the oldest message in its way.
+ *
+ * @tparam T The mbuf type of the dispatcher
+ * @tparam kMaxSegs The maximum number of segments in a message
+ */
+template <class T, size_t kMaxSegs>
+class ReassemblyTable {
+ public:
+  static constexpr size_t kSlotNum = 256;
+  static constexpr size_t kMaxProbe = 4;
+  static_assert((kSlotNum & (kSlotNum - 1)) == 0, "kSlotNum must be a power of two");
+
+  struct reasm_stats {
+    size_t msg_num_ = 0;        ///< Messages completed
+    size_t expired_ = 0;        ///< Incomplete messages freed by expire()
+    size_t evicted_ = 0;        ///< Incomplete messages freed to make room
+    size_t dup_segs_ = 0;       ///< Duplicate segments dropped
+    size_t invalid_segs_ = 0;   ///< Segments with a bad index or count dropped
+  };
+
+  ReassemblyTable() { memset(slots_, 0, sizeof(slots_)); }
+
+  /**
+   * @brief Add a segment to its message
+   * @param pkt The segment
+   * @param key Identifies the message among all senders
+   * @param seg_idx Index of the segment in its message
+   * @param seg_num Number of segments in the message
+   * @param now_tsc The current TSC
+   * @param segs Receives the segments of the message if it is complete
+   * @param free_fn Called with (T **pkts, size_t num) to free dropped segments
+   * @return true if \p pkt completes its message
+   */
+  template <class FreeFn>
+  inline bool insert(T *pkt, uint64_t key, uint8_t seg_idx, uint8_t seg_num,
+                     size_t now_tsc, T **segs, FreeFn free_fn) {
+    if (unlikely(seg_num == 0 || seg_num > kMaxSegs || seg_idx >= seg_num)) {
+      stats_.invalid_segs_++;
+      free_fn(&pkt, 1);
+      return false;
+    }
+    slot *s = lookup(key, free_fn);
+    if (s->seg_num_ == 0) {
+      s->key_ = key;
+      s->seg_num_ = seg_num;
+      s->recv_num_ = 0;
+      s->first_tsc_ = now_tsc;
+    }
+    if (unlikely(s->seg_num_ != seg_num || s->segs_[seg_idx] != nullptr)) {
+      seg_num == s->seg_num_ ? stats_.dup_segs_++ : stats_.invalid_segs_++;
+      free_fn(&pkt, 1);
+      return false;
+    }
+    s->segs_[seg_idx] = pkt;
+    if (++s->recv_num_ < seg_num) return false;
+
+    memcpy(segs, s->segs_, seg_num * sizeof(T *));
+    clear(s);
+    stats_.msg_num_++;
+    return true;
+  }
+
+  /// Free the messages that started more than \p timeout_tsc ago
+  template <class FreeFn>
+  void expire(size_t now_tsc, size_t timeout_tsc, FreeFn free_fn) {
+    for (size_t i = 0; i < kSlotNum; i++) {
+      slot *s = &slots_[i];
+      if (s->seg_num_ != 0 && now_tsc - s->first_tsc_ > timeout_tsc) {
+        drop(s, free_fn);
+        stats_.expired_++;
+      }
+    }
+  }
+
+  /// Return the number of messages being reassembled
+  size_t get_pending() const {
+    size_t pending = 0;
+    for (size_t i = 0; i < kSlotNum; i++) pending += (slots_[i].seg_num_ != 0);
+    return pending;
+  }
+
+  inline const reasm_stats &get_stats() const { return stats_; }
+  inline void reset_stats() { stats_ = reasm_stats(); }
+
+ private:
+  struct slot {
+    uint64_t key_;
+    uint8_t seg_num_;       ///< 0 if the slot is free
+    uint8_t recv_num_;
+    size_t first_tsc_;      ///< Arrival of the first segment
+    T *segs_[kMaxSegs];
+  };
+
+  /// Find the slot of \p key, or a free slot, evicting the oldest message if none
+  template <class FreeFn>
+  inline slot *lookup(uint64_t key, FreeFn free_fn) {
+    size_t idx = hash(key);
+    slot *free_slot = nullptr, *oldest = nullptr;
+    for (size_t i = 0; i < kMaxProbe; i++) {
+      slot *s = &slots_[(idx + i) & (kSlotNum - 1)];
+      if (s->seg_num_ == 0) {
+        if (free_slot == nullptr) free_slot = s;
+        continue;
+      }
+      if (s->key_ == key) return s;
+      if (oldest == nullptr || s->first_tsc_ < oldest->first_tsc_) oldest = s;
+    }
+    if (free_slot != nullptr) return free_slot;
+    drop(oldest, free_fn);
+    stats_.evicted_++;
+    return oldest;
+  }
+
+  template <class FreeFn>
+  inline void drop(slot *s, FreeFn free_fn) {
+    for (size_t i = 0; i < s->seg_num_; i++) {
+      if (s->segs_[i] != nullptr) free_fn(&s->segs_[i], 1);
+    }
+    clear(s);
+  }
+
+  inline void clear(slot *s) {
+    memset(s->segs_, 0, s->seg_num_ * sizeof(T *));
+    s->seg_num_ = 0;
+  }
+
+  static inline size_t hash(uint64_t key) {
+    return (key * 0x9E3779B97F4A7C15ull) >> (64 - __builtin_ctzll(kSlotNum));
+  }
+
+  slot slots_[kSlotNum];
+  reasm_stats stats_;
+};
+
+}  // namespace dperf
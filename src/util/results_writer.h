@@ -0,0 +1,152 @@
+/**
+ * @file results_writer.h
+ * @brief Per-iteration result file in JSON lines or CSV
+ */
+#pragma once
+
+#include "common.h"
+#include "util/net_stats.h"
+#include <cmath>
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace dperf {
+
+/**
+ * Writes one record per iteration with every field of perf_stats, the counters
+ * of each workload and the net_stats of each workspace, so that tools read
+ * exact numbers instead of scraping the printed tables.
+ *
+ * The format follows the extension of the path:
+ *  - .csv: long format, one "iteration,scope,id,workload,metric,value" row per
+ *    number, where scope is perf, workload or ws. New fields add rows, never
+ *    columns, so readers keep working across versions.
+ *  - otherwise JSON lines, one object per iteration, e.g.,
+ *    {"iteration": 0, "duration": 1, "perf": {...}, "workloads": {"0": {...}},
+ *     "workspaces": [{"ws_id": 0, "ws_type": 3, "workload": 0, "freq_ghz": 2.1, "stats": {...}}]}
+ */
+class ResultsWriter {
+ public:
+  /// A workspace at the end of an iteration
+  struct ws_result {
+    uint8_t ws_id_;
+    uint8_t ws_type_;
+    uint8_t workload_type_;
+    double freq_ghz_;
+    const net_stats *stats_;
+  };
+
+  explicit ResultsWriter(const std::string &path) : path_(path) {
+    csv_ = path.size() >= 4 && path.compare(path.size() - 4, 4, ".csv") == 0;
+    out_.open(path, std::ios::out | std::ios::trunc);
+    rt_assert(out_.is_open(), "Failed to open the result file " + path);
+    out_.precision(17);
+    if (csv_) out_ << "iteration,scope,id,workload,metric,value\n";
+  }
+
+  /// Call it after print_perf_stats(), which fills the e2e fields
+  void write(size_t iteration, uint8_t duration, const perf_stats &perf, const std::vector<ws_result> &ws) {
+    /// per workload counters, summed over its app workspaces
+    std::map<uint8_t, workload_result> workloads;
+    for (auto &r : ws) {
+      if (!(r.ws_type_ & WORKER)) continue;
+      workload_result &w = workloads[r.workload_type_];
+      w.ws_num_++;
+      w.app_tx_msg_num_ += r.stats_->app_tx_msg_num;
+      w.app_rx_msg_num_ += r.stats_->app_rx_msg_num;
+      w.app_tx_late_num_ += r.stats_->app_tx_late_num;
+      w.app_enqueue_drops_ += r.stats_->app_enqueue_drops;
+      w.app_stolen_msg_num_ += r.stats_->app_stolen_msg_num;
+    }
+    if (csv_) write_csv(iteration, duration, perf, workloads, ws);
+    else write_json(iteration, duration, perf, workloads, ws);
+    out_.flush();
+  }
+
+ private:
+  struct workload_result {
+    size_t ws_num_ = 0;
+    uint64_t app_tx_msg_num_ = 0;
+    uint64_t app_rx_msg_num_ = 0;
+    uint64_t app_tx_late_num_ = 0;
+    uint64_t app_enqueue_drops_ = 0;
+    uint64_t app_stolen_msg_num_ = 0;
+  };
+
+  /// JSON has no inf or nan
+  static double finite(double v) { return std::isfinite(v) ? v : 0.0; }
+
+  void write_json(size_t iteration, uint8_t duration, const perf_stats &perf,
+                  const std::map<uint8_t, workload_result> &workloads, const std::vector<ws_result> &ws) {
+    const char *sep = "";
+    out_ << "{\"iteration\": " << iteration << ", \"duration\": " << unsigned(duration) << ", \"perf\": {";
+    #define __PERF_FIELD(f) out_ << sep << "\"" #f "\": " << finite(perf.f); sep = ", ";
+    PERF_STATS_FIELDS(__PERF_FIELD)
+    #undef __PERF_FIELD
+    out_ << "}, \"workloads\": {";
+    sep = "";
+    for (auto &w : workloads) {
+      out_ << sep << "\"" << unsigned(w.first) << "\": {\"ws_num\": " << w.second.ws_num_
+           << ", \"app_tx_mpps\": " << w.second.app_tx_msg_num_ / (duration * 1e6)
+           << ", \"app_rx_mpps\": " << w.second.app_rx_msg_num_ / (duration * 1e6)
+           << ", \"app_tx_msg_num\": " << w.second.app_tx_msg_num_
+           << ", \"app_rx_msg_num\": " << w.second.app_rx_msg_num_
+           << ", \"app_tx_late_num\": " << w.second.app_tx_late_num_
+           << ", \"app_enqueue_drops\": " << w.second.app_enqueue_drops_
+           << ", \"app_stolen_msg_num\": " << w.second.app_stolen_msg_num_ << "}";
+      sep = ", ";
+    }
+    out_ << "}, \"workspaces\": [";
+    const char *ws_sep = "";
+    for (auto &r : ws) {
+      out_ << ws_sep << "{\"ws_id\": " << unsigned(r.ws_id_) << ", \"ws_type\": " << unsigned(r.ws_type_)
+           << ", \"workload\": " << unsigned(r.workload_type_) << ", \"freq_ghz\": " << finite(r.freq_ghz_)
+           << ", \"stats\": {";
+      sep = "";
+      #define __NET_FIELD(f) out_ << sep << "\"" #f "\": " << finite(r.stats_->f); sep = ", ";
+      NET_STATS_FIELDS(__NET_FIELD)
+      #undef __NET_FIELD
+      out_ << "}}";
+      ws_sep = ", ";
+    }
+    out_ << "]}\n";
+  }
+
+  void write_csv(size_t iteration, uint8_t duration, const perf_stats &perf,
+                 const std::map<uint8_t, workload_result> &workloads, const std::vector<ws_result> &ws) {
+    auto __row = [&](const char *scope, const std::string &id, const std::string &workload, const char *metric, double value) {
+      out_ << iteration << "," << scope << "," << id << "," << workload << "," << metric << "," << finite(value) << "\n";
+    };
+    __row("perf", "", "", "duration", duration);
+    #define __PERF_FIELD(f) __row("perf", "", "", #f, perf.f);
+    PERF_STATS_FIELDS(__PERF_FIELD)
+    #undef __PERF_FIELD
+    for (auto &w : workloads) {
+      std::string id = std::to_string(w.first);
+      __row("workload", id, id, "ws_num", w.second.ws_num_);
+      __row("workload", id, id, "app_tx_mpps", w.second.app_tx_msg_num_ / (duration * 1e6));
+      __row("workload", id, id, "app_rx_mpps", w.second.app_rx_msg_num_ / (duration * 1e6));
+      __row("workload", id, id, "app_tx_msg_num", w.second.app_tx_msg_num_);
+      __row("workload", id, id, "app_rx_msg_num", w.second.app_rx_msg_num_);
+      __row("workload", id, id, "app_tx_late_num", w.second.app_tx_late_num_);
+      __row("workload", id, id, "app_enqueue_drops", w.second.app_enqueue_drops_);
+      __row("workload", id, id, "app_stolen_msg_num", w.second.app_stolen_msg_num_);
+    }
+    for (auto &r : ws) {
+      std::string id = std::to_string(r.ws_id_), workload = std::to_string(r.workload_type_);
+      __row("ws", id, workload, "ws_type", r.ws_type_);
+      __row("ws", id, workload, "freq_ghz", r.freq_ghz_);
+      #define __NET_FIELD(f) __row("ws", id, workload, #f, r.stats_->f);
+      NET_STATS_FIELDS(__NET_FIELD)
+      #undef __NET_FIELD
+    }
+  }
+
+  std::string path_;
+  bool csv_ = false;
+  std::ofstream out_;
+};
+
+}  // namespace dperf
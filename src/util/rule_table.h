@@ -1,59 +1,200 @@
 #pragma once
 
 #include "common.h"
+#include "util/lock_free_queue.h"
+#include "util/rand.h"
 #include <vector>
-#include <unordered_map>
 #include <algorithm>
 namespace dperf {
 
+/// Selection policies of a rule, i.e., how a workload spreads over its destinations
+#define kSelectRR         0   // round-robin
+#define kSelectWRR        1   // weighted round-robin
+#define kSelectFlowHash   2   // the same flow always goes to the same destination
+#define kSelectP2C        3   // the shorter queue of two random destinations
+#define kSelectJSQ        4   // the shortest queue of all destinations
+
+static inline const char *select_policy_name(uint8_t policy) {
+  static const char *names[] = {"round-robin", "weighted round-robin", "flow hash", "power of two choices", "join shortest queue"};
+  return names[policy];
+}
+
+/**
+ * Routes of each workload type to its destination workspaces, e.g., the app
+ * workspaces of a dispatcher (RX), or the remote dispatchers of a worker (TX).
+ *
+ * The table is a flat array indexed by the workload type, so a lookup is a
+ * single indexed load. Each rule keeps its destinations and, for weighted
+ * round-robin, an interleaved sequence of them that is rebuilt whenever the
+ * routes or weights change, never on the datapath.
+ *
+ * Load-aware policies (kSelectP2C, kSelectJSQ) compare the queue depths of a
+ * snapshot taken once per burst by snapshot_depths(). Each selection adds one
+ * to the depth of the chosen queue, so a burst is not dumped on the queue that
+ * was shortest at its start, and the queues are not read for every packet.
+ */
 struct RuleTable {
-  // map from workload type to the corresponding destination workspace id
-  std::unordered_map<uint8_t, std::vector<uint8_t>> table;
+  static constexpr size_t kMaxRuleNum = UINT8_MAX + 1;
+  static constexpr size_t kWrrSeqLen = 64;      // max sum of the weights of a rule
+
+  struct alignas(64) rule_entry {
+    uint8_t ws_ids_[kWorkspaceMaxNum];      // destinations
+    uint8_t weights_[kInvalidWsId];         // WRR weight of each destination, by ws id
+    uint8_t wrr_seq_[kWrrSeqLen];           // WRR destinations, interleaved by weight
+    uint8_t ws_num_ = 0;
+    uint8_t wrr_len_ = 0;
+    uint8_t policy_ = kSelectRR;
+    size_t cursor_ = 0;
+  };
 
-  // budget for issuing infly message of each workload
-  std::unordered_map<uint8_t, uint64_t> infly_budget;
+  struct rule_stats {
+    size_t msg_num_ = 0;      // messages dispatched
+    size_t drops_ = 0;        // messages dropped at a full destination queue
+  };
+
+  RuleTable() {
+    for (auto &rule : table) memset(rule.weights_, 1, sizeof(rule.weights_));
+  }
 
   void add_route(uint8_t type, uint8_t ws_id) {
-      table[type].push_back(ws_id);
+      rule_entry &rule = table[type];
+      rt_assert(ws_id < kInvalidWsId, "Invalid workspace id");
+      rt_assert(rule.ws_num_ < kWorkspaceMaxNum, "Too many routes of a workload");
+      rule.ws_ids_[rule.ws_num_++] = ws_id;
+      build_wrr(rule);
+  }
 
-      if(infly_budget.count(type) == 0){
-        infly_budget[type] = kInflyMessageBudget;
+  void remove_route(uint8_t type, uint8_t ws_id) {
+      rule_entry &rule = table[type];
+      auto end = rule.ws_ids_ + rule.ws_num_;
+      auto it = std::find(rule.ws_ids_, end, ws_id);
+      if (it != end) {
+        std::copy(it + 1, end, it);
+        rule.ws_num_--;
+        build_wrr(rule);
       }
   }
 
-  bool apply_infly_budget(uint8_t type, uint64_t apply_size){
-    bool has_budget = infly_budget[type] >= apply_size;
-    if(unlikely(has_budget)){
-      infly_budget[type] -= apply_size;
-    }
-    return has_budget;
+  std::vector<uint8_t> get_ws_ids(uint8_t type) {
+      rule_entry &rule = table[type];
+      return std::vector<uint8_t>(rule.ws_ids_, rule.ws_ids_ + rule.ws_num_);
   }
 
-  uint64_t get_infly_budget(uint8_t type){
-    return infly_budget[type];
+  void set_policy(uint8_t type, uint8_t policy) {
+      rt_assert(policy <= kSelectJSQ, "Invalid selection policy");
+      table[type].policy_ = policy;
+      load_aware_ |= (policy == kSelectP2C || policy == kSelectJSQ);
   }
 
-  inline void return_infly_budget(uint8_t type, uint64_t return_size = 1){
-    infly_budget[type] += return_size;
+  uint8_t get_policy(uint8_t type) {
+      return table[type].policy_;
   }
 
-  void remove_route(uint8_t type, uint8_t ws_id) {
-      auto& ws_ids = table[type];
-      auto it = std::find(ws_ids.begin(), ws_ids.end(), ws_id);
-      if (it != ws_ids.end()) {
-        ws_ids.erase(it);
+  /// set the WRR weight of a destination, 0 to only reach it through other policies
+  void set_weight(uint8_t type, uint8_t ws_id, uint8_t weight) {
+      rt_assert(ws_id < kInvalidWsId, "Invalid workspace id");
+      table[type].weights_[ws_id] = weight;
+      build_wrr(table[type]);
+  }
+
+  /// the queue whose depth power-of-two choices compares for a destination
+  void set_queue(uint8_t ws_id, lock_free_queue *queue) {
+      rt_assert(ws_id < kInvalidWsId, "Invalid workspace id");
+      if (queues_[ws_id] == nullptr) queue_ids_.push_back(ws_id);
+      queues_[ws_id] = queue;
+  }
+
+  /// take the queue depths that load-aware policies compare during a burst
+  inline void snapshot_depths() {
+      if (!load_aware_) return;
+      for (auto &ws_id : queue_ids_) depths_[ws_id] = queues_[ws_id]->get_size();
+  }
+
+  /**
+   * @brief Select a destination by the policy of the rule
+   * @param flow_hash Hash of the flow key, only used by kSelectFlowHash
+   */
+  inline uint8_t select(uint8_t type, uint32_t flow_hash) {
+      rule_entry &rule = table[type];
+      switch (rule.policy_) {
+        case kSelectWRR:
+          return rule.wrr_seq_[rule.cursor_++ % rule.wrr_len_];
+        case kSelectFlowHash:
+          return rule.ws_ids_[flow_hash % rule.ws_num_];
+        case kSelectP2C: {
+          uint32_t r = rand_.next_u32();
+          uint8_t a = rule.ws_ids_[(r & 0xffff) % rule.ws_num_];
+          uint8_t b = rule.ws_ids_[(r >> 16) % rule.ws_num_];
+          uint8_t chosen = depths_[b] < depths_[a] ? b : a;
+          depths_[chosen]++;
+          return chosen;
+        }
+        case kSelectJSQ: {
+          uint8_t chosen = rule.ws_ids_[0];
+          for (size_t i = 1; i < rule.ws_num_; i++) {
+            if (depths_[rule.ws_ids_[i]] < depths_[chosen]) chosen = rule.ws_ids_[i];
+          }
+          depths_[chosen]++;
+          return chosen;
+        }
+        default:
+          break;
       }
+      return rule.ws_ids_[rule.cursor_++ % rule.ws_num_];
   }
 
-  std::vector<uint8_t> get_ws_ids(uint8_t type) {
-      return table[type];
+  inline uint8_t rr_select(uint8_t type) {
+      rule_entry &rule = table[type];
+      return rule.ws_ids_[rule.cursor_++ % rule.ws_num_];
+  }
+  /// select by a hash, e.g., to keep the packets of a message together
+  inline uint8_t hash_select(uint8_t type, uint32_t hash) {
+      rule_entry &rule = table[type];
+      return rule.ws_ids_[hash % rule.ws_num_];
   }
 
-  uint8_t rr_select(uint8_t type) {
-      auto& ws_ids = table[type];
-      return ws_ids[select_idx++ % ws_ids.size()];
+  /// count a message of \p type that was dispatched, or dropped at a full queue
+  inline void count(uint8_t type, bool dropped) {
+      stats_[type].msg_num_ += !dropped;
+      stats_[type].drops_ += dropped;
+  }
+  inline const rule_stats &get_stats(uint8_t type) const { return stats_[type]; }
+  void reset_stats() {
+      for (auto &stats : stats_) stats = rule_stats();
   }
-  size_t select_idx = 0;
+
+ private:
+  /// Smooth weighted round-robin: each step picks the destination with the
+  /// largest accumulated weight, so heavy destinations are spread out
+  static void build_wrr(rule_entry &rule) {
+      size_t total = 0;
+      for (size_t i = 0; i < rule.ws_num_; i++) total += rule.weights_[rule.ws_ids_[i]];
+      rt_assert(total <= kWrrSeqLen, "Sum of the WRR weights of a workload is too large");
+      int current[kWorkspaceMaxNum] = {0};
+      rule.wrr_len_ = 0;
+      for (size_t n = 0; n < total; n++) {
+        size_t best = 0;
+        for (size_t i = 0; i < rule.ws_num_; i++) {
+          current[i] += rule.weights_[rule.ws_ids_[i]];
+          if (current[i] > current[best]) best = i;
+        }
+        current[best] -= static_cast<int>(total);
+        rule.wrr_seq_[rule.wrr_len_++] = rule.ws_ids_[best];
+      }
+      /// all weights are 0: fall back to plain round-robin
+      if (rule.wrr_len_ == 0) {
+        memcpy(rule.wrr_seq_, rule.ws_ids_, rule.ws_num_);
+        rule.wrr_len_ = rule.ws_num_;
+      }
+  }
+
+  rule_entry table[kMaxRuleNum];
+  lock_free_queue *queues_[kInvalidWsId] = {nullptr};
+  std::vector<uint8_t> queue_ids_;          // ws ids that have a queue
+  size_t depths_[kInvalidWsId] = {0};       // queue depths of the current burst
+  bool load_aware_ = false;                 // a rule compares queue depths
+  FastRand rand_;
+  rule_stats stats_[kMaxRuleNum];
 };
 
-} // namespace dperf
\ No newline at end of file
+} // namespace dperf
@@ -0,0 +1,52 @@
+/**
+ * @file seqlock.h
+ * @brief A single-writer sequence lock to publish a small struct
+ */
+#pragma once
+
+#include "common.h"
+#include <atomic>
+#include <immintrin.h>
+#include <type_traits>
+
+namespace dperf {
+
+/**
+ * The writer never waits: it makes the sequence odd, copies the value and makes
+ * it even again. A reader retries until it copied the value between two reads
+ * of the same even sequence, so it never sees a half-written value, and the
+ * writer, e.g., a workspace on the datapath, is not slowed down by readers.
+ */
+template <class T>
+class SeqLock {
+  static_assert(std::is_trivially_copyable<T>::value, "SeqLock needs a trivially copyable value");
+
+ public:
+  /// Only one thread may store
+  inline void store(const T &value) {
+    uint64_t seq = seq_.load(std::memory_order_relaxed);
+    seq_.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    value_ = value;
+    seq_.store(seq + 2, std::memory_order_release);
+  }
+
+  T load() const {
+    T value;
+    uint64_t seq0, seq1;
+    do {
+      seq0 = seq_.load(std::memory_order_acquire);
+      value = value_;
+      std::atomic_thread_fence(std::memory_order_acquire);
+      seq1 = seq_.load(std::memory_order_relaxed);
+      if (seq0 != seq1 || (seq0 & 1)) _mm_pause();
+    } while (seq0 != seq1 || (seq0 & 1));
+    return value;
+  }
+
+ private:
+  std::atomic<uint64_t> seq_{0};
+  T value_ = {};
+};
+
+}  // namespace dperf
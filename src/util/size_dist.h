@@ -0,0 +1,133 @@
+/**
+ * @file size_dist.h
+ * @brief Precomputed message size distributions for the client
+ */
+#pragma once
+
+#include "common.h"
+#include "util/rand.h"
+#include <cmath>
+#include <utility>
+#include <vector>
+
+namespace dperf {
+
+/// Message size distributions, sizes are application bytes after the ws_hdr
+#define kSizeBuiltin    0   // the compile-time size in common.h
+#define kSizeFixed      1   // params: size
+#define kSizeUniform    2   // params: min, max
+#define kSizeBimodal    3   // params: small, large, probability of large
+#define kSizeEmpirical  4   // cdf: (size, cumulative probability) points
+#define kSizeETC        5   // Facebook memcached ETC pool: GEV keys, GPD values
+#define kSizeUSR        6   // Facebook memcached USR pool: 16/21 B keys, 2 B values
+
+/// Power-of-two buckets that results are reported by: <= 64 B, <= 128 B, ..., > 16 KB
+#define kSizeBucketNum  10
+
+static inline uint8_t size_bucket(size_t size) {
+  if (size <= 64) return 0;
+  size_t bucket = 64 - __builtin_clzll(size - 1) - 6;   // ceil(log2(size)) - 6
+  return bucket < kSizeBucketNum ? bucket : kSizeBucketNum - 1;
+}
+
+static inline const char *size_bucket_name(uint8_t bucket) {
+  static const char *names[kSizeBucketNum] = {"<= 64 B", "<= 128 B", "<= 256 B", "<= 512 B",
+      "<= 1 KB", "<= 2 KB", "<= 4 KB", "<= 8 KB", "<= 16 KB", "> 16 KB"};
+  return names[bucket];
+}
+
+struct size_dist_spec {
+  uint8_t type_ = kSizeBuiltin;
+  std::vector<double> params_;
+  std::vector<std::pair<double, double>> cdf_;   // kSizeEmpirical, sorted by size
+};
+
+/**
+ * A message size distribution.
+ *
+ * Like ArrivalSchedule, sizes are drawn once at init and replayed cyclically,
+ * so the datapath only reads the next entry of a table.
+ *
+ * The ETC and USR presets follow the memcached workload analysis of Atikoglu
+ * et al. (SIGMETRICS'12). A request carries a key and a response carries a
+ * value, so \p is_resp selects the value distribution.
+ */
+class SizeDist {
+ public:
+  static constexpr size_t kTableLen = 65536;
+
+  /**
+   * @brief Precompute the sizes, each clamped to [min_size, max_size]
+   * @return The fraction of draws that were clamped
+   */
+  double init(const size_dist_spec &spec, bool is_resp, size_t min_size, size_t max_size) {
+    rt_assert(spec.type_ != kSizeBuiltin, "No size distribution to draw from");
+    rt_assert(min_size <= max_size && max_size <= UINT16_MAX, "Invalid message size range");
+    FastRand rand;
+    auto __uniform = [&rand]() { return (rand.next_u32() + 1.0) / 4294967297.0; };   // (0, 1)
+    size_t clamped = 0;
+    table_.clear();
+    for (size_t i = 0; i < kTableLen; i++) {
+      double size = 0;
+      double u = __uniform();
+      switch (spec.type_) {
+        case kSizeFixed:
+          size = spec.params_[0];
+          break;
+        case kSizeUniform:
+          size = std::floor(spec.params_[0] + u * (spec.params_[1] - spec.params_[0] + 1));
+          break;
+        case kSizeBimodal:
+          size = u < spec.params_[2] ? spec.params_[1] : spec.params_[0];
+          break;
+        case kSizeEmpirical:
+          size = inverse_cdf(spec.cdf_, u);
+          break;
+        case kSizeETC:
+          /// values: generalized Pareto(0, 214.476, 0.348238), keys: GEV(30.7984, 8.20449, 0.078688)
+          size = is_resp ? 214.476 * (std::pow(u, -0.348238) - 1) / 0.348238
+                         : 30.7984 + 8.20449 * (std::pow(-std::log(u), -0.078688) - 1) / 0.078688;
+          break;
+        case kSizeUSR:
+          size = is_resp ? 2 : (u < 0.5 ? 16 : 21);
+          break;
+        default:
+          rt_assert(false, "Invalid size distribution");
+      }
+      size_t s = size < 0 ? 0 : static_cast<size_t>(std::llround(size));
+      if (s < min_size || s > max_size) {
+        clamped++;
+        s = s < min_size ? min_size : max_size;
+      }
+      table_.push_back(static_cast<uint16_t>(s));
+    }
+    idx_ = 0;
+    return static_cast<double>(clamped) / kTableLen;
+  }
+
+  /// Return the size of the next message
+  inline size_t next() {
+    size_t size = table_[idx_];
+    idx_ = (idx_ + 1) & (kTableLen - 1);
+    return size;
+  }
+
+ private:
+  /// Linear interpolation between the points of an empirical CDF
+  static double inverse_cdf(const std::vector<std::pair<double, double>> &cdf, double u) {
+    if (u <= cdf.front().second) return cdf.front().first;
+    for (size_t i = 1; i < cdf.size(); i++) {
+      if (u <= cdf[i].second) {
+        double span = cdf[i].second - cdf[i - 1].second;
+        double frac = span > 0 ? (u - cdf[i - 1].second) / span : 1.0;
+        return cdf[i - 1].first + frac * (cdf[i].first - cdf[i - 1].first);
+      }
+    }
+    return cdf.back().first;
+  }
+
+  std::vector<uint16_t> table_;   ///< Precomputed sizes
+  size_t idx_ = 0;                ///< Next size to hand out
+};
+
+}  // namespace dperf
@@ -0,0 +1,91 @@
+/**
+ * @file stats_shm.h
+ * @brief Read-only shared memory segment with the live counters of all workspaces
+ */
+#pragma once
+
+#include "common.h"
+#include "util/logger.h"
+#include "util/net_stats.h"
+#include "util/seqlock.h"
+#include <new>
+#include <string>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace dperf {
+
+static constexpr uint64_t kStatsShmMagic = 0x5441545343495841;   // "AXIOSTAT"
+static constexpr uint32_t kStatsShmVersion = 1;
+
+/// The counters of all workspaces at one instant
+struct stats_snapshot {
+  uint64_t time_ns = 0;                       // CLOCK_MONOTONIC of the sample
+  stats_sample ws_[kWorkspaceMaxNum];
+};
+
+/**
+ * Layout of the segment, read by toolchain/axio_stat.py, keep both in sync.
+ * The header is written once, ws_num last, and the snapshot is replaced under a
+ * SeqLock every stats_interval, so a reader copies it and retries if the
+ * sequence was odd or changed.
+ */
+struct stats_shm_layout {
+  uint64_t magic_;
+  uint32_t version_;
+  uint32_t ws_num_;                           // 0 until the workspaces are registered
+  uint32_t interval_ms_;
+  uint32_t pid_;
+  uint8_t ws_id_[kWorkspaceMaxNum];
+  uint8_t ws_type_[kWorkspaceMaxNum];
+  uint8_t workload_type_[kWorkspaceMaxNum];
+  SeqLock<stats_snapshot> snapshot_;
+};
+static_assert(sizeof(stats_sample) == 80 && sizeof(stats_shm_layout) == 72 + 8 + 8 + 80 * kWorkspaceMaxNum,
+              "Update toolchain/axio_stat.py with the new stats_shm_layout");
+
+/**
+ * Owns the segment, /dev/shm/<name>, and unlinks it on destruction. Only the
+ * stats monitor writes it, the workspaces are never touched by the readers.
+ */
+class StatsShm {
+ public:
+  StatsShm(const std::string &name, uint32_t interval_ms) : name_(name[0] == '/' ? name : "/" + name) {
+    int fd = shm_open(name_.c_str(), O_CREAT | O_RDWR | O_TRUNC, 0644);
+    rt_assert(fd >= 0, "Failed to create the stats shared memory " + name_);
+    rt_assert(ftruncate(fd, sizeof(stats_shm_layout)) == 0, "Failed to size the stats shared memory");
+    void *addr = mmap(nullptr, sizeof(stats_shm_layout), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    rt_assert(addr != MAP_FAILED, "Failed to map the stats shared memory");
+    layout_ = new (addr) stats_shm_layout();
+    layout_->magic_ = kStatsShmMagic;
+    layout_->version_ = kStatsShmVersion;
+    layout_->interval_ms_ = interval_ms;
+    layout_->pid_ = getpid();
+    DPERF_INFO("Stats shared memory: /dev/shm%s\n", name_.c_str());
+  }
+
+  ~StatsShm() {
+    munmap(layout_, sizeof(stats_shm_layout));
+    shm_unlink(name_.c_str());
+  }
+
+  /// Describe the workspaces, before the first snapshot
+  void set_workspaces(size_t ws_num, const uint8_t *ws_id, const uint8_t *ws_type, const uint8_t *workload_type) {
+    for (size_t i = 0; i < ws_num; i++) {
+      layout_->ws_id_[i] = ws_id[i];
+      layout_->ws_type_[i] = ws_type[i];
+      layout_->workload_type_[i] = workload_type[i];
+    }
+    __atomic_store_n(&layout_->ws_num_, static_cast<uint32_t>(ws_num), __ATOMIC_RELEASE);
+  }
+
+  inline void store(const stats_snapshot &snapshot) { layout_->snapshot_.store(snapshot); }
+
+ private:
+  std::string name_;
+  stats_shm_layout *layout_ = nullptr;
+};
+
+}  // namespace dperf
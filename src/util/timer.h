@@ -8,7 +8,10 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <chrono>
+#include <cpuid.h>
+#include <immintrin.h>
 #include "common.h"
+#include "util/logger.h"
 
 namespace dperf {
 
@@ -37,6 +40,18 @@ static void nano_sleep(size_t ns, double freq_ghz) {
   while (end - start < upp) end = rdtsc();
 }
 
+/**
+ * @brief Wait until the TSC passes \p deadline_tsc. With WAITPKG, TPAUSE parks
+ * the core in C0.1 (the faster-wakeup state); otherwise spin on PAUSE.
+ */
+static inline void wait_until_tsc(size_t deadline_tsc) {
+#ifdef __WAITPKG__
+  _tpause(1, deadline_tsc);
+#else
+  while (rdtsc() < deadline_tsc) _mm_pause();
+#endif
+}
+
 /// Simple time that uses std::chrono
 class ChronoTimer {
  public:
@@ -83,6 +98,52 @@ static double measure_rdtsc_freq() {
   return freq_ghz;
 }
 
+/**
+ * @brief TSC frequency from CPUID leaf 0x15, the ratio of the TSC to the core
+ * crystal clock, which the kernel also trusts when it sets tsc_known_freq.
+ * Some CPUs leave the crystal frequency out, it is then derived from the base
+ * frequency of leaf 0x16. Return 0 if the CPU does not enumerate it, e.g., AMD
+ * or most VMs.
+ */
+static double cpuid_tsc_freq_ghz() {
+  uint32_t eax, ebx, ecx, edx;
+  if (__get_cpuid_max(0, nullptr) < 0x15) return 0;
+  __cpuid(0x15, eax, ebx, ecx, edx);
+  if (eax == 0 || ebx == 0) return 0;
+  double crystal_hz = ecx;
+  if (crystal_hz == 0) {
+    if (__get_cpuid_max(0, nullptr) < 0x16) return 0;
+    uint32_t base_mhz, unused;
+    __cpuid(0x16, base_mhz, unused, unused, unused);
+    crystal_hz = base_mhz * 1e6 * eax / ebx;
+  }
+  return crystal_hz * ebx / eax / 1e9;
+}
+
+/**
+ * @brief The TSC frequency of this machine, calibrate it once per process and
+ * share it, so all workspaces convert cycles identically. Falls back to one
+ * measurement against the steady clock if CPUID does not enumerate it.
+ */
+static double calibrate_tsc_freq_ghz() {
+  double freq_ghz = cpuid_tsc_freq_ghz();
+  if (freq_ghz >= 0.5 && freq_ghz <= 5.0) {
+    DPERF_INFO("TSC frequency: %.4f GHz from CPUID\n", freq_ghz);
+    return freq_ghz;
+  }
+  freq_ghz = measure_rdtsc_freq();
+  DPERF_INFO("TSC frequency: %.4f GHz measured\n", freq_ghz);
+  return freq_ghz;
+}
+
+/// Cycles of one rdtsc(), the cost of taking a timestamp
+static double measure_rdtsc_cost() {
+  const size_t kReads = 1000;
+  const uint64_t rdtsc_start = rdtsc();
+  for (size_t i = 0; i < kReads; i++) rdtsc();
+  return (rdtsc() - rdtsc_start) * 1.0 / (kReads + 1);
+}
+
 /// Convert cycles measured by rdtsc with frequence \p freq_ghz to seconds
 static double to_sec(size_t cycles, double freq_ghz) {
   return (cycles / (freq_ghz * 1000000000));
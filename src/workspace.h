@@ -16,11 +16,24 @@
 #include "util/numautils.h"
 #include "util/rand.h"
 #include "util/kv.h"
+#include "util/arrival_schedule.h"
+#include "util/size_dist.h"
+#include "util/reassembly_table.h"
+#include "util/histogram.h"
+#include "util/batch_controller.h"
+#include "util/elastic_controller.h"
+#include "util/seqlock.h"
+#if PERF_HW_COUNTERS == 1
+#include "util/perf_counters.h"
+#endif
 
 #include "ws_impl/workspace_context.h"
 #include "ws_impl/ws_hdr.h"
 
+#include <atomic>
+#include <condition_variable>
 #include <mutex>
+#include <set>
 #include <vector>
 #include <unordered_map>
 #include <algorithm>
@@ -36,6 +49,28 @@ namespace dperf{
 
 using phase_t = void (Workspace<DISPATCHER_TYPE>::*)();
 
+/**
+ * ----------------------Fused event loops----------------------
+ * Each bit stands for one phase. A fused loop runs the phases of its bitmap in
+ * pipeline order (RX dispatcher, RX app, TX app, TX dispatcher) within a single
+ * inlined loop body, so a loop costs no indirect call.
+ */ 
+#define kPhaseNicRx         (1 << 0)
+#define kPhaseBurstedRx     (1 << 1)
+#define kPhaseAppHandler    (1 << 2)
+#define kPhaseApplyMbufs    (1 << 3)
+#define kPhaseGeneratePkts  (1 << 4)
+#define kPhaseBurstedTx     (1 << 5)
+#define kPhaseNicTx         (1 << 6)
+
+/// The phase list is not fused, the loop walks ws_loop_ through member function pointers
+#define kInterpretedLoop        0
+#define kDispatcherLoop         (kPhaseNicRx | kPhaseBurstedRx | kPhaseBurstedTx | kPhaseNicTx)
+#define kServerWorkerLoop       (kPhaseAppHandler)
+#define kClientWorkerLoop       (kPhaseAppHandler | kPhaseApplyMbufs | kPhaseGeneratePkts)
+#define kServerDispWorkerLoop   (kDispatcherLoop | kServerWorkerLoop)
+#define kClientDispWorkerLoop   (kDispatcherLoop | kClientWorkerLoop)
+
 template <class TDispatcher>
 class Workspace {
   /**
@@ -54,10 +89,45 @@ class Workspace {
   // RX specific
   static constexpr size_t kAppReponsePktsNum = ceil((double)kAppRespPayloadSize / (double)Dispatcher::kMaxPayloadSize); // number of packets in a response message
   static constexpr size_t kAppRespFullPaddingSize = Dispatcher::kMaxPayloadSize - sizeof(ws_hdr);
+  static_assert(kAppRequestPktsNum <= UINT8_MAX && kAppReponsePktsNum <= UINT8_MAX, "Too many segments for ws_hdr");
+  /// Runtime message sizes (msg_size), the segment number of a request stays kAppRequestPktsNum
+  static constexpr size_t kAppMinPaddingSize = (PERF_LAT_BREAKDOWN == 1) ? sizeof(ws_ts) : 0;
+  static constexpr size_t kAppMinReqSize = (kAppRequestPktsNum - 1) * kAppFullPaddingSize + kAppMinPaddingSize;
+  static constexpr size_t kAppMaxReqSize = kAppRequestPktsNum * kAppFullPaddingSize;
+  /// Per-message logs of the client are indexed by msg_id_, so they cover 64K messages in flight
+  static constexpr size_t kTxMsgLogLen = UINT16_MAX + 1;
+#if PERF_LAT_BREAKDOWN == 1
+  static_assert(kAppLastPaddingSize >= sizeof(ws_ts) && kAppRespPayloadSize >= sizeof(ws_ts), 
+                "Payload is too small to carry the latency breakdown timestamps");
+#endif
   
   /**
    * ----------------------Workspace internal structures----------------------
    */ 
+  public:
+    /// Client latency histograms of one iteration, in cycles
+    struct lat_hists {
+      Histogram rtt_;
+      Histogram client_queue_;    // from send_tsc_ until the client dispatcher flushes the request
+      Histogram network_;         // the rest of the RTT, i.e., NICs, network, and RX dispatching
+      Histogram server_;          // server residency
+      Histogram size_rtt_[kSizeBucketNum];    // RTT by request size, with runtime message sizes only
+
+      void reset() {
+        rtt_.reset();
+        client_queue_.reset();
+        network_.reset();
+        server_.reset();
+        for (auto &hist : size_rtt_) hist.reset();
+      }
+      void merge(const lat_hists &other) {
+        rtt_.merge(other.rtt_);
+        client_queue_.merge(other.client_queue_);
+        network_.merge(other.network_);
+        server_.merge(other.server_);
+        for (size_t i = 0; i < kSizeBucketNum; i++) size_rtt_[i].merge(other.size_rtt_[i]);
+      }
+    };
   
   /**
    * ----------------------Workerspace methods----------------------
@@ -88,6 +158,86 @@ class Workspace {
     */
     void launch();
 
+    /**
+     * @brief Execute one loop of the phases in \p kPhases. kInterpretedLoop 
+     * falls back to launch().
+    */
+    template <uint8_t kPhases>
+    inline void launch_fused() {
+      probe_ = next_probe();
+      if (probe_) stats_->probe_loop_num++;
+      hw_begin();
+    #if PERF_CYCLE_ACCOUNTING == 1
+      if (probe_) phase_tsc_ = rdtsc();
+    #endif
+      if constexpr (kPhases == kInterpretedLoop) { run_phase<kLoopPhaseInterpreted, &Workspace::launch>(); return; }
+      if constexpr ((kPhases & kPhaseNicRx) != 0) run_phase<__builtin_ctz(kPhaseNicRx), &Workspace::nic_rx>();
+      if constexpr ((kPhases & kPhaseBurstedRx) != 0) run_phase<__builtin_ctz(kPhaseBurstedRx), &Workspace::bursted_rx>();
+      if constexpr ((kPhases & kPhaseAppHandler) != 0) run_phase<__builtin_ctz(kPhaseAppHandler), &Workspace::app_handler>();
+      if constexpr ((kPhases & kPhaseApplyMbufs) != 0) run_phase<__builtin_ctz(kPhaseApplyMbufs), &Workspace::apply_mbufs>();
+      if constexpr ((kPhases & kPhaseGeneratePkts) != 0) run_phase<__builtin_ctz(kPhaseGeneratePkts), &Workspace::generate_pkts>();
+      if constexpr ((kPhases & kPhaseBurstedTx) != 0) run_phase<__builtin_ctz(kPhaseBurstedTx), &Workspace::bursted_tx>();
+      if constexpr ((kPhases & kPhaseNicTx) != 0) run_phase<__builtin_ctz(kPhaseNicTx), &Workspace::nic_tx>();
+    }
+
+    /**
+     * @brief Run one phase of a loop, and charge its cycles to the phase, as
+     * useful work if it moved packets, as an empty poll otherwise
+    */
+    template <size_t kPhase, void (Workspace::*kFunc)()>
+    inline void run_phase() {
+    #if PERF_CYCLE_ACCOUNTING == 1
+      if (!probe_) {
+        (this->*kFunc)();
+        return;
+      }
+      uint64_t pkts = (kPhase == kLoopPhaseInterpreted) ? loop_progress() : phase_pkts(stats_, kPhase);
+      (this->*kFunc)();
+      hw_account(kPhase);
+      size_t now_tsc = rdtsc();
+      bool busy = (kPhase == kLoopPhaseInterpreted) ? loop_progress() != pkts : phase_pkts(stats_, kPhase) != pkts;
+      if (busy) stats_->phase_busy_duration[kPhase] += (now_tsc - phase_tsc_) * probe_scale_;
+      else stats_->phase_empty_duration[kPhase] += (now_tsc - phase_tsc_) * probe_scale_;
+      stats_->phase_calls[kPhase]++;
+      phase_tsc_ = now_tsc;
+    #else
+      (this->*kFunc)();
+      hw_account(kPhase);
+    #endif
+    }
+
+    /// Instrumentation: whether the next loop takes probes, every probe_scale_-th loop if sampled
+    inline bool next_probe() {
+      if (instrument_level_ != kInstrumentSampled) return instrument_level_ == kInstrumentFull;
+      if (--probe_countdown_ != 0) return false;
+      probe_countdown_ = probe_scale_;
+      return true;
+    }
+    /// The start of a duration probe, skipped in loops without probes
+    inline size_t probe_tsc() {
+      return probe_ ? rdtsc() : 0;
+    }
+    double measure_probe_cost();
+
+    /// Hardware counters: snapshot at the start of a loop, and charge each phase its delta
+  #if PERF_HW_COUNTERS == 1
+    inline void hw_begin() {
+      if (hw_counters_ != nullptr && probe_) hw_counters_->read(hw_prev_);
+    }
+    inline void hw_account(size_t phase) {
+      if (hw_counters_ == nullptr || !probe_) return;
+      uint64_t now[kHwEventNum];
+      hw_counters_->read(now);
+      for (size_t i = 0; i < kHwEventNum; i++) {
+        stats_->hw_[phase][i] += (now[i] - hw_prev_[i]) * probe_scale_;
+        hw_prev_[i] = now[i];
+      }
+    }
+  #else
+    inline void hw_begin() {}
+    inline void hw_account(size_t) {}
+  #endif
+
     /**
      * @brief Run the pipeline loops for a given number of iterations
      * @param iteration The number of iterations to run
@@ -100,17 +250,33 @@ class Workspace {
      * @brief App tx phase, step 1: apply mbufs. Stall occurs when there is no available mbuf
      */
     void apply_mbufs() {
-    #if EnableInflyMessageLimit
-      // we block until we have infly budget
-      if(tx_rule_table_->apply_infly_budget(workload_type_, kAppTxMsgBatchSize) == false){
-        infly_flag_ = false;
-        return;
+      if (schedule_ != nullptr) {
+        /// open loop: take the messages that are due, at most one batch
+        size_t now_tsc = rdtsc();
+        tx_msg_num_ = 0;
+        while (tx_msg_num_ < kAppTxMsgBatchSize && schedule_->peek() <= now_tsc) {
+          if (unlikely(now_tsc - schedule_->peek() > late_tsc_)) net_stats_app_tx_late(1);
+          tx_sched_tsc_[tx_msg_num_++] = schedule_->peek();
+          schedule_->advance();
+        }
+        if (tx_msg_num_ == 0) return;
+        tx_dest_ = tx_rule_table_->rr_select(workload_type_);
+      } else {
+      #if EnableInflyMessageLimit
+        // we block until a remote dispatcher has credits for a batch
+        tx_dest_ = acquire_credits(kAppTxMsgBatchSize);
+        if (unlikely(tx_dest_ == kInvalidWsId)) {
+          tx_msg_num_ = 0;
+          return;
+        }
+      #else
+        tx_dest_ = tx_rule_table_->rr_select(workload_type_);
+      #endif
+        tx_msg_num_ = kAppTxMsgBatchSize;
       }
-      infly_flag_ = true;
-    #endif
 
-      size_t s_tick = rdtsc();
-      while (unlikely(alloc_bulk(tx_mbuf_, kAppRequestPktsNum * kAppTxMsgBatchSize) != 0)) {
+      size_t s_tick = probe_tsc();
+      while (unlikely(alloc_bulk(tx_mbuf_, kAppRequestPktsNum * tx_msg_num_) != 0)) {
         net_stats_app_apply_mbuf_stalls();
       }
 
@@ -132,47 +298,61 @@ class Workspace {
      * @brief App tx phase, step 2: generate packets. Drop occurs when the tx queue is full
     */
     void generate_pkts() {
-      #if EnableInflyMessageLimit
-        if(!infly_flag_) return;
-      #endif
+      if (tx_msg_num_ == 0) return;
       size_t s_tick = rdtsc();
       /// partially set udp header
       udphdr uh;
       uh.source = ws_id_;
-      uh.dest = tx_rule_table_->rr_select(workload_type_);
+      uh.dest = tx_dest_;
       /// set workspace header
       ws_hdr hdr;
       hdr.workload_type_ = workload_type_;
       hdr.segment_num_ = kAppRequestPktsNum;
+      hdr.src_ws_id_ = ws_id_;
+      hdr.resp_size_ = 0;
+      size_t last_padding_size = kAppLastPaddingSize;
       MEM_REG_TYPE **mbuf_ptr = tx_mbuf_;
       /// Insert payload to mbufs
-      for (size_t msg_idx = 0; msg_idx < kAppTxMsgBatchSize; msg_idx++) {
+      for (size_t msg_idx = 0; msg_idx < tx_msg_num_; msg_idx++) {
+        /// latency counts from the scheduled send time in open loop
+        hdr.send_tsc_ = (schedule_ != nullptr) ? tx_sched_tsc_[msg_idx] : s_tick;
+        hdr.msg_id_ = next_msg_id_++;
+        if (tx_dest_log_ != nullptr) tx_dest_log_[hdr.msg_id_] = tx_dest_;
+        /// draw the sizes of this message, only the last segment shrinks or grows
+        if (req_sizes_ != nullptr) {
+          size_t req_size = req_sizes_->next();
+          last_padding_size = req_size - (kAppRequestPktsNum - 1) * kAppFullPaddingSize;
+          tx_size_log_[hdr.msg_id_] = size_bucket(req_size);
+          if (resp_sizes_ != nullptr) hdr.resp_size_ = resp_sizes_->next();
+        }
         /// TBD: Perform extra memory access and calculation for each message
         /// Iterate all messages in a batch
         for (size_t seg_idx = 0; seg_idx < kAppRequestPktsNum - 1; seg_idx++) {
           /// Iterate all segments in a message
+          hdr.seg_idx_ = seg_idx;
           set_payload(*mbuf_ptr, (char*)&uh, (char*)&hdr, kAppFullPaddingSize);
           mbuf_ptr++;
         }
-        set_payload(*mbuf_ptr, (char*)&uh, (char*)&hdr, kAppLastPaddingSize);
+        hdr.seg_idx_ = kAppRequestPktsNum - 1;
+        set_payload(*mbuf_ptr, (char*)&uh, (char*)&hdr, last_padding_size);
         mbuf_ptr++;
       }
       /// Insert packets to worker tx queue
       size_t drop_num = 0;
-      for (size_t i = 0; i < kAppRequestPktsNum * kAppTxMsgBatchSize; i++) {
+      for (size_t i = 0; i < kAppRequestPktsNum * tx_msg_num_; i++) {
         if (unlikely(!tx_queue_->enqueue((uint8_t*)tx_mbuf_[i]))) {
           /// Drop the packet if the tx queue is full
           de_alloc(tx_mbuf_[i]);
           drop_num++;
         }
       }
-      net_stats_app_tx(kAppTxMsgBatchSize * kAppRequestPktsNum - drop_num);
+      net_stats_app_tx(tx_msg_num_ * kAppRequestPktsNum - drop_num);
       net_stats_app_drops(drop_num);
       net_stats_app_tx_duration(s_tick);
       #ifdef OneStage
         tx_queue_->reset_tail();
-        s_tick = rdtsc();
-        de_alloc_bulk(tx_mbuf_, kAppRequestPktsNum * kAppTxMsgBatchSize);
+        s_tick = probe_tsc();
+        de_alloc_bulk(tx_mbuf_, kAppRequestPktsNum * tx_msg_num_);
         net_stats_app_tx_stall_duration(s_tick);
         // for (size_t i = 0; i < kAppRequestPktsNum * kAppTxMsgBatchSize; i++) {
         //   de_alloc(tx_mbuf_[i]);
@@ -180,6 +360,56 @@ class Workspace {
       #endif
     }
 
+    /**
+     * @brief Move the segments in the rx queue to the reassembly table, complete 
+     * messages are appended to rx_mbuf_buffer_ in segment order
+     * @return The number of complete messages in rx_mbuf_buffer_
+    */
+    size_t reassemble_msgs(size_t rx_size) {
+      size_t now_tsc = rdtsc();
+      auto __free = [this](MEM_REG_TYPE **pkts, size_t num) { de_alloc_bulk(pkts, num); };
+      for (size_t i = 0; i < rx_size && (rx_ready_msg_num_ + 1) * kAppRequestPktsNum <= kWsQueueSize; i++) {
+        MEM_REG_TYPE *pkt = (MEM_REG_TYPE*)rx_queue_->dequeue();
+        rt_assert(pkt != nullptr, "Get invalid mbuf!");
+        ws_hdr *hdr = extract_ws_hdr(pkt);
+        /// a message is identified by the sender host, the sender port (as encoded by the 
+        /// dispatcher), and its id. A 16-bit id does not wrap within the reassembly timeout
+        uint64_t key = (static_cast<uint64_t>(extract_ip_hdr(pkt)->saddr) << 32) 
+                      | (static_cast<uint64_t>(extract_udp_hdr(pkt)->source) << 16) | hdr->msg_id_;
+        if (reasm_->insert(pkt, key, hdr->seg_idx_, hdr->segment_num_, now_tsc, 
+                           &rx_mbuf_buffer_[rx_ready_msg_num_ * kAppRequestPktsNum], __free)) {
+          rx_ready_msg_num_++;
+        }
+      }
+      if (unlikely(now_tsc - reasm_expire_tsc_ > reasm_timeout_tsc_)) {
+        reasm_->expire(now_tsc, reasm_timeout_tsc_, __free);
+        reasm_expire_tsc_ = now_tsc;
+      }
+      return rx_ready_msg_num_;
+    }
+
+    /**
+     * @brief Work stealing: when the rx queue holds less than a batch, take its 
+     * messages plus the rest of a batch from the longest sibling queue of the group
+     * @return The number of messages in rx_mbuf_buffer_, 0 if there was nothing to steal
+    */
+    size_t steal_msgs(size_t rx_size) {
+      lock_free_queue *victim = nullptr;
+      size_t backlog = steal_min_backlog_ - 1;
+      for (auto &queue : steal_victims_) {
+        size_t size = queue->get_size();
+        if (size > backlog) {
+          victim = queue;
+          backlog = size;
+        }
+      }
+      if (victim == nullptr) return 0;
+      size_t own = rx_queue_->dequeue_burst((uint8_t**)rx_mbuf_buffer_, rx_size);
+      size_t stolen = victim->dequeue_burst((uint8_t**)&rx_mbuf_buffer_[own], rx_batch_.get() - own);
+      net_stats_app_steal(stolen);
+      return own + stolen;
+    }
+
     /**
      * @brief App rx phase: handle received messages. 
     */
@@ -212,10 +442,10 @@ class Workspace {
         } while(passed_ticks < ticks);
       };
 
-      /// enter rule, receive >= kAppRxMsgBatchSize requests to process
+      /// enter rule, receive a batch of requests to process (kAppRxMsgBatchSize, or less if adaptive)
     #if NODE_TYPE == CLIENT
       size_t msg_num = rx_size / kAppReponsePktsNum;
-      if (msg_num < kAppRxMsgBatchSize)
+      if (!rx_batch_.ready(msg_num, s_tick))
         return;
       /// handle message
       for (size_t i = 0; i < msg_num; i++) {
@@ -224,20 +454,36 @@ class Workspace {
           rt_assert(rx_mbuf_buffer_[i*kAppReponsePktsNum + j] != nullptr, "Get invalid mbuf!");
         }
       }
-      __mock_process_msg(rx_mbuf_buffer_, kAppTicksPerMsg * msg_num, msg_num);
+      __mock_process_msg(rx_mbuf_buffer_, app_ticks_per_msg_ * msg_num, msg_num);
       net_stats_app_rx(msg_num * kAppReponsePktsNum); // 
     #else
-      size_t msg_num = rx_size / kAppRequestPktsNum;
-      if (msg_num < kAppRxMsgBatchSize)
-        return;
-      /// handle message
-      for (size_t i = 0; i < msg_num; i++) {
-        for (size_t j = 0; j < kAppRequestPktsNum; j++) {
-          rx_mbuf_buffer_[i*kAppRequestPktsNum + j] = (MEM_REG_TYPE*)rx_queue_->dequeue();
-          rt_assert(rx_mbuf_buffer_[i*kAppRequestPktsNum + j] != nullptr, "Get invalid mbuf!");
+      size_t msg_num = 0;
+      if constexpr (kAppRequestPktsNum == 1) {
+        msg_num = rx_size;
+        if (steal_) {
+          /// siblings may dequeue from this queue too
+          /// a parked workspace drains its queue without waiting for a batch
+          msg_num = !rx_batch_.ready(msg_num, s_tick) && !draining_ ? steal_msgs(rx_size)
+                  : rx_queue_->dequeue_burst((uint8_t**)rx_mbuf_buffer_, rx_size);
+          if (msg_num == 0)
+            return;
+        } else {
+          if (!rx_batch_.ready(msg_num, s_tick) && (!draining_ || msg_num == 0))
+            return;
+          /// handle message
+          for (size_t i = 0; i < msg_num; i++) {
+            rx_mbuf_buffer_[i] = (MEM_REG_TYPE*)rx_queue_->dequeue();
+            rt_assert(rx_mbuf_buffer_[i] != nullptr, "Get invalid mbuf!");
+          }
         }
+      } else {
+        /// segments of different messages may interleave, reassemble them first
+        msg_num = reassemble_msgs(rx_size);
+        if (!rx_batch_.ready(msg_num, s_tick))
+          return;
+        rx_ready_msg_num_ = 0;
       }
-      __mock_process_msg(rx_mbuf_buffer_, kAppTicksPerMsg * msg_num, msg_num);
+      __mock_process_msg(rx_mbuf_buffer_, app_ticks_per_msg_ * msg_num, msg_num);
       net_stats_app_rx(msg_num * kAppRequestPktsNum);
     #endif
       net_stats_app_rx_duration(s_tick);
@@ -260,7 +506,7 @@ class Workspace {
         fill_queue(tx_queue_, FlowSize);
       #endif
       /// Dispatch stage
-      size_t s_tick = rdtsc();
+      size_t s_tick = probe_tsc();
       size_t nb_collect = 0;
       nb_collect = dispatcher_->collect_tx_pkts();
       if (likely(nb_collect != 0)) {
@@ -280,9 +526,9 @@ class Workspace {
         dispatcher_->fill_tx_pkts(FlowSize, kAppReqPayloadSize + 42);
       #endif
       /// Calculate NIC transimitted packets and duration first
-      size_t nb_tx = 0;
-      if (dispatcher_->get_tx_queue_size() >= dispatcher_->kDispTxBatchSize) {
-        size_t s_tick = rdtsc();
+      size_t nb_tx = 0, tx_size = dispatcher_->get_tx_queue_size();
+      if (tx_size != 0 && tx_batch_.ready(tx_size, rdtsc())) {
+        size_t s_tick = probe_tsc();
         nb_tx = dispatcher_->tx_flush();
         // DPERF_INFO("Workspace %u successfully transmit %lu packets\n", ws_id_, nb_tx); 
         net_stats_nic_tx(nb_tx);
@@ -307,7 +553,7 @@ class Workspace {
       size_t queue_size = 0, nb_dispatched = 0;
       queue_size = dispatcher_->get_rx_queue_size();
       if (queue_size != 0) {
-        size_t s_tick = rdtsc();
+        size_t s_tick = probe_tsc();
         nb_dispatched = dispatcher_->template pkt_handler_server<kRxPktHandler>();
         nb_dispatched += dispatcher_->dispatch_rx_pkts();
         // DPERF_INFO("Workspace %u successfully dispatch %lu packets\n", ws_id_, nb_dispatched);
@@ -326,17 +572,21 @@ class Workspace {
     }
 
     void nic_rx(){
-      size_t s_tick = rdtsc(), cur_desc = dispatcher_->get_rx_used_desc();
+      size_t s_tick = probe_tsc(), cur_desc = dispatcher_->get_rx_used_desc();
       size_t nb_rx = 0;
       /// Calculate NIC received packets and duration first
-      if (cur_desc != Dispatcher::kNumRxRingEntries && cur_desc != nic_rx_prev_desc_) {
-        net_stats_nic_rx_duration(s_tick, nic_rx_prev_tick_);
+      if (cur_desc != dispatcher_->rx_ring_size_ && cur_desc != nic_rx_prev_desc_) {
         net_stats_nic_rx(cur_desc, nic_rx_prev_desc_);
-        double cpt = (double)(s_tick - nic_rx_prev_tick_) / (double)(cur_desc - nic_rx_prev_desc_);
-        net_stats_nic_rx_cpt(cpt);
+        nic_rx_probe_desc_ += cur_desc - nic_rx_prev_desc_;
+      }
+      /// cycles per descriptor over the span since the previous probe
+      if (probe_ && nic_rx_probe_desc_ != 0) {
+        net_stats_nic_rx_duration(s_tick, nic_rx_prev_tick_);
+        net_stats_nic_rx_cpt((double)(s_tick - nic_rx_prev_tick_) / (double)nic_rx_probe_desc_);
+        nic_rx_probe_desc_ = 0;
       }
       nb_rx = dispatcher_->rx_burst();
-      nic_rx_prev_tick_ = rdtsc();
+      if (probe_) nic_rx_prev_tick_ = rdtsc();
       nic_rx_prev_desc_ = dispatcher_->get_rx_used_desc();
       if (likely(nb_rx)){
         // DPERF_INFO("Workspace %u successfully receive %lu packets\n", ws_id_, nb_rx);
@@ -347,15 +597,82 @@ class Workspace {
       #endif
     }
     
+    /**
+     * @brief Closed loop: take credits for \p msg_num messages from the next remote
+     * dispatcher (round-robin) whose window has room
+     * @return The remote dispatcher, kInvalidWsId if no window has room
+    */
+    uint8_t acquire_credits(uint32_t msg_num) {
+      for (size_t i = 0; i < credit_dests_.size(); i++) {
+        uint8_t dest = credit_dests_[credit_rr_++ % credit_dests_.size()];
+        if (unlikely(credit_infly_[dest] + msg_num > credit_window_[dest])) {
+          /// take back the credits of responses that reached other workspaces
+          credit_infly_[dest] -= credit_returned_[dest].exchange(0, std::memory_order_relaxed);
+          if (credit_infly_[dest] + msg_num > credit_window_[dest]) continue;
+        }
+        credit_infly_[dest] += msg_num;
+        return dest;
+      }
+      return kInvalidWsId;
+    }
+
+    /// Closed loop: the response of \p msg_id reached its sender, adapt the window from its \p rtt
+    inline void release_credit(uint16_t msg_id, size_t rtt, size_t now_tsc) {
+      uint8_t dest = tx_dest_log_[msg_id];
+      credit_infly_[dest]--;
+      if (!credit_config_->adaptive_) return;
+      if (rtt > credit_target_tsc_) {
+        /// multiplicative decrease, at most once per RTT
+        if (now_tsc - credit_cut_tsc_[dest] > rtt) {
+          credit_window_[dest] = std::max<uint32_t>(credit_window_[dest] * 7 / 8, credit_min_window_);
+          credit_cut_tsc_[dest] = now_tsc;
+          credit_acked_[dest] = 0;
+        }
+      } else if (++credit_acked_[dest] >= credit_window_[dest]) {
+        /// additive increase, one message per window of responses
+        credit_window_[dest] = std::min<uint32_t>(credit_window_[dest] + 1, credit_config_->max_window_);
+        credit_acked_[dest] = 0;
+      }
+    }
+
+    /// Closed loop: the response of \p msg_id reached another workspace, called by that workspace
+    inline void return_credit(uint16_t msg_id) {
+      credit_returned_[tx_dest_log_[msg_id]].fetch_add(1, std::memory_order_relaxed);
+    }
+
   /**
    * ----------------------User defined methods----------------------
    */ 
 
   void msg_handler_client(MEM_REG_TYPE** msg, size_t msg_num) {
-  #if EnableInflyMessageLimit
-    ws_hdr *recv_ws_hdr = extract_ws_hdr(msg[0]);
-    tx_rule_table_->return_infly_budget(recv_ws_hdr->workload_type_, msg_num);
-  #endif
+    /// round-trip time of each message, from its (scheduled) send time
+    size_t now_tsc = rdtsc();
+    for (size_t i = 0; i < msg_num; i++) {
+      MEM_REG_TYPE *m = msg[i * kAppReponsePktsNum];
+      ws_hdr *hdr = extract_ws_hdr(m);
+      size_t rtt = now_tsc - hdr->send_tsc_;
+      /// the per-message logs are kept by the sender, which is usually this workspace
+      bool is_sender = likely(hdr->src_ws_id_ == ws_id_);
+    #if EnableInflyMessageLimit
+      if (schedule_ == nullptr) {
+        if (is_sender) release_credit(hdr->msg_id_, rtt, now_tsc);
+        else context_->ws_[hdr->src_ws_id_]->return_credit(hdr->msg_id_);
+      }
+    #endif
+    #if PERF_TEST_LAT == 1
+      lat_hists_->rtt_.record(rtt);
+      if (tx_size_log_ != nullptr && is_sender) 
+        lat_hists_->size_rtt_[tx_size_log_[hdr->msg_id_]].record(rtt);
+    #if PERF_LAT_BREAKDOWN == 1
+      ws_ts *ts = extract_ws_ts(m);
+      size_t client_queue = ts->client_tx_tsc_ - hdr->send_tsc_;
+      size_t server = ns_to_cycles(ts->server_ts_, freq_ghz_);
+      lat_hists_->client_queue_.record(client_queue);
+      lat_hists_->server_.record(server);
+      lat_hists_->network_.record(rtt > client_queue + server ? rtt - client_queue - server : 0);
+    #endif
+    #endif
+    }
     de_alloc_bulk(msg, msg_num * kAppReponsePktsNum);
   }
 
@@ -512,15 +829,54 @@ class Workspace {
     ws_hdr* extract_ws_hdr(MEM_REG_TYPE *mbuf){
       return mem_reg_->extract_ws_hdr_(mbuf);
     }
+
+    /// Every dispatcher lays out the UDP header right before ws_hdr, and the IP header before that
+    udphdr* extract_udp_hdr(MEM_REG_TYPE *mbuf){
+      return reinterpret_cast<udphdr*>(extract_ws_hdr(mbuf)) - 1;
+    }
+
+    iphdr* extract_ip_hdr(MEM_REG_TYPE *mbuf){
+      return reinterpret_cast<iphdr*>(extract_udp_hdr(mbuf)) - 1;
+    }
+
+    /// The latency breakdown timestamps at the head of the payload
+    ws_ts* extract_ws_ts(MEM_REG_TYPE *mbuf){
+      return reinterpret_cast<ws_ts*>(extract_ws_hdr(mbuf) + 1);
+    }
     
     size_t get_RX_ring_size() {
-      return dispatcher_->kNumRxRingEntries;
+      return dispatcher_->rx_ring_size_;
     }
 
     uint8_t get_ws_id() {
       return ws_id_;
     }
 
+    lat_hists* get_lat_hists() {
+      return lat_hists_;
+    }
+
+    Histogram* get_server_hist() {
+      return server_hist_;
+    }
+
+    uint8_t get_rx_policy() {
+      return rx_policy_;
+    }
+
+    bool is_stealing() {
+      return steal_;
+    }
+
+    struct net_stats* get_stats() {
+      return stats_;
+    }
+
+    /// The counters last published while running, safe to read from any thread
+    stats_sample get_stats_sample() {
+      return stats_pub_.load();
+    }
+
     uint8_t get_ws_type() {
       return ws_type_;
     }
@@ -534,6 +890,24 @@ class Workspace {
       return freq_ghz_;
     }
 
+    /// Elastic mode: stop taking messages, and sleep once the rx queue is drained
+    void park() {
+      parked_.store(true, std::memory_order_release);
+    }
+
+    void unpark() {
+      {
+        std::lock_guard<std::mutex> lock(park_mutex_);
+        parked_.store(false, std::memory_order_release);
+      }
+      park_cv_.notify_one();
+    }
+
+    /// Elastic mode: cycles spent in loops that moved messages
+    size_t get_busy_tsc() {
+      return busy_tsc_.load(std::memory_order_relaxed);
+    }
+
     /**
      * @brief Get the memory_region_info from workspace->dispatcher
      * @throw runtime_error if workspace is not a dispatcher
@@ -567,10 +941,51 @@ class Workspace {
 
     /// Parameters for pipeline
     std::vector<phase_t> *ws_loop_ = nullptr;
+    uint8_t fused_loop_ = kInterpretedLoop;   // phase bitmap of the fused loop, selected at startup
+    UserConfig::pacing_config *pacing_ = nullptr;   // loop pacing of this workspace role
     /// Application related parameters
     Dispatcher::mem_reg_info<MEM_REG_TYPE> *mem_reg_ = nullptr;     // registered by the dispatcher
-    bool infly_flag_ = false;
+    size_t tx_msg_num_ = 0;                     // messages generated in this loop
     MEM_REG_TYPE *tx_mbuf_[kAppRequestPktsNum * kMaxBatchSize] = {nullptr};
+    /// Open-loop client
+    UserConfig::load_config *load_config_ = nullptr;
+    ArrivalSchedule *schedule_ = nullptr;        // nullptr in closed loop
+    size_t tx_sched_tsc_[kMaxBatchSize] = {0};  // scheduled send time of each generated message
+    size_t late_tsc_ = 0;
+    uint16_t next_msg_id_ = 0;
+    uint8_t tx_dest_ = kInvalidWsId;            // remote dispatcher of the messages generated in this loop
+    /// Closed-loop credit windows, indexed by remote dispatcher ws id
+    UserConfig::credit_config *credit_config_ = nullptr;
+    std::vector<uint8_t> credit_dests_;         // remote dispatchers of the workload
+    size_t credit_rr_ = 0;
+    uint32_t credit_window_[kInvalidWsId] = {0};
+    uint32_t credit_infly_[kInvalidWsId] = {0};
+    uint32_t credit_acked_[kInvalidWsId] = {0};     // responses since the window last grew
+    size_t credit_cut_tsc_[kInvalidWsId] = {0};     // last time the window shrank
+    std::atomic<uint32_t> credit_returned_[kInvalidWsId];   // credits returned by other workspaces
+    uint32_t credit_min_window_ = 0;
+    size_t credit_target_tsc_ = 0;
+    uint8_t *tx_dest_log_ = nullptr;            // remote dispatcher of each message in flight
+    /// Runtime message sizes, nullptr for the built-in sizes
+    SizeDist *req_sizes_ = nullptr;
+    SizeDist *resp_sizes_ = nullptr;
+    uint8_t *tx_size_log_ = nullptr;            // size bucket of each request in flight
+    /// Server: header fields of the requests being handled, echoed in their responses
+    struct echo_info {
+      uint64_t send_tsc_;
+      uint16_t msg_id_;
+      uint8_t src_ws_id_;
+      uint32_t resp_size_;      // response payload size
+    #if PERF_LAT_BREAKDOWN == 1
+      uint64_t client_tx_tsc_;
+      uint64_t server_rx_tsc_;
+    #endif
+    } rx_echo_[kWsQueueSize];
+    /// Server: reassembly of multi-packet requests, nullptr for single-packet requests
+    ReassemblyTable<MEM_REG_TYPE, kAppRequestPktsNum> *reasm_ = nullptr;
+    size_t rx_ready_msg_num_ = 0;               // reassembled messages waiting for a full batch
+    size_t reasm_timeout_tsc_ = 0;
+    size_t reasm_expire_tsc_ = 0;
     uint8_t workload_type_ = kInvalidWorkloadType; 
     uint8_t dispatcher_ws_id_ = kInvalidWsId;                  // A group of worker workspaces only have one dispatcher
     RuleTable *tx_rule_table_ = new RuleTable();
@@ -585,10 +1000,68 @@ class Workspace {
     /// Statistical parameters
     double freq_ghz_ = 0.0;
     struct net_stats *stats_ = new struct net_stats();
+    struct net_stats *drain_stats_ = nullptr;     // dispatchers: counts the loops after the timeout, discarded
+    SeqLock<stats_sample> stats_pub_;             // published for the stats monitor
+    size_t phase_tsc_ = 0;                        // cycle accounting: end of the previous phase
+    uint8_t instrument_level_ = kInstrumentFull;
+    uint32_t probe_scale_ = 1;                    // loops per loop with probes
+    uint32_t probe_countdown_ = 1;
+    bool probe_ = true;                           // the current loop takes probes
+    double rdtsc_cycles_ = 0;                     // cost of one timestamp, charged to instrumentation
+  #if PERF_HW_COUNTERS == 1
+    PerfCounters *hw_counters_ = nullptr;         // opened by the workspace thread, nullptr if unavailable
+    uint64_t hw_prev_[kHwEventNum] = {};
+  #endif
+    uint64_t stats_epoch_ = 0;
+    bool publish_ = false;
+    size_t publish_interval_tsc_ = 0;
+    size_t publish_next_tsc_ = 0;
+    size_t housekeeping_tsc_ = SIZE_MAX;          // next elastic step or publish, SIZE_MAX if neither
     bool stats_init_ws_ = false;
-    size_t nic_rx_prev_tick_ = 0, nic_rx_prev_desc_ = 0;
-    size_t lat_sample_vector[PERF_LAT_SAMPLE_NUM] = {0};
-    size_t lat_sample_idx = 0;
+    size_t nic_rx_prev_tick_ = 0, nic_rx_prev_desc_ = 0, nic_rx_probe_desc_ = 0;
+    lat_hists *lat_hists_ = nullptr;    // client workers only
+    Histogram *server_hist_ = nullptr;  // server workers: residency from RX dispatch to TX queue (PERF_LAT_BREAKDOWN)
+    uint8_t rx_policy_ = kSelectRR;     // how the dispatcher spreads this workload over its workers
+
+    /// Batch sizes the app rx and dispatcher tx stages wait for, adapted if kBatchTargetUs is set
+    BatchController rx_batch_, tx_batch_;
+    double batch_target_us_ = 0;
+    uint16_t disp_tx_batch_size_ = 0;     // the configured dispatcher tx batch size
+    size_t mempool_size_ = Dispatcher::kMemPoolSize;  // mbufs per dispatcher queue
+
+    /// Elastic mode (server app workspaces): parked by their dispatcher when a group needs fewer
+    UserConfig::elastic_config *elastic_config_ = nullptr;
+    bool elastic_ = false;                      // this workspace may be parked, or parks others
+    size_t elastic_interval_tsc_ = 0;
+    size_t elastic_next_tsc_ = 0;
+    size_t elastic_prev_tsc_ = 0;               // last control step, 0 before the first one
+    std::atomic<bool> parked_{false};
+    bool draining_ = false;                     // parked, handling what is left in the rx queue
+    std::atomic<size_t> busy_tsc_{0};
+    std::mutex park_mutex_;
+    std::condition_variable park_cv_;
+    /// Dispatchers: parkable app workspaces of each workload, the first active_ ones are active
+    struct elastic_group {
+      uint8_t workload_type_ = kInvalidWorkloadType;
+      std::vector<uint8_t> ws_ids_;
+      std::vector<lock_free_queue*> rx_queues_;
+      std::vector<size_t> prev_busy_tsc_;
+      size_t active_ = 0;
+      size_t min_active_ = 0;
+      ElasticController ctl_;
+    };
+    std::vector<elastic_group> elastic_groups_;
+
+    /// Extra execution ticks of each received message (kAppTicksPerMsg)
+    size_t app_ticks_per_msg_ = 0;
+
+    /// Daemon mode: the tunable params are re-read from here before each request
+    UserConfig *user_config_ = nullptr;
+
+    /// Work stealing (server workers)
+    bool steal_ = false;
+    size_t steal_min_backlog_ = 0;
+    std::vector<lock_free_queue*> steal_victims_;   // rx queues of the other workers of the group
 
     // key-value store instance
     KV* kv;
@@ -605,11 +1078,90 @@ class Workspace {
     */
     void register_ws();
     void set_mem_reg();
-    void set_dispatcher_config();
+    void set_dispatcher_config(UserConfig *user_config);
+    /**
+     * @brief Map ws_loop_ to a fused loop, kInterpretedLoop if there is no
+     * fused loop running the same phases in the same order
+    */
+    uint8_t select_fused_loop();
+
+    /* ----------------------For execution---------------------- */
+    template <uint8_t kPhases>
+    void run_event_loop(uint8_t iteration, uint8_t seconds);
+    void run_iterations(uint8_t iteration, uint8_t seconds);
+
+    /* ----------------------For elastic mode---------------------- */
+    void init_elastic();
+    /// Start an iteration with all app workspaces active
+    void reset_elastic();
+    /**
+     * @brief Run once per control interval: dispatchers park or unpark the app workspaces
+     * of their groups, a parked workspace sleeps once its rx queue is drained
+     * @return The current TSC, after the sleep if any
+    */
+    size_t elastic_step(size_t now_tsc, size_t end_tsc);
+
+    /* ----------------------For daemon mode---------------------- */
+    /**
+     * @brief Wait for a request that passes the checks of the constructor, 
+     * and commit its values to the user config
+     * \note Only the first active workspace serves requests, between two barriers
+    */
+    void serve_request();
+    /// Check the values of a request as the constructor checks the config file
+    static std::string check_tunables(UserConfig::tunable_params *tune, UserConfig::credit_config *credit, 
+                                      size_t mempool_size, size_t max_credit_dests);
+    /// Re-read the tunable params after a request was committed
+    void apply_tunables();
+
+    /// Packets and messages moved so far, a loop that does not change it is an empty poll
+    inline size_t loop_progress() {
+      return stats_->app_tx_msg_num + stats_->app_rx_msg_num 
+              + stats_->disp_tx_pkt_num + stats_->disp_rx_pkt_num + stats_->nic_tx_pkt_num;
+    }
+
+    /**
+     * @brief The periodic work of the event loop, i.e., elastic steps and publishing stats
+     * @return The current TSC
+    */
+    size_t housekeeping(size_t now_tsc, size_t end_tsc);
 
     /* ----------------------For statistics---------------------- */
-    void update_stats(uint8_t duration);
+    /// Cycles of the last iteration by bucket, they add up to window_
+    struct cycle_breakdown {
+      double useful_ = 0;         // phases that moved packets
+      double empty_ = 0;          // phases that polled nothing
+      double overhead_ = 0;       // the loop around the phases
+      double pacing_ = 0;         // waiting for the next loop, interval spin and backoff
+      double parked_ = 0;
+      double housekeeping_ = 0;
+      double instrument_ = 0;     // timestamps of the cycle accounting itself
+      double window_ = 0;
+      double phase_useful_[kLoopPhaseNum] = {};
+      double phase_empty_[kLoopPhaseNum] = {};
+      /// cycles a core has to provide, i.e., all but pacing and parked
+      inline double loaded() const { return window_ - pacing_ - parked_; }
+    };
+    cycle_breakdown get_cycle_breakdown();
+
+    /// Count this workspace as completed, the first one collects the stats after the barrier
+    void update_stats();
+    void collect_stats(uint8_t duration);
     void aggregate_stats(perf_stats *g_stats, double freq, uint8_t duration);
+    inline void publish_stats() {
+      stats_sample sample;
+      sample.epoch = stats_epoch_;
+      sample.app_tx_msg_num = stats_->app_tx_msg_num;
+      sample.app_rx_msg_num = stats_->app_rx_msg_num;
+      sample.disp_tx_pkt_num = stats_->disp_tx_pkt_num;
+      sample.disp_rx_pkt_num = stats_->disp_rx_pkt_num;
+      sample.nic_tx_pkt_num = stats_->nic_tx_pkt_num;
+      sample.nic_rx_pkt_num = stats_->nic_rx_pkt_num;
+      sample.drops = stats_->app_enqueue_drops + stats_->disp_enqueue_drops;
+      sample.loop_num = stats_->loop_num;
+      sample.idle_loop_num = stats_->idle_loop_num;
+      stats_pub_.store(sample);
+    }
 
     /* ----------------------DEBUG----------------------*/
     uint8_t mbuf_data_one_byte_ = 0;
@@ -16,10 +16,10 @@ namespace dperf {
 
         // [step 2] set the payload of a response with same size
         #if ApplyNewMbuf
-          set_payload(tx_mbuf_buffer_[i], (char*)uh, (char*)hdr, kAppRespPayloadSize);
+          set_payload(tx_mbuf_buffer_[i], (char*)uh, (char*)hdr, rx_echo_[i / kAppRequestPktsNum].resp_size_);
           // cp_payload(tx_mbuf_buffer_[i], *mbuf_ptr, (char*)uh, (char*)hdr, kAppRespPayloadSize);
         #else
-          set_payload(*mbuf_ptr, (char*)uh, (char*)hdr, kAppRespPayloadSize);
+          set_payload(*mbuf_ptr, (char*)uh, (char*)hdr, rx_echo_[i / kAppRequestPktsNum].resp_size_);
         #endif
         mbuf_ptr++;
       }
@@ -34,9 +34,9 @@ namespace dperf {
         // [step 2] set the payload of a response with same size
         #if ApplyNewMbuf
           // set_payload(tx_mbuf_buffer_[i], (char*)uh, (char*)hdr, kAppRespPayloadSize);
-          cp_payload(tx_mbuf_buffer_[i], *mbuf_ptr, (char*)uh, (char*)hdr, kAppRespPayloadSize);
+          cp_payload(tx_mbuf_buffer_[i], *mbuf_ptr, (char*)uh, (char*)hdr, rx_echo_[i / kAppRequestPktsNum].resp_size_);
         #else
-          set_payload(*mbuf_ptr, (char*)uh, (char*)hdr, kAppRespPayloadSize);
+          set_payload(*mbuf_ptr, (char*)uh, (char*)hdr, rx_echo_[i / kAppRequestPktsNum].resp_size_);
         #endif
         mbuf_ptr++;
       }
@@ -61,9 +61,9 @@ namespace dperf {
         // [step 3] set the payload of a response with same size
         #if ApplyNewMbuf        
           // set_payload(tx_mbuf_buffer_[i], (char*)uh, (char*)hdr, kAppRespPayloadSize);
-          cp_payload(tx_mbuf_buffer_[i], *mbuf_ptr, (char*)uh, (char*)hdr, kAppRespPayloadSize);
+          cp_payload(tx_mbuf_buffer_[i], *mbuf_ptr, (char*)uh, (char*)hdr, rx_echo_[i / kAppRequestPktsNum].resp_size_);
         #else
-          set_payload(*mbuf_ptr, (char*)uh, (char*)hdr, kAppRespPayloadSize);
+          set_payload(*mbuf_ptr, (char*)uh, (char*)hdr, rx_echo_[i / kAppRequestPktsNum].resp_size_);
         #endif
         mbuf_ptr++;
       }
@@ -93,9 +93,9 @@ namespace dperf {
       for (size_t i = 0; i < msg_num; i++) {
         // [step 3] set response payload
         #if ApplyNewMbuf
-          set_payload(tx_mbuf_buffer_[i], (char*)uh, (char*)hdr, kAppRespPayloadSize);
+          set_payload(tx_mbuf_buffer_[i], (char*)uh, (char*)hdr, rx_echo_[i].resp_size_);
         #else
-          set_payload(*mbuf_ptr, (char*)uh, (char*)hdr, kAppRespPayloadSize);
+          set_payload(*mbuf_ptr, (char*)uh, (char*)hdr, rx_echo_[i].resp_size_);
           mbuf_ptr++;
         #endif
       }
@@ -158,9 +158,9 @@ namespace dperf {
           kv->put_test(key,value);
 
           #if ApplyNewMbuf
-            cp_payload(tx_mbuf_buffer_[i], *mbuf_ptr, (char*)uh, (char*)hdr, kAppRespPayloadSize);
+            cp_payload(tx_mbuf_buffer_[i], *mbuf_ptr, (char*)uh, (char*)hdr, rx_echo_[i / kAppRequestPktsNum].resp_size_);
           #else
-            set_payload(*mbuf_ptr, (char*)uh, (char*)hdr, kAppRespPayloadSize);
+            set_payload(*mbuf_ptr, (char*)uh, (char*)hdr, rx_echo_[i / kAppRequestPktsNum].resp_size_);
           #endif
           mbuf_ptr++;
         // }
@@ -187,6 +187,22 @@ namespace dperf {
     // set workspace header of the response
     hdr.workload_type_ = workload_type_;
     hdr.segment_num_ = kAppReponsePktsNum;
+    hdr.resp_size_ = 0;
+
+    // keep what the responses echo, the handler may overwrite the request mbufs
+    for (size_t i = 0; i < msg_num; i++) {
+      ws_hdr *req_hdr = extract_ws_hdr(msg[i * kAppRequestPktsNum]);
+      rx_echo_[i].send_tsc_ = req_hdr->send_tsc_;
+      rx_echo_[i].msg_id_ = req_hdr->msg_id_;
+      rx_echo_[i].src_ws_id_ = req_hdr->src_ws_id_;
+      rx_echo_[i].resp_size_ = req_hdr->resp_size_ 
+          ? std::min<size_t>(req_hdr->resp_size_, kAppRespFullPaddingSize) : kAppRespPayloadSize;
+    #if PERF_LAT_BREAKDOWN == 1
+      ws_ts *req_ts = extract_ws_ts(msg[i * kAppRequestPktsNum]);
+      rx_echo_[i].client_tx_tsc_ = req_ts->client_tx_tsc_;
+      rx_echo_[i].server_rx_tsc_ = req_ts->server_ts_;
+    #endif
+    }
 
     // ------------------Begin of the message handler------------------
   #if ApplyNewMbuf
@@ -209,6 +225,24 @@ namespace dperf {
   #else
     mbuf_ptr = msg;
   #endif
+    /// Echo the header fields of each request in its response
+  #if PERF_LAT_BREAKDOWN == 1
+    size_t egress_tsc = rdtsc();
+  #endif
+    for (size_t i = 0; i < resp_pkt_num; i++) {
+      echo_info *echo = &rx_echo_[i / kAppReponsePktsNum];
+      ws_hdr *resp_hdr = extract_ws_hdr(mbuf_ptr[i]);
+      resp_hdr->send_tsc_ = echo->send_tsc_;
+      resp_hdr->msg_id_ = echo->msg_id_;
+      resp_hdr->src_ws_id_ = echo->src_ws_id_;
+      resp_hdr->seg_idx_ = i % kAppReponsePktsNum;
+    #if PERF_LAT_BREAKDOWN == 1
+      ws_ts *resp_ts = extract_ws_ts(mbuf_ptr[i]);
+      resp_ts->client_tx_tsc_ = echo->client_tx_tsc_;
+      resp_ts->server_ts_ = static_cast<uint64_t>(to_nsec(egress_tsc - echo->server_rx_tsc_, freq_ghz_));
+      if (i % kAppReponsePktsNum == 0) server_hist_->record(egress_tsc - echo->server_rx_tsc_);
+    #endif
+    }
     /// Insert packets to worker tx queue
     for (size_t i = 0; i < resp_pkt_num; i++) {
       if (unlikely(!tx_queue_->enqueue((uint8_t*)(*mbuf_ptr)))) {
@@ -0,0 +1,110 @@
+/**
+ * @file stats_monitor.h
+ * @brief A thread that samples the counters of running workspaces
+ */
+#pragma once
+#include "common.h"
+#include "workspace.h"
+#include "util/net_stats.h"
+#include "util/stats_shm.h"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <time.h>
+#include <vector>
+
+namespace dperf {
+/**
+ * Every interval, reads the counters each workspace publishes through a
+ * SeqLock, and prints the throughput of each stage over the interval. The
+ * datapath never waits for the monitor, so stats are sampled while it keeps
+ * running, not only at iteration boundaries. With a StatsShm, the samples are
+ * stored in the shared memory for axio_stat.py instead of printed.
+ */
+class StatsMonitor {
+ public:
+  StatsMonitor(WsContext *context, uint32_t interval_ms, size_t ws_num, StatsShm *shm = nullptr)
+      : context_(context), interval_ms_(interval_ms), ws_num_(ws_num), shm_(shm) {}
+
+  void start() {
+    thread_ = std::thread(&StatsMonitor::run, this);
+  }
+
+  /// Stop and join the monitor, before any workspace is destroyed
+  void stop() {
+    stop_.store(true);
+    if (thread_.joinable()) thread_.join();
+  }
+
+ private:
+  void run() {
+    auto start = std::chrono::steady_clock::now(), prev = start;
+    std::vector<uint8_t> ws_ids;
+    stats_sample prev_samples[kWorkspaceMaxNum];
+    while (!stop_.load()) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(interval_ms_));
+      auto now = std::chrono::steady_clock::now();
+      double elapsed_us = std::chrono::duration<double, std::micro>(now - prev).count();
+      prev = now;
+      /// wait until all workspaces are registered
+      if (ws_ids.size() < ws_num_) {
+        std::lock_guard<std::mutex> lock(context_->mutex_);
+        if (context_->active_ws_id_.size() < ws_num_) continue;
+        ws_ids = context_->active_ws_id_;
+        for (auto &ws_id : ws_ids) prev_samples[ws_id] = context_->ws_[ws_id]->get_stats_sample();
+        if (shm_ != nullptr) {
+          uint8_t ws_type[kWorkspaceMaxNum], workload_type[kWorkspaceMaxNum];
+          for (size_t i = 0; i < ws_ids.size(); i++) {
+            ws_type[i] = context_->ws_[ws_ids[i]]->get_ws_type();
+            workload_type[i] = (ws_type[i] & WORKER) ? context_->ws_[ws_ids[i]]->get_workload_type() : kInvalidWorkloadType;
+          }
+          shm_->set_workspaces(ws_ids.size(), ws_ids.data(), ws_type, workload_type);
+        }
+        continue;
+      }
+
+      if (shm_ != nullptr) {
+        stats_snapshot snapshot;
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        snapshot.time_ns = ts.tv_sec * 1000000000ull + ts.tv_nsec;
+        for (size_t i = 0; i < ws_ids.size(); i++) snapshot.ws_[i] = context_->ws_[ws_ids[i]]->get_stats_sample();
+        shm_->store(snapshot);
+        continue;
+      }
+
+      stats_sample delta;
+      for (auto &ws_id : ws_ids) {
+        stats_sample sample = context_->ws_[ws_id]->get_stats_sample();
+        stats_sample &last = prev_samples[ws_id];
+        /// a new iteration restarted the counters
+        if (sample.epoch != last.epoch) last = stats_sample();
+        delta.app_tx_msg_num += sample.app_tx_msg_num - last.app_tx_msg_num;
+        delta.app_rx_msg_num += sample.app_rx_msg_num - last.app_rx_msg_num;
+        delta.disp_tx_pkt_num += sample.disp_tx_pkt_num - last.disp_tx_pkt_num;
+        delta.disp_rx_pkt_num += sample.disp_rx_pkt_num - last.disp_rx_pkt_num;
+        delta.nic_tx_pkt_num += sample.nic_tx_pkt_num - last.nic_tx_pkt_num;
+        delta.nic_rx_pkt_num += sample.nic_rx_pkt_num - last.nic_rx_pkt_num;
+        delta.drops += sample.drops - last.drops;
+        delta.loop_num += sample.loop_num - last.loop_num;
+        delta.idle_loop_num += sample.idle_loop_num - last.idle_loop_num;
+        last = sample;
+      }
+      printf("[Stats %.3f s] Mpps app tx %.3f, app rx %.3f, disp tx %.3f, disp rx %.3f, nic tx %.3f, nic rx %.3f | %lu drops | %.2f%% empty polls\n",
+             std::chrono::duration<double>(now - start).count(),
+             delta.app_tx_msg_num / elapsed_us, delta.app_rx_msg_num / elapsed_us,
+             delta.disp_tx_pkt_num / elapsed_us, delta.disp_rx_pkt_num / elapsed_us,
+             delta.nic_tx_pkt_num / elapsed_us, delta.nic_rx_pkt_num / elapsed_us, delta.drops,
+             delta.loop_num ? 100.0 * delta.idle_loop_num / delta.loop_num : 0.0);
+    }
+  }
+
+  WsContext *context_;
+  const uint32_t interval_ms_;
+  const size_t ws_num_;
+  StatsShm *shm_;
+  std::atomic<bool> stop_{false};
+  std::thread thread_;
+};
+}  // namespace dperf
@@ -4,6 +4,8 @@
  * be called by various thread library such as pthread, datapath OS, DOCA, etc.
  */
 #include "workspace.h"
+#include "ws_impl/stats_monitor.h"
+#include "util/results_writer.h"
 
 namespace dperf {
 
@@ -17,7 +19,8 @@ Workspace<TDispatcher>::Workspace(WsContext *context, uint8_t ws_id, uint8_t ws_
       ws_type_(ws_type),
       numa_node_(numa_node),
       phy_port_(phy_port),
-      ws_loop_(ws_loop) {
+      ws_loop_(ws_loop),
+      freq_ghz_(context->tsc_freq_ghz_) {
 
   if (ws_type_ == 0) {
     DPERF_INFO("Workspace %u is not used\n", ws_id_);
@@ -36,28 +39,45 @@ Workspace<TDispatcher>::Workspace(WsContext *context, uint8_t ws_id, uint8_t ws_
   rt_assert(kAppTxMsgBatchSize <= kMaxBatchSize, "App TX batch size is too large");
   kAppRxMsgBatchSize = user_config->tune_params_->kAppRxMsgBatchSize;
   rt_assert(kAppRxMsgBatchSize <= kMaxBatchSize, "App RX batch size is too large");
+  pacing_ = (ws_type_ & DISPATCHER) ? user_config->disp_pacing_ : user_config->worker_pacing_;
+  batch_target_us_ = user_config->tune_params_->kBatchTargetUs;
+  disp_tx_batch_size_ = user_config->tune_params_->kDispTxBatchSize;
+  app_ticks_per_msg_ = user_config->tune_params_->kAppTicksPerMsg;
+  user_config_ = user_config;
+  elastic_config_ = user_config->elastic_config_;
+  publish_ = user_config->server_config_->stats_interval_ms > 0;
 
   // Check batch size to avoid deadlock
-  rt_assert(kInflyMessageBudget >= kAppTxMsgBatchSize, "kInflyMessageBudget is too small");
-  rt_assert(kInflyMessageBudget >= kAppRxMsgBatchSize, "kInflyMessageBudget is too small");
+  credit_config_ = user_config->credit_config_;
+  rt_assert(credit_config_->window_ >= kAppTxMsgBatchSize, "Credit window is too small");
+  rt_assert(credit_config_->window_ >= kAppRxMsgBatchSize, "Credit window is too small");
 
   // Check queue capacity is enough
   rt_assert(kWsQueueSize >= kAppTxMsgBatchSize, "Application TX queue size is too small");
   rt_assert(kWsQueueSize >= kAppRxMsgBatchSize, "Application RX queue size is too small");
 
   // Check memory pool size is enough
-  rt_assert(Dispatcher::kMemPoolSize >= kAppTxMsgBatchSize * kAppRequestPktsNum, "Mempool size is too small");
-  rt_assert(Dispatcher::kMemPoolSize >= kAppRxMsgBatchSize * kAppReponsePktsNum, "Mempool size is too small");
+  mempool_size_ = Dispatcher::derive_queue_sizes(user_config->footprint_config_, TDispatcher::kDmaBufSize, 
+                                                 TDispatcher::kRxRingInPool).mempool_;
+  rt_assert(mempool_size_ >= kAppTxMsgBatchSize * kAppRequestPktsNum, "Mempool size is too small");
+  rt_assert(mempool_size_ >= kAppRxMsgBatchSize * kAppReponsePktsNum, "Mempool size is too small");
 
   /* Init workspace, phase 1 */
   if (ws_type_ & WORKER) {
     workload_type_ = user_config->workloads_config_->ws_id_workload_map[ws_id_];
     uint8_t group_idx = user_config->workloads_config_->ws_id_group_idx_map[ws_id_];
     dispatcher_ws_id_ = user_config->workloads_config_->workload_dispatcher_map[workload_type_][group_idx];
-    /// config tx rule table
+    /// config tx rule table, and a credit window for each remote dispatcher
     for (auto &remote_dispatcher_ws_id : user_config->workloads_config_->workload_remote_dispatcher_map[workload_type_]) {
       tx_rule_table_->add_route(workload_type_, remote_dispatcher_ws_id);
+      credit_dests_.push_back(remote_dispatcher_ws_id);
+      credit_window_[remote_dispatcher_ws_id] = credit_config_->window_;
     }
+    /// tx_dest_log_ and tx_size_log_ are indexed by the 16-bit msg_id_, ids must not wrap onto a message in flight
+    rt_assert(credit_dests_.size() * credit_config_->max_window_ <= kTxMsgLogLen, 
+              "Credit windows allow more than 64K messages in flight");
+    for (auto &returned : credit_returned_) returned.store(0);
+    credit_min_window_ = std::max<uint32_t>(kAppTxMsgBatchSize, kAppRxMsgBatchSize);
     printf("Workspace %u is assigned to workload %u, dispatcher %u\n", ws_id_, workload_type_, dispatcher_ws_id_);
 
     if constexpr (kMemoryAccessRangePerPkt > 0) {
@@ -67,6 +87,55 @@ Workspace<TDispatcher>::Workspace(WsContext *context, uint8_t ws_id, uint8_t ws_
       stateful_memory_access_ptr_ = 0;
     }
 
+    if (NODE_TYPE == CLIENT) {
+      lat_hists_ = new lat_hists();
+      tx_dest_log_ = new uint8_t[kTxMsgLogLen]();
+    }
+    auto msg_size = user_config->workloads_config_->workload_msg_size_map.find(workload_type_);
+    if (NODE_TYPE == CLIENT && msg_size != user_config->workloads_config_->workload_msg_size_map.end()) {
+      req_sizes_ = new SizeDist();
+      double clamped = req_sizes_->init(msg_size->second.req_, false, kAppMinReqSize, kAppMaxReqSize);
+      if (clamped > 0) {
+        DPERF_WARN("Workspace %u: %.2f%% of request sizes clamped to [%zu, %zu] B\n", ws_id_, 100 * clamped, kAppMinReqSize, kAppMaxReqSize);
+      }
+      if (msg_size->second.resp_.type_ != kSizeBuiltin) {
+        rt_assert(kAppReponsePktsNum == 1, "Runtime response sizes need single-packet responses");
+        resp_sizes_ = new SizeDist();
+        /// a zero resp_size_ stands for the built-in size
+        size_t min_resp_size = std::max<size_t>(kAppMinPaddingSize, 1);
+        clamped = resp_sizes_->init(msg_size->second.resp_, true, min_resp_size, kAppRespFullPaddingSize);
+        if (clamped > 0) {
+          DPERF_WARN("Workspace %u: %.2f%% of response sizes clamped to [%zu, %zu] B\n", ws_id_, 100 * clamped, min_resp_size, kAppRespFullPaddingSize);
+        }
+      }
+      tx_size_log_ = new uint8_t[kTxMsgLogLen]();
+    }
+    if (NODE_TYPE == CLIENT && user_config->load_config_->open_loop_) {
+      load_config_ = user_config->load_config_;
+      schedule_ = new ArrivalSchedule();
+    }
+
+    auto rx_policy = user_config->workloads_config_->workload_rx_policy_map.find(workload_type_);
+    if (rx_policy != user_config->workloads_config_->workload_rx_policy_map.end()) rx_policy_ = rx_policy->second.policy_;
+    if (NODE_TYPE == SERVER) {
+      server_hist_ = new Histogram();
+    }
+    if (user_config->steal_config_->enabled_) {
+      if (NODE_TYPE == SERVER && kAppRequestPktsNum == 1) {
+        steal_ = true;
+        steal_min_backlog_ = user_config->steal_config_->min_backlog_ ? user_config->steal_config_->min_backlog_ : 2 * kAppRxMsgBatchSize;
+      } else {
+        DPERF_WARN("Workspace %u: work stealing needs single-packet requests on the server, disabled\n", ws_id_);
+      }
+    }
+
+    /// app workspaces that are also dispatchers are never parked
+    elastic_ = elastic_config_->enabled_ && NODE_TYPE == SERVER && kAppRequestPktsNum == 1 && ws_type_ == WORKER;
+
+    if (NODE_TYPE == SERVER && kAppRequestPktsNum > 1) {
+      reasm_ = new ReassemblyTable<MEM_REG_TYPE, kAppRequestPktsNum>();
+    }
+
     if (kRxMsgHandler == kRxMsgHandler_KV && NODE_TYPE == SERVER) {
       size_t initial_map_size = 10000;
       kv = new KV(initial_map_size);
@@ -74,6 +143,8 @@ Workspace<TDispatcher>::Workspace(WsContext *context, uint8_t ws_id, uint8_t ws_
   }
   if (ws_type_ & DISPATCHER) {
     dispatcher_ = new TDispatcher(ws_id_, phy_port_, numa_node_, user_config);
+    drain_stats_ = new struct net_stats();
+    net_stats_init(drain_stats_);
   }
   // Register this workspace to ws context. Then, workspace can communicate with
   // each other through ws context.
@@ -82,6 +153,19 @@ Workspace<TDispatcher>::Workspace(WsContext *context, uint8_t ws_id, uint8_t ws_
   // Wait for all workspaces to be registered
   wait();
 
+#ifdef RoceMode
+  // One dispatcher exchanges the QP info of all local dispatchers with the
+  // remote host, then every dispatcher brings up its own QPs in parallel
+  if (ws_type_ & DISPATCHER && ws_id_ == (context_->local_qp_info_.begin()->first >> 8)) {
+    TDispatcher::exchange_qp_info(dispatcher_->kRemoteIpStr, context_->local_qp_info_,
+                                  &context_->remote_qp_info_);
+  }
+  wait();
+  if (ws_type_ & DISPATCHER) {
+    dispatcher_->connect_qps(&context_->remote_qp_info_);
+  }
+#endif
+
   /* Init workspace, phase 2 */
   if (ws_type_ & WORKER) {
     set_mem_reg();
@@ -89,15 +173,42 @@ Workspace<TDispatcher>::Workspace(WsContext *context, uint8_t ws_id, uint8_t ws_
       DPERF_ERROR("Workspace %u cannot get mem_reg\n", ws_id_);
       return;
     }
+    if (steal_) {
+      uint8_t group_idx = user_config->workloads_config_->ws_id_group_idx_map[ws_id_];
+      for (auto &sibling_ws_id : *user_config->workloads_config_->workload_appws_map[workload_type_][group_idx]) {
+        if (sibling_ws_id != ws_id_) steal_victims_.push_back(context_->ws_rx_queue_map_[sibling_ws_id]);
+      }
+    }
   }
   if (ws_type_ & DISPATCHER) {
     /// config rx rule table and workspace queues
-    set_dispatcher_config();
+    set_dispatcher_config(user_config);
     if (dispatcher_->get_ws_tx_queue_size() == 0) {
       DPERF_ERROR("Failed to config dispatcher %u\n", ws_id_);
       return;
     }
+    if (elastic_config_->enabled_) {
+      if (NODE_TYPE == SERVER && kAppRequestPktsNum == 1) {
+        init_elastic();
+      } else {
+        DPERF_WARN("Workspace %u: elastic mode needs single-packet requests on the server, disabled\n", ws_id_);
+      }
+    }
+  }
+  fused_loop_ = select_fused_loop();
+#if PERF_HW_COUNTERS == 1
+  /// counters of this thread, the constructor runs on the workspace thread
+  hw_counters_ = new PerfCounters();
+  if (!hw_counters_->enabled()) {
+    delete hw_counters_;
+    hw_counters_ = nullptr;
+  } else {
+    DPERF_INFO("Workspace %u reads hardware counters with %s\n", ws_id_, hw_counters_->use_rdpmc() ? "rdpmc" : "read()");
   }
+#endif
+  instrument_level_ = user_config->instrument_config_->level_;
+  probe_scale_ = (instrument_level_ == kInstrumentSampled) ? user_config->instrument_config_->period_ : 1;
+  probe_countdown_ = probe_scale_;
   wait();   // Force sync before launch
 }
 
@@ -105,6 +216,11 @@ template <class TDispatcher>
 Workspace<TDispatcher>::~Workspace(){
   DPERF_INFO("Destroying Ws %u.\n", ws_id_);
   delete dispatcher_;
+  /// the private copy of set_mem_reg(), its cache belongs to the dispatcher's slab
+  delete mem_reg_;
+#if PERF_HW_COUNTERS == 1
+  delete hw_counters_;
+#endif
 }
 
 template <class TDispatcher>
@@ -124,17 +240,24 @@ void Workspace<TDispatcher>::register_ws() {
       return;
     }
     context_->mem_reg_map_.insert(std::make_pair(ws_id_, dispatcher_->get_mem_reg()));
+  #ifdef RoceMode
+    dispatcher_->publish_qp_info(&context_->local_qp_info_);
+  #endif
   }
 }
 
 template <class TDispatcher>
 void Workspace<TDispatcher>::set_mem_reg() {
   std::lock_guard<std::mutex> lock(context_->mutex_);
-  mem_reg_ = context_->mem_reg_map_[dispatcher_ws_id_];
+  Dispatcher::mem_reg_info<MEM_REG_TYPE> *shared_mem_reg = context_->mem_reg_map_[dispatcher_ws_id_];
+  if (shared_mem_reg == nullptr) return;
+  /// allocate through a handle private to this workspace
+  mem_reg_ = new Dispatcher::mem_reg_info<MEM_REG_TYPE>(*shared_mem_reg);
+  mem_reg_->dispatcher_mr_ = shared_mem_reg->local_mr_(shared_mem_reg->dispatcher_mr_);
 }
 
 template <class TDispatcher>
-void Workspace<TDispatcher>::set_dispatcher_config() {
+void Workspace<TDispatcher>::set_dispatcher_config(UserConfig *user_config) {
   std::lock_guard<std::mutex> lock(context_->mutex_);
   for (auto &ws_id : context_->active_ws_id_) {
     auto it = context_->ws_id_dispatcher_map_.find(ws_id);
@@ -143,11 +266,118 @@ void Workspace<TDispatcher>::set_dispatcher_config() {
       uint8_t workload_type = context_->ws_[ws_id]->get_workload_type();
       dispatcher_->add_ws_tx_queue(context_->ws_tx_queue_map_[ws_id]);
       dispatcher_->add_ws_rx_queue(ws_id, context_->ws_rx_queue_map_[ws_id]);
-      dispatcher_->add_rx_rule(workload_type, ws_id);
+      dispatcher_->add_rx_rule(workload_type, ws_id, user_config->workloads_config_->get_rx_weight(workload_type, ws_id));
+      auto policy = user_config->workloads_config_->workload_rx_policy_map.find(workload_type);
+      if (policy != user_config->workloads_config_->workload_rx_policy_map.end()) 
+        dispatcher_->set_rx_policy(workload_type, policy->second.policy_);
+    }
+  }
+}
+
+template <class TDispatcher>
+void Workspace<TDispatcher>::init_elastic() {
+  std::lock_guard<std::mutex> lock(context_->mutex_);
+  std::map<uint8_t, elastic_group> groups;
+  for (auto &ws_id : context_->active_ws_id_) {
+    auto it = context_->ws_id_dispatcher_map_.find(ws_id);
+    if (it == context_->ws_id_dispatcher_map_.end() || it->second != ws_id_ || context_->ws_[ws_id]->get_ws_type() != WORKER) 
+      continue;
+    elastic_group &group = groups[context_->ws_[ws_id]->get_workload_type()];
+    group.ws_ids_.push_back(ws_id);
+    group.rx_queues_.push_back(context_->ws_rx_queue_map_[ws_id]);
+  }
+  for (auto &it : groups) {
+    elastic_group &group = it.second;
+    if (group.ws_ids_.size() <= elastic_config_->min_active_) continue;
+    group.workload_type_ = it.first;
+    group.active_ = group.ws_ids_.size();
+    group.min_active_ = elastic_config_->min_active_;
+    group.prev_busy_tsc_.assign(group.ws_ids_.size(), 0);
+    elastic_groups_.push_back(group);
+    printf("Workspace %u parks up to %zu of the %zu app workspaces of workload %u\n", ws_id_, 
+           group.ws_ids_.size() - group.min_active_, group.ws_ids_.size(), it.first);
+  }
+  elastic_ = !elastic_groups_.empty();
+}
+
+template <class TDispatcher>
+void Workspace<TDispatcher>::reset_elastic() {
+  elastic_interval_tsc_ = us_to_cycles(elastic_config_->interval_us_, freq_ghz_);
+  elastic_prev_tsc_ = 0;
+  draining_ = false;
+  for (auto &group : elastic_groups_) {
+    for (size_t i = group.active_; i < group.ws_ids_.size(); i++) {
+      dispatcher_->get_rx_rule_table()->add_route(group.workload_type_, group.ws_ids_[i]);
+      context_->ws_[group.ws_ids_[i]]->unpark();
     }
+    group.active_ = group.ws_ids_.size();
+    group.ctl_.init(elastic_config_->park_util_, elastic_config_->unpark_util_, elastic_config_->hold_, 2 * kAppRxMsgBatchSize);
   }
 }
 
+template <class TDispatcher>
+size_t Workspace<TDispatcher>::elastic_step(size_t now_tsc, size_t end_tsc) {
+  elastic_next_tsc_ = now_tsc + elastic_interval_tsc_;
+  /// dispatchers: observe the interval of each group, the first step only takes the counters
+  size_t elapsed_tsc = now_tsc - elastic_prev_tsc_;
+  for (auto &group : elastic_groups_) {
+    size_t busy_tsc = 0, backlog = 0;
+    for (size_t i = 0; i < group.ws_ids_.size(); i++) {
+      size_t ws_busy_tsc = context_->ws_[group.ws_ids_[i]]->get_busy_tsc();
+      if (i < group.active_) {
+        busy_tsc += ws_busy_tsc - group.prev_busy_tsc_[i];
+        backlog += group.rx_queues_[i]->get_size();
+      }
+      group.prev_busy_tsc_[i] = ws_busy_tsc;
+    }
+    if (elastic_prev_tsc_ == 0) continue;
+    double util = static_cast<double>(busy_tsc) / (elapsed_tsc * group.active_);
+    int change = group.ctl_.step(util, backlog, group.active_, group.min_active_, group.ws_ids_.size(), elapsed_tsc);
+    if (change > 0) {
+      uint8_t ws_id = group.ws_ids_[group.active_++];
+      dispatcher_->get_rx_rule_table()->add_route(group.workload_type_, ws_id);
+      context_->ws_[ws_id]->unpark();
+    } else if (change < 0) {
+      uint8_t ws_id = group.ws_ids_[--group.active_];
+      dispatcher_->get_rx_rule_table()->remove_route(group.workload_type_, ws_id);
+      context_->ws_[ws_id]->park();
+    }
+  }
+  elastic_prev_tsc_ = now_tsc;
+
+  /// app workspaces: once parked, drain the rx queue, then sleep until unparked or the iteration ends
+  draining_ = parked_.load(std::memory_order_acquire);
+  if (!draining_ || rx_queue_->get_size() != 0) return now_tsc;
+  {
+    std::unique_lock<std::mutex> lock(park_mutex_);
+    while (parked_.load(std::memory_order_acquire) && rdtsc() < end_tsc) {
+      park_cv_.wait_for(lock, std::chrono::milliseconds(1));
+    }
+  }
+  draining_ = false;
+  size_t wake_tsc = rdtsc();
+  net_stats_app_park(wake_tsc - now_tsc);
+  return wake_tsc;
+}
+
+template <class TDispatcher>
+size_t Workspace<TDispatcher>::housekeeping(size_t now_tsc, size_t end_tsc) {
+#if PERF_CYCLE_ACCOUNTING == 1
+  size_t start_tsc = now_tsc;
+#endif
+  if (elastic_ && now_tsc >= elastic_next_tsc_) now_tsc = elastic_step(now_tsc, end_tsc);
+  if (publish_ && now_tsc >= publish_next_tsc_) {
+    publish_stats();
+    publish_next_tsc_ = now_tsc + publish_interval_tsc_;
+  }
+  housekeeping_tsc_ = std::min(elastic_ ? elastic_next_tsc_ : SIZE_MAX, publish_ ? publish_next_tsc_ : SIZE_MAX);
+#if PERF_CYCLE_ACCOUNTING == 1
+  now_tsc = rdtsc();
+  net_stats_housekeeping(now_tsc - start_tsc);
+#endif
+  return now_tsc;
+}
+
 template <class TDispatcher>
 void Workspace<TDispatcher>::launch() {
   for (auto &phase : *ws_loop_) {
@@ -155,6 +385,43 @@ void Workspace<TDispatcher>::launch() {
   }
 }
 
+template <class TDispatcher>
+uint8_t Workspace<TDispatcher>::select_fused_loop() {
+  /// phases in the order a fused loop runs them
+  static const std::vector<std::pair<uint8_t, phase_t>> kFusedOrder = {
+    {kPhaseNicRx, &Workspace<DISPATCHER_TYPE>::nic_rx},
+    {kPhaseBurstedRx, &Workspace<DISPATCHER_TYPE>::bursted_rx},
+    {kPhaseAppHandler, &Workspace<DISPATCHER_TYPE>::app_handler},
+    {kPhaseApplyMbufs, &Workspace<DISPATCHER_TYPE>::apply_mbufs},
+    {kPhaseGeneratePkts, &Workspace<DISPATCHER_TYPE>::generate_pkts},
+    {kPhaseBurstedTx, &Workspace<DISPATCHER_TYPE>::bursted_tx},
+    {kPhaseNicTx, &Workspace<DISPATCHER_TYPE>::nic_tx},
+  };
+  uint8_t phases = 0;
+  size_t order_idx = 0;
+  for (auto &phase : *ws_loop_) {
+    /// the phase must appear after the previous one in the fused order
+    while (order_idx < kFusedOrder.size() && kFusedOrder[order_idx].second != phase) order_idx++;
+    if (order_idx == kFusedOrder.size()) {
+      DPERF_INFO("Workspace %u runs an interpreted loop of %lu phases\n", ws_id_, ws_loop_->size());
+      return kInterpretedLoop;
+    }
+    phases |= kFusedOrder[order_idx].first;
+  }
+  switch (phases) {
+    case kDispatcherLoop:
+    case kServerWorkerLoop:
+    case kClientWorkerLoop:
+    case kServerDispWorkerLoop:
+    case kClientDispWorkerLoop:
+      DPERF_INFO("Workspace %u runs fused loop 0x%x\n", ws_id_, phases);
+      return phases;
+    default:
+      DPERF_INFO("Workspace %u runs an interpreted loop of %lu phases\n", ws_id_, ws_loop_->size());
+      return kInterpretedLoop;
+  }
+}
+
 template <class TDispatcher>
 void Workspace<TDispatcher>::aggregate_stats(perf_stats *g_stats, double freq, uint8_t duration){
   /// App
@@ -291,7 +558,7 @@ void Workspace<TDispatcher>::aggregate_stats(perf_stats *g_stats, double freq, u
     "App rx avg num: %.2f\n",
     ws_id_, 
     stats_->app_apply_mbuf_stalls,
-    (double)stats_->mbuf_usage/stats_->mbuf_alloc_times/Dispatcher::kMemPoolSize,
+    (double)stats_->mbuf_usage/stats_->mbuf_alloc_times/mempool_size_,
     stats_->app_tx_mbuf_trace_addr == nullptr
       ? (double)(stats_->app_tx_mbuf_reuse_interval) / (double)(stats_->app_tx_nb_traced_mbuf)
       : (double)(stats_->app_tx_mbuf_reuse_interval) / (double)(stats_->app_tx_nb_traced_mbuf - 1),
@@ -299,6 +566,124 @@ void Workspace<TDispatcher>::aggregate_stats(perf_stats *g_stats, double freq, u
     stats_->disp_enqueue_drops,
     self_app_rx_batch
   );
+  /// Loop overhead, an empty poll costs the loop itself plus polling the queues
+  if (stats_->loop_num) {
+    size_t loaded_loop_num = stats_->loop_num - stats_->idle_loop_num;
+    printf("[Workspace %u] Loop: %lu loops, %.2f%% empty polls, %.1f ns/empty poll, %.1f ns/loaded loop, %.2f%% time in backoff\n",
+      ws_id_, stats_->loop_num, 100.0 * stats_->idle_loop_num / stats_->loop_num,
+      stats_->idle_loop_num ? to_nsec(stats_->idle_loop_duration, freq) / stats_->idle_loop_num : 0.0,
+      loaded_loop_num ? to_nsec(stats_->loop_duration - stats_->idle_loop_duration, freq) / loaded_loop_num : 0.0,
+      100.0 * to_sec(stats_->backoff_duration, freq) / duration);
+  }
+  if (instrument_level_ != kInstrumentOff) {
+    printf("[Workspace %u] Instrumentation: %s, %lu loops with probes, %.1f cycles (%.1f ns) per probe, "
+           "stage durations include it once per sample\n", ws_id_,
+           instrument_level_ == kInstrumentFull ? "full" : "sampled", stats_->probe_loop_num,
+           stats_->probe_cycles, stats_->probe_cycles / freq);
+  }
+#if PERF_CYCLE_ACCOUNTING == 1
+  /// where all cycles went, and what a message costs with the overhead
+  if (stats_->window_duration && instrument_level_ != kInstrumentOff) {
+    cycle_breakdown cycles = get_cycle_breakdown();
+    auto __pct = [&](double c) { return 100.0 * c / cycles.window_; };
+    printf("[Workspace %u] Cycles: useful %.1f%%, empty polls %.1f%%, loop overhead %.1f%%, pacing/idle %.1f%%, "
+           "parked %.1f%%, housekeeping %.1f%%, instrumentation %.1f%%\n", ws_id_, __pct(cycles.useful_),
+           __pct(cycles.empty_), __pct(cycles.overhead_), __pct(cycles.pacing_), __pct(cycles.parked_),
+           __pct(cycles.housekeeping_), __pct(cycles.instrument_));
+    printf("[Workspace %u]   useful/empty by phase:", ws_id_);
+    for (size_t phase = 0; phase < kLoopPhaseNum; phase++) {
+      if (stats_->phase_calls[phase] == 0) continue;
+      printf(" %s %.1f%%/%.1f%%", kLoopPhaseName[phase], __pct(cycles.phase_useful_[phase]), __pct(cycles.phase_empty_[phase]));
+    }
+    printf("\n");
+    /// app workspaces are sized by messages, dispatchers by packets
+    bool app = ws_type_ & WORKER;
+    uint64_t units = app ? stats_->app_rx_msg_num : stats_->disp_rx_pkt_num + stats_->disp_tx_pkt_num;
+    if (units) {
+      printf("[Workspace %u]   %.1f cycles/%s with overhead (%.1f useful), core %.1f%% loaded\n", ws_id_,
+             cycles.loaded() / units, app ? "msg" : "pkt", cycles.useful_ / units, __pct(cycles.loaded()));
+    }
+  }
+#endif
+#if PERF_HW_COUNTERS == 1
+  if (hw_counters_ != nullptr) {
+    char prefix[32];
+    snprintf(prefix, sizeof(prefix), "[Workspace %u] HW", ws_id_);
+    print_hw_phases(prefix, stats_->hw_, stats_);
+  }
+#endif
+  if (schedule_ != nullptr) {
+    printf("[Workspace %u] Open loop: offered %.3f Mmsgs/s, sent late: %lu (%.2f%%)\n", ws_id_,
+      load_config_->rate_ / 1e6, stats_->app_tx_late_num,
+      stats_->app_tx_msg_num ? 100.0 * stats_->app_tx_late_num * kAppRequestPktsNum / stats_->app_tx_msg_num : 0.0);
+  }
+  if (batch_target_us_ > 0) {
+    auto __print_batch = [](const char *stage, const BatchController &ctl) {
+      auto &batch_stats = ctl.get_stats();
+      if (batch_stats.run_num_ == 0) return;
+      printf(" %s avg %.1f (%zu - %zu), now %zu;", stage, (double)batch_stats.batch_sum_ / batch_stats.run_num_,
+        batch_stats.min_, batch_stats.max_, ctl.get());
+    };
+    printf("[Workspace %u] Adaptive batch sizes:", ws_id_);
+    if (ws_type_ & WORKER) __print_batch("app rx", rx_batch_);
+    if (ws_type_ & DISPATCHER) __print_batch("dispatcher tx", tx_batch_);
+    printf("\n");
+  }
+  if (elastic_ && (ws_type_ & WORKER)) {
+    printf("[Workspace %u] Elastic: parked %.2f%% of the time\n", ws_id_, 100.0 * to_sec(stats_->app_park_duration, freq) / duration);
+  }
+  if (ws_type_ & WORKER) {
+    g_stats->app_cores_ += 1.0 - std::min(to_sec(stats_->app_park_duration, freq) / duration, 1.0);
+  }
+  if (steal_) {
+    printf("[Workspace %u] Work stealing: %lu attempts, %lu successful, %lu msgs stolen (%.2f%% of handled)\n", ws_id_,
+      stats_->app_steal_attempts, stats_->app_steal_successes, stats_->app_stolen_msg_num,
+      stats_->app_rx_msg_num ? 100.0 * stats_->app_stolen_msg_num / stats_->app_rx_msg_num : 0.0);
+  }
+#if EnableInflyMessageLimit
+  if (NODE_TYPE == CLIENT && (ws_type_ & WORKER) && schedule_ == nullptr) {
+    printf("[Workspace %u] Credits (remote: in flight/window):", ws_id_);
+    for (auto &dest : credit_dests_) {
+      printf(" %u: %u/%u", dest, credit_infly_[dest] - credit_returned_[dest].load(std::memory_order_relaxed), credit_window_[dest]);
+    }
+    printf("\n");
+  }
+#endif
+  if (ws_type_ & DISPATCHER) {
+    /// the buffers the NIC DMAs into, what has to fit the DDIO ways of the LLC
+    printf("[Workspace %u] DMA footprint: %.1f KB, %lu RX / %lu TX descriptors, %lu mbufs of %lu B\n", ws_id_,
+      (double)dispatcher_->dma_footprint_ / KB(1), dispatcher_->rx_ring_size_, dispatcher_->tx_ring_size_,
+      dispatcher_->mempool_size_, TDispatcher::kDmaBufSize);
+    g_stats->disp_dma_footprint_ += (double)dispatcher_->dma_footprint_ / KB(1);
+    RuleTable *rx_rule_table = dispatcher_->get_rx_rule_table();
+    std::set<uint8_t> workload_types;
+    for (auto &ws_id : context_->active_ws_id_) {
+      auto it = context_->ws_id_dispatcher_map_.find(ws_id);
+      if (it != context_->ws_id_dispatcher_map_.end() && it->second == ws_id_) 
+        workload_types.insert(context_->ws_[ws_id]->get_workload_type());
+    }
+    for (auto &workload_type : workload_types) {
+      auto &rule_stats = rx_rule_table->get_stats(workload_type);
+      size_t total = rule_stats.msg_num_ + rule_stats.drops_;
+      printf("[Workspace %u] RX dispatch of workload %u (%s): %lu pkts, %lu dropped (%.2f%%)\n", ws_id_, workload_type,
+        select_policy_name(rx_rule_table->get_policy(workload_type)), rule_stats.msg_num_, rule_stats.drops_,
+        total ? 100.0 * rule_stats.drops_ / total : 0.0);
+    }
+    for (auto &group : elastic_groups_) {
+      auto &elastic_stats = group.ctl_.get_stats();
+      if (elastic_stats.elapsed_tsc_ == 0) continue;
+      printf("[Workspace %u] Elastic app workspaces of workload %u: avg %.2f (%zu - %zu) of %zu active, now %zu, %zu parks, %zu unparks\n",
+        ws_id_, group.workload_type_, (double)elastic_stats.active_tsc_ / elastic_stats.elapsed_tsc_, 
+        elastic_stats.min_active_, elastic_stats.max_active_, group.ws_ids_.size(), group.active_,
+        elastic_stats.parks_, elastic_stats.unparks_);
+    }
+  }
+  if (reasm_ != nullptr) {
+    auto &reasm_stats = reasm_->get_stats();
+    printf("[Workspace %u] Reassembly: %lu messages, %lu pending, incomplete(expired %lu, evicted %lu), dropped segments(duplicate %lu, invalid %lu)\n", 
+      ws_id_, reasm_stats.msg_num_, reasm_->get_pending(), reasm_stats.expired_, reasm_stats.evicted_, 
+      reasm_stats.dup_segs_, reasm_stats.invalid_segs_);
+  }
   printf("[Workspace %u] TX Breakdown: throughput(App%.3f, Disp%.3f, NIC%.3f), latency(%.3f, %.3f, %.3f)\n", ws_id_, self_app_tx_tp, self_disp_tx_tp, self_nic_tx_tp, self_app_tx_compl + self_app_tx_stall, self_disp_tx_compl + self_disp_tx_stall, self_nic_tx_compl);
   printf("[Workspace %u] RX Breakdown: throughput(App%.3f, Disp%.3f, NIC%.3f), latency(%.3f, %.3f, %.3f)\n", ws_id_, self_app_rx_tp, self_disp_rx_tp, self_nic_rx_tp, self_app_rx_compl + self_app_rx_stall, self_disp_rx_compl + self_disp_rx_stall, self_nic_rx_compl);
   #ifdef OneStage
@@ -307,149 +692,491 @@ void Workspace<TDispatcher>::aggregate_stats(perf_stats *g_stats, double freq, u
   #endif
 
   if(likely(stats_->mbuf_alloc_times > 0)){
-    g_stats->disp_mbuf_usage += (double)(stats_->mbuf_usage) / (double)(stats_->mbuf_alloc_times) / (double)(Dispatcher::kMemPoolSize);
-    // printf("mbuf_usage: %lu, mbuf_alloc_times: %u, mempool size: %lu, usage: %lf\n", stats_->mbuf_usage, stats_->mbuf_alloc_times, Dispatcher::kMemPoolSize, g_stats->disp_mbuf_usage);
+    g_stats->disp_mbuf_usage += (double)(stats_->mbuf_usage) / (double)(stats_->mbuf_alloc_times) / (double)(mempool_size_);
+    // printf("mbuf_usage: %lu, mbuf_alloc_times: %u, mempool size: %lu, usage: %lf\n", stats_->mbuf_usage, stats_->mbuf_alloc_times, mempool_size_, g_stats->disp_mbuf_usage);
   } else {
     g_stats->disp_mbuf_usage += 0.0f;
   }
 }
 
 template <class TDispatcher>
-void Workspace<TDispatcher>::update_stats(uint8_t duration) {
+double Workspace<TDispatcher>::measure_probe_cost() {
+  static constexpr size_t kProbeNum = 1000;
+  /// time a duration probe into scratch stats, so the iteration starts from zero
+  net_stats *stats = stats_, scratch;
+  net_stats_init(&scratch);
+  stats_ = &scratch;
+  bool probe = probe_;
+  uint32_t scale = probe_scale_;
+  probe_ = true;
+  probe_scale_ = 1;
+  size_t start = rdtsc();
+  for (size_t i = 0; i < kProbeNum; i++) {
+    size_t s_tick = rdtsc();
+    net_stats_disp_tx_duration(s_tick);
+  }
+  double cycles = (double)(rdtsc() - start) / kProbeNum;
+  probe_ = probe;
+  probe_scale_ = scale;
+  stats_ = stats;
+  delete[] scratch.hists;
+  return cycles;
+}
+
+template <class TDispatcher>
+typename Workspace<TDispatcher>::cycle_breakdown Workspace<TDispatcher>::get_cycle_breakdown() {
+  cycle_breakdown cycles;
+  cycles.window_ = stats_->window_duration;
+  /// each loop with probes took one timestamp, and each phase call timed in it another
+  cycles.instrument_ = stats_->probe_loop_num * rdtsc_cycles_;
+  double phases = 0;
+  for (size_t phase = 0; phase < kLoopPhaseNum; phase++) {
+    double raw = stats_->phase_busy_duration[phase] + stats_->phase_empty_duration[phase];
+    if (raw == 0) continue;
+    /// sampled durations are extrapolated to all loops, the timestamps were only taken in probe loops
+    double scale = std::max(0.0, raw - stats_->phase_calls[phase] * rdtsc_cycles_ * probe_scale_) / raw;
+    cycles.phase_useful_[phase] = stats_->phase_busy_duration[phase] * scale;
+    cycles.phase_empty_[phase] = stats_->phase_empty_duration[phase] * scale;
+    cycles.useful_ += cycles.phase_useful_[phase];
+    cycles.empty_ += cycles.phase_empty_[phase];
+    cycles.instrument_ += stats_->phase_calls[phase] * rdtsc_cycles_;
+    phases += raw * scale;
+  }
+  cycles.pacing_ = stats_->pacing_duration + stats_->backoff_duration;
+  cycles.parked_ = stats_->app_park_duration;
+  cycles.housekeeping_ = std::max(0.0, (double)stats_->housekeeping_duration - cycles.parked_);
+  cycles.overhead_ = std::max(0.0, cycles.window_ - phases - cycles.pacing_ - stats_->housekeeping_duration
+                                   - cycles.instrument_);
+  return cycles;
+}
+
+template <class TDispatcher>
+void Workspace<TDispatcher>::update_stats() {
   std::lock_guard<std::mutex> lock(context_->mutex_);
   context_->completed_ws_num_++;
   // printf("[Workspace %u] Completed\n", ws_id_);
+  /// The first ws will collect all ws stats, once all of them stopped
   if (!context_->end_signal_) {
     context_->end_signal_ = true;
-    /// The first ws will collect all ws stats
-    uint8_t worker_num = 0, dispatcher_num = 0;
-    std::vector<double> ws_freq;
-    for (auto &ws_id : context_->active_ws_id_) {
-      double freq = context_->ws_[ws_id]->get_freq();
-      context_->ws_[ws_id]->aggregate_stats(context_->perf_stats_, freq, duration);
-      if (context_->ws_[ws_id]->get_ws_type() & WORKER) {
-        worker_num++;
-      }
-      if (context_->ws_[ws_id]->get_ws_type() & DISPATCHER) {
-        dispatcher_num++;
-      }
-      ws_freq.push_back(freq);
+    stats_init_ws_ = true;
+  }
+}
+
+template <class TDispatcher>
+void Workspace<TDispatcher>::collect_stats(uint8_t duration) {
+  uint8_t worker_num = 0, dispatcher_num = 0;
+  /// the TSC is calibrated once, all workspaces convert cycles with the same frequency
+  double avg_freq = context_->tsc_freq_ghz_;
+  for (auto &ws_id : context_->active_ws_id_) {
+    context_->ws_[ws_id]->aggregate_stats(context_->perf_stats_, avg_freq, duration);
+    if (context_->ws_[ws_id]->get_ws_type() & WORKER) {
+      worker_num++;
     }
-    /// Print ws freq for debug
-    double avg_freq = 0;
-    printf("Workspace freqs: ");
-    for (auto &freq : ws_freq) {
-      printf("%.2f ", freq);
-      avg_freq += freq;
+    if (context_->ws_[ws_id]->get_ws_type() & DISPATCHER) {
+      dispatcher_num++;
     }
-    printf("\n");
-    avg_freq /= ws_freq.size();
-    /// Update latency
-    context_->perf_stats_->app_tx_compl_ /= worker_num;
-    context_->perf_stats_->app_tx_compl_avg_ /= worker_num;
-    context_->perf_stats_->app_tx_stall_ /= worker_num;
-    context_->perf_stats_->app_tx_stall_avg_ /= worker_num;
-    context_->perf_stats_->app_rx_compl_ /= worker_num;
-    context_->perf_stats_->app_rx_compl_avg_ /= worker_num;
-    context_->perf_stats_->app_rx_stall_ /= worker_num;
-    context_->perf_stats_->app_rx_stall_avg_ /= worker_num;
-
-    context_->perf_stats_->disp_tx_compl_ /= dispatcher_num;
-    context_->perf_stats_->disp_tx_stall_ /= dispatcher_num;
-    context_->perf_stats_->disp_rx_compl_ /= dispatcher_num;
-    context_->perf_stats_->disp_rx_stall_ /= dispatcher_num;
-
-    context_->perf_stats_->nic_tx_compl_ /= dispatcher_num;
-    context_->perf_stats_->nic_rx_compl_ /= dispatcher_num;
-
-    context_->perf_stats_->disp_mbuf_usage /= dispatcher_num;
-
-    /// calculate P50, P99, P99.9 latency
-    /// sort lat_sample_vector
+  }
+  /// Update latency
+  context_->perf_stats_->app_tx_compl_ /= worker_num;
+  context_->perf_stats_->app_tx_compl_avg_ /= worker_num;
+  context_->perf_stats_->app_tx_stall_ /= worker_num;
+  context_->perf_stats_->app_tx_stall_avg_ /= worker_num;
+  context_->perf_stats_->app_rx_compl_ /= worker_num;
+  context_->perf_stats_->app_rx_compl_avg_ /= worker_num;
+  context_->perf_stats_->app_rx_stall_ /= worker_num;
+  context_->perf_stats_->app_rx_stall_avg_ /= worker_num;
+
+  context_->perf_stats_->disp_tx_compl_ /= dispatcher_num;
+  context_->perf_stats_->disp_tx_stall_ /= dispatcher_num;
+  context_->perf_stats_->disp_rx_compl_ /= dispatcher_num;
+  context_->perf_stats_->disp_rx_stall_ /= dispatcher_num;
+
+  context_->perf_stats_->nic_tx_compl_ /= dispatcher_num;
+  context_->perf_stats_->nic_rx_compl_ /= dispatcher_num;
+
+  context_->perf_stats_->disp_mbuf_usage /= dispatcher_num;
+  if (elastic_config_->enabled_) 
+    printf("App workspaces in use: %.2f of %u\n", context_->perf_stats_->app_cores_, worker_num);
+
+  /// merge the latency histograms of client workers by workload
   #if PERF_TEST_LAT == 1 && NODE_TYPE == CLIENT
-    std::sort(lat_sample_vector, lat_sample_vector + PERF_LAT_SAMPLE_NUM);
-    size_t p50_idx = PERF_LAT_SAMPLE_NUM / 2;
-    size_t p99_idx = PERF_LAT_SAMPLE_NUM * 99 / 100;
-    size_t p999_idx = PERF_LAT_SAMPLE_NUM * 999 / 1000;
-    printf("P50: %.2f, P99: %.2f, P99.9: %.2f\n", to_usec(lat_sample_vector[p50_idx], avg_freq), to_usec(lat_sample_vector[p99_idx], avg_freq), to_usec(lat_sample_vector[p999_idx], avg_freq));
+  std::map<uint8_t, lat_hists*> workload_hists;
+  lat_hists *total_hists = new lat_hists();
+  for (auto &ws_id : context_->active_ws_id_) {
+    auto *ws = context_->ws_[ws_id];
+    if (!(ws->get_ws_type() & WORKER) || ws->get_lat_hists() == nullptr) continue;
+    uint8_t workload_type = ws->get_workload_type();
+    if (workload_hists.count(workload_type) == 0) workload_hists[workload_type] = new lat_hists();
+    workload_hists[workload_type]->merge(*ws->get_lat_hists());
+    total_hists->merge(*ws->get_lat_hists());
+  }
+  auto __print_hist = [&](const char *name, Histogram &hist) {
+    printf("  %-14s %10lu msgs, avg %8.2f, P50 %8.2f, P90 %8.2f, P99 %8.2f, P99.9 %8.2f, P99.99 %8.2f, max %8.2f us\n", 
+           name, hist.get_count(), to_usec(static_cast<size_t>(hist.get_mean()), avg_freq),
+           to_usec(hist.percentile(50), avg_freq), to_usec(hist.percentile(90), avg_freq), 
+           to_usec(hist.percentile(99), avg_freq), to_usec(hist.percentile(99.9), avg_freq),
+           to_usec(hist.percentile(99.99), avg_freq), to_usec(hist.get_max(), avg_freq));
+  };
+  auto __print_hists = [&](lat_hists *hists) {
+    __print_hist("RTT", hists->rtt_);
+  #if PERF_LAT_BREAKDOWN == 1
+    __print_hist("client queue", hists->client_queue_);
+    __print_hist("network+NIC", hists->network_);
+    __print_hist("server", hists->server_);
   #endif
-    stats_init_ws_ = true;
+    /// small and large messages bottleneck different stages, so split the RTT by request size
+    for (uint8_t bucket = 0; bucket < kSizeBucketNum; bucket++) {
+      if (hists->size_rtt_[bucket].get_count() == 0) continue;
+      std::string name = std::string("RTT ") + size_bucket_name(bucket);
+      __print_hist(name.c_str(), hists->size_rtt_[bucket]);
+    }
+  };
+  for (auto &workload_hist : workload_hists) {
+    printf("Latency of workload %u:\n", workload_hist.first);
+    __print_hists(workload_hist.second);
+    delete workload_hist.second;
+  }
+  printf("Latency of all workloads:\n");
+  __print_hists(total_hists);
+  delete total_hists;
+  #endif
+
+  /// merge the server residency of workers by workload, i.e., by RX dispatch policy
+  #if PERF_LAT_BREAKDOWN == 1 && NODE_TYPE == SERVER
+  std::map<uint8_t, Histogram*> server_hists;
+  std::map<uint8_t, uint8_t> server_policies;
+  std::map<uint8_t, bool> server_stealing;
+  for (auto &ws_id : context_->active_ws_id_) {
+    auto *ws = context_->ws_[ws_id];
+    if (!(ws->get_ws_type() & WORKER) || ws->get_server_hist() == nullptr) continue;
+    uint8_t workload_type = ws->get_workload_type();
+    if (server_hists.count(workload_type) == 0) server_hists[workload_type] = new Histogram();
+    server_hists[workload_type]->merge(*ws->get_server_hist());
+    server_policies[workload_type] = ws->get_rx_policy();
+    server_stealing[workload_type] = ws->is_stealing();
+  }
+  for (auto &server_hist : server_hists) {
+    Histogram &hist = *server_hist.second;
+    printf("Server residency of workload %u (%s%s): %lu msgs, avg %.2f, P50 %.2f, P99 %.2f, P99.9 %.2f, max %.2f us\n",
+           server_hist.first, select_policy_name(server_policies[server_hist.first]), 
+           server_stealing[server_hist.first] ? ", work stealing" : "", hist.get_count(),
+           to_usec(static_cast<size_t>(hist.get_mean()), avg_freq), to_usec(hist.percentile(50), avg_freq),
+           to_usec(hist.percentile(99), avg_freq), to_usec(hist.percentile(99.9), avg_freq), to_usec(hist.get_max(), avg_freq));
+    delete server_hist.second;
+  }
+  #endif
+
+  /// cores the workload takes: the loaded cycles of all workspaces per completed message
+  #if PERF_CYCLE_ACCOUNTING == 1
+  double loaded_cores = 0;
+  uint64_t msg_num = 0;
+  for (auto &ws_id : context_->active_ws_id_) {
+    auto *ws = context_->ws_[ws_id];
+    if (ws->get_stats()->window_duration == 0) continue;
+    cycle_breakdown cycles = ws->get_cycle_breakdown();
+    loaded_cores += cycles.loaded() / cycles.window_;
+    if (ws->get_ws_type() & WORKER) msg_num += ws->get_stats()->app_rx_msg_num;
+  }
+  if (msg_num) {
+    printf("Cycle accounting: %.2f cores loaded for %.3f Mmsgs/s, %.2f cores per Mmsgs/s\n",
+           loaded_cores, msg_num / 1e6 / duration, loaded_cores / (msg_num / 1e6 / duration));
+  }
+  #endif
+
+  /// sum the hardware events of each phase over all workspaces
+  #if PERF_HW_COUNTERS == 1
+  struct net_stats *hw_total = new struct net_stats();
+  for (auto &ws_id : context_->active_ws_id_) {
+    struct net_stats *ws_stats = context_->ws_[ws_id]->get_stats();
+    for (size_t phase = 0; phase < kLoopPhaseNum; phase++) {
+      for (size_t i = 0; i < kHwEventNum; i++) hw_total->hw_[phase][i] += ws_stats->hw_[phase][i];
+    }
+    hw_total->nic_rx_pkt_num += ws_stats->nic_rx_pkt_num;
+    hw_total->disp_rx_pkt_num += ws_stats->disp_rx_pkt_num;
+    hw_total->app_rx_msg_num += ws_stats->app_rx_msg_num;
+    hw_total->app_tx_msg_num += ws_stats->app_tx_msg_num;
+    hw_total->disp_tx_pkt_num += ws_stats->disp_tx_pkt_num;
+    hw_total->nic_tx_pkt_num += ws_stats->nic_tx_pkt_num;
+    hw_total->loop_num += ws_stats->loop_num;
+  }
+  printf("Hardware counters per phase, all workspaces:\n");
+  print_hw_phases(" ", hw_total->hw_, hw_total);
+  delete hw_total;
+  #endif
+
+  /// merge the per-stage histograms of all workspaces
+  #if PERF_STATS_HIST == 1
+  Histogram *stage_hists = new Histogram[kStageHistNum];
+  for (auto &ws_id : context_->active_ws_id_) {
+    struct net_stats *ws_stats = context_->ws_[ws_id]->get_stats();
+    for (size_t i = 0; i < kStageHistNum; i++) stage_hists[i].merge(ws_stats->hists[i]);
+  }
+  printf("Stage distributions (cycles in ns):\n");
+  printf("  %-16s %12s %10s %10s %10s %10s %10s %10s\n", 
+         "stage", "samples", "avg", "P50", "P90", "P99", "P99.9", "max");
+  for (size_t i = 0; i < kStageHistNum; i++) {
+    Histogram &hist = stage_hists[i];
+    if (hist.get_count() == 0) continue;
+    /// counts are printed as is, cycles are converted with the average freq
+    double scale = kStageHistInfo[i].is_cycles_ ? 1.0 / avg_freq : 1.0;
+    printf("  %-16s %12lu %10.1f %10.1f %10.1f %10.1f %10.1f %10.1f\n", 
+           kStageHistInfo[i].name_, hist.get_count(), hist.get_mean() * scale,
+           hist.percentile(50) * scale, hist.percentile(90) * scale, hist.percentile(99) * scale,
+           hist.percentile(99.9) * scale, hist.get_max() * scale);
   }
+  delete[] stage_hists;
+  #endif
 }
 
 template <class TDispatcher>
 void Workspace<TDispatcher>::run_event_loop_timeout_st(uint8_t iteration, uint8_t seconds) {
-  size_t core_idx = get_global_index(numa_node_, ws_id_);
-  /// Warmup CPU
-  set_cpu_freq_max(core_idx);
+  /// Warmup CPU, unless main pinned the frequency through cpufreq
+  if (!context_->cpufreq_set_) warm_up_cpu();
+  run_iterations(iteration, seconds);
+  /// Daemon mode: run the iterations again for each request, until a quit request
+  bool leader = (context_->active_ws_id_.front() == ws_id_);
+  while (context_->control_socket_ != nullptr) {
+    wait();
+    if (leader) serve_request();
+    wait();
+    if (context_->quit_) break;
+    apply_tunables();
+    run_iterations(user_config_->get_iteration(), user_config_->get_duration());
+  }
+  /// stop the stats monitor before any workspace is destroyed
+  if (context_->monitor_ != nullptr) {
+    wait();
+    if (leader) context_->monitor_->stop();
+    wait();
+  }
+}
+
+template <class TDispatcher>
+void Workspace<TDispatcher>::run_iterations(uint8_t iteration, uint8_t seconds) {
+  /// select the loop body once, each fused loop is a separate instantiation
+  switch (fused_loop_) {
+    case kDispatcherLoop:       run_event_loop<kDispatcherLoop>(iteration, seconds); break;
+    case kServerWorkerLoop:     run_event_loop<kServerWorkerLoop>(iteration, seconds); break;
+    case kClientWorkerLoop:     run_event_loop<kClientWorkerLoop>(iteration, seconds); break;
+    case kServerDispWorkerLoop: run_event_loop<kServerDispWorkerLoop>(iteration, seconds); break;
+    case kClientDispWorkerLoop: run_event_loop<kClientDispWorkerLoop>(iteration, seconds); break;
+    default:                    run_event_loop<kInterpretedLoop>(iteration, seconds); break;
+  }
+}
+
+template <class TDispatcher>
+void Workspace<TDispatcher>::serve_request() {
+  ControlSocket *control_socket = context_->control_socket_;
+  /// answer the request whose iterations just finished
+  if (context_->control_conn_ >= 0) {
+    std::string reply = "{\"status\": \"ok\", \"iterations\": [";
+    for (size_t i = 0; i < context_->results_.size(); i++) 
+      reply += (i ? ", " : "") + context_->results_[i];
+    control_socket->reply(context_->control_conn_, reply + "]}");
+  }
+  context_->results_.clear();
+
+  std::vector<std::string> lines;
+  std::string cmd;
+  while (true) {
+    context_->control_conn_ = control_socket->accept_request(&lines, &cmd);
+    if (cmd == "quit") {
+      control_socket->reply(context_->control_conn_, "{\"status\": \"ok\", \"iterations\": []}");
+      context_->quit_ = true;
+      return;
+    }
+    UserConfig::tunable_params tune = *user_config_->tune_params_;
+    UserConfig::credit_config credit = *user_config_->credit_config_;
+    UserConfig::server_config server = *user_config_->server_config_;
+    std::string err = user_config_->parse_live_config(lines, &tune, &credit, &server);
+    size_t max_credit_dests = 0;
+    for (auto &dests : user_config_->workloads_config_->workload_remote_dispatcher_map) 
+      max_credit_dests = std::max(max_credit_dests, dests.second.size());
+    if (err.empty()) err = check_tunables(&tune, &credit, mempool_size_, max_credit_dests);
+    if (err.empty()) {
+      *user_config_->tune_params_ = tune;
+      *user_config_->credit_config_ = credit;
+      *user_config_->server_config_ = server;
+      DPERF_INFO("Daemon mode: run %u iterations with %zu changed params\n", server.iteration, lines.size());
+      return;
+    }
+    DPERF_WARN("Daemon mode: rejected a request, %s\n", err.c_str());
+    control_socket->reply_error(context_->control_conn_, err);
+  }
+}
+
+template <class TDispatcher>
+std::string Workspace<TDispatcher>::check_tunables(UserConfig::tunable_params *tune, UserConfig::credit_config *credit, 
+                                                   size_t mempool_size, size_t max_credit_dests) {
+  if (credit->window_ < tune->kAppTxMsgBatchSize || credit->window_ < tune->kAppRxMsgBatchSize) 
+    return "credit window is below the app batch sizes";
+  if (max_credit_dests * credit->max_window_ > kTxMsgLogLen) 
+    return "credit windows allow more than 64K messages in flight";
+  if (kWsQueueSize < tune->kAppTxMsgBatchSize || kWsQueueSize < tune->kAppRxMsgBatchSize) 
+    return "app batch sizes exceed the workspace queue size";
+  if (mempool_size < tune->kAppTxMsgBatchSize * kAppRequestPktsNum 
+      || mempool_size < tune->kAppRxMsgBatchSize * kAppReponsePktsNum) 
+    return "app batch sizes exceed the mempool size";
+  return "";
+}
+
+template <class TDispatcher>
+void Workspace<TDispatcher>::apply_tunables() {
+  UserConfig::tunable_params *tune = user_config_->tune_params_;
+  kAppTxMsgBatchSize = tune->kAppTxMsgBatchSize;
+  kAppRxMsgBatchSize = tune->kAppRxMsgBatchSize;
+  batch_target_us_ = tune->kBatchTargetUs;
+  disp_tx_batch_size_ = tune->kDispTxBatchSize;
+  app_ticks_per_msg_ = tune->kAppTicksPerMsg;
+  if (dispatcher_ != nullptr) {
+    dispatcher_->kDispTxBatchSize = tune->kDispTxBatchSize;
+    dispatcher_->kDispRxBatchSize = tune->kDispRxBatchSize;
+  }
+  /// messages still in flight keep their credits, only the windows restart
+  for (auto &dest : credit_dests_) {
+    credit_window_[dest] = credit_config_->window_;
+    credit_acked_[dest] = 0;
+    credit_cut_tsc_[dest] = 0;
+  }
+  credit_min_window_ = std::max<uint32_t>(kAppTxMsgBatchSize, kAppRxMsgBatchSize);
+  if (steal_ && user_config_->steal_config_->min_backlog_ == 0) steal_min_backlog_ = 2 * kAppRxMsgBatchSize;
+}
+
+template <class TDispatcher>
+template <uint8_t kPhases>
+void Workspace<TDispatcher>::run_event_loop(uint8_t iteration, uint8_t seconds) {
   /// Sync and print stats for each one second
   for (size_t i = 0; i < iteration; i++) {
     /// Loop init
     net_stats_init(stats_);
+    stats_epoch_++;
+    if (publish_) publish_stats();
+    if (lat_hists_ != nullptr) lat_hists_->reset();
+    if (server_hist_ != nullptr) server_hist_->reset();
+    if (dispatcher_ != nullptr) dispatcher_->get_rx_rule_table()->reset_stats();
     nic_rx_prev_desc_ = 0;
-    freq_ghz_ = measure_rdtsc_freq();
+    rdtsc_cycles_ = measure_rdtsc_cost();
+    stats_->probe_cycles = measure_probe_cost();
+    if (reasm_ != nullptr) reasm_->reset_stats();
+    reasm_timeout_tsc_ = us_to_cycles(kReassemblyTimeoutUs, freq_ghz_);
+    credit_target_tsc_ = us_to_cycles(credit_config_->target_rtt_us_, freq_ghz_);
+    rx_batch_.init(kAppRxMsgBatchSize, us_to_cycles(batch_target_us_, freq_ghz_));
+    tx_batch_.init(disp_tx_batch_size_, us_to_cycles(batch_target_us_, freq_ghz_));
+    /// with adaptive batches, nic_tx() is the only stage that waits for a tx batch
+    if (dispatcher_ != nullptr && batch_target_us_ > 0) dispatcher_->kDispTxBatchSize = 1;
+    if (elastic_) reset_elastic();
+    publish_interval_tsc_ = us_to_cycles(kStatsPublishUs, freq_ghz_);
     // printf("Ws %u: Current CPU freq is %.2f\n", ws_id_, freq);
     size_t timeout_tsc = ms_to_cycles(1000*seconds, freq_ghz_);
-    size_t interval_tsc = us_to_cycles(1.0, freq_ghz_);  // launch an event loop once per one us
+    /// loop pacing, the interval only applies to kPacingInterval
+    size_t interval_tsc = us_to_cycles(pacing_->interval_us_, freq_ghz_);
+    size_t backoff_max_tsc = us_to_cycles(pacing_->backoff_max_us_, freq_ghz_);
+    size_t backoff_min_tsc = std::max<size_t>(backoff_max_tsc >> 4, 1);
+    size_t backoff_tsc = backoff_min_tsc;
+    uint32_t empty_polls = 0;
+    if (schedule_ != nullptr) {
+      schedule_->init(load_config_->rate_, load_config_->dist_, load_config_->on_us_, load_config_->off_us_, freq_ghz_);
+      late_tsc_ = us_to_cycles(kOpenLoopLateUs, freq_ghz_);
+    }
     wait();
 
     /* Start loop */
+    if (schedule_ != nullptr) schedule_->start(rdtsc());
     /// random start
     size_t wait_tsc = rdtsc(), random_tsc = context_->dis_(context_->gen_);
     while (rdtsc() - wait_tsc < random_tsc) {
-      launch();
+      launch_fused<kPhases>();
     }
     
     // printf("[Workspace %u] Start event loop, waiting for %lu\n", ws_id_, random_tsc);
     size_t start_tsc = rdtsc();
     size_t loop_tsc = start_tsc;
-    size_t lat_start_tick = start_tsc;
-    size_t lat_sended_pkt_num = 0;
+    size_t now_tsc = start_tsc;   // the only TSC read of a spin
     nic_rx_prev_tick_ = start_tsc;
+    elastic_next_tsc_ = start_tsc;
+    publish_next_tsc_ = start_tsc;
+    housekeeping_tsc_ = (elastic_ || publish_) ? start_tsc : SIZE_MAX;
     while (true) {
-      if (rdtsc() - loop_tsc > interval_tsc) {
-        loop_tsc = rdtsc();
-        launch();
-        /// latency stats
-      #if PERF_TEST_LAT == 1 && NODE_TYPE == CLIENT
-        if (unlikely(lat_sended_pkt_num < stats_->app_rx_msg_num)) {
-          // 使用单次rdtscp调用优化
-          size_t end_tick = dpath_rdtsc();
-          lat_sample_vector[lat_sample_idx] = end_tick - lat_start_tick;
-          lat_sample_idx = (lat_sample_idx + 1) % PERF_LAT_SAMPLE_NUM;
-          lat_start_tick = end_tick;  // 重用时间戳，减少一次rdtsc调用
-          lat_sended_pkt_num = stats_->app_tx_msg_num;
+      if (pacing_->policy_ != kPacingInterval || now_tsc - loop_tsc > interval_tsc) {
+        loop_tsc = now_tsc;
+        size_t progress = loop_progress();
+        launch_fused<kPhases>();
+        bool idle = (progress == loop_progress());
+        now_tsc = rdtsc();
+        net_stats_loop(idle, now_tsc - loop_tsc);
+        if (elastic_ && !idle) busy_tsc_.store(busy_tsc_.load(std::memory_order_relaxed) + now_tsc - loop_tsc, std::memory_order_relaxed);
+        if (pacing_->policy_ == kPacingBackoff) {
+          /// back off after consecutive empty polls, leave backoff at the first non-empty poll
+          if (!idle) {
+            empty_polls = 0;
+            backoff_tsc = backoff_min_tsc;
+          } else if (++empty_polls >= pacing_->backoff_thresh_) {
+            wait_until_tsc(now_tsc + backoff_tsc);
+            size_t wake_tsc = rdtsc();
+            net_stats_backoff(wake_tsc - now_tsc);
+            now_tsc = wake_tsc;
+            backoff_tsc = std::min(backoff_tsc << 1, backoff_max_tsc);
+          }
         }
+      } else {
+      #if PERF_CYCLE_ACCOUNTING == 1
+        size_t spin_tsc = rdtsc();
+        net_stats_pacing(spin_tsc - now_tsc);
+        now_tsc = spin_tsc;
+      #else
+        now_tsc = rdtsc();
       #endif
       }
-      if (unlikely(rdtsc() - start_tsc > timeout_tsc)) {
-        /// Only the first workspace records the stats
-        update_stats(seconds);
+      if (unlikely(now_tsc >= housekeeping_tsc_)) now_tsc = housekeeping(now_tsc, start_tsc + timeout_tsc);
+      if (unlikely(now_tsc - start_tsc > timeout_tsc)) {
+        stats_->window_duration = now_tsc - start_tsc;
+        if (publish_) publish_stats();
+        update_stats();
         break;
       }
     }
     /* Loop End */
-    /// continue loop until all workspaces are completed
-    while ((ws_type_ & DISPATCHER) && context_->completed_ws_num_ != context_->active_ws_id_.size()) {
-      // printf("[Workspace %u] Waiting for other workspaces to complete, %u, %lu\n", ws_id_, context_->completed_ws_num_, context_->active_ws_id_.size());
-      launch();
-      /// waiting for 100ms
-      wait_tsc = rdtsc();
-      while (rdtsc() - wait_tsc < ms_to_cycles(100, freq_ghz_)) {
-        continue;
+    /// keep dispatching until all workspaces are completed, the stats stay as they were at the timeout
+    if (ws_type_ & DISPATCHER) {
+      struct net_stats *stats = stats_;
+      stats_ = drain_stats_;
+      while (context_->completed_ws_num_ != context_->active_ws_id_.size()) {
+        launch_fused<kPhases>();
       }
+      stats_ = stats;
     }
     wait();
-    /// Print and reset stats
+    /// Collect stats, all workspaces have stopped. Only what reads their counters runs
+    /// between the barriers, printing and writing the results overlaps the next iteration.
+    std::vector<net_stats> ws_stats;
     if (stats_init_ws_) {
-      context_->perf_stats_->print_perf_stats(seconds);
-      context_->init_perf_stats();
+      collect_stats(seconds);
+      /// the result file needs the counters after the workspaces reset them
+      if (context_->results_writer_ != nullptr) {
+        for (auto &ws_id : context_->active_ws_id_) ws_stats.push_back(*context_->ws_[ws_id]->get_stats());
+      }
       context_->end_signal_ = false;
       context_->completed_ws_num_ = 0;
+    }
+    /// nobody resets its stats, histograms or rule tables (or exits) before the collector read them
+    wait();
+    if (stats_init_ws_) {
+      context_->perf_stats_->print_perf_stats(seconds);
+      if (context_->control_socket_ != nullptr) context_->results_.push_back(context_->perf_stats_->to_json());
+      if (context_->results_writer_ != nullptr) {
+        std::vector<ResultsWriter::ws_result> results;
+        for (size_t j = 0; j < context_->active_ws_id_.size(); j++) {
+          auto *ws = context_->ws_[context_->active_ws_id_[j]];
+          uint8_t workload_type = (ws->get_ws_type() & WORKER) ? ws->get_workload_type() : kInvalidWorkloadType;
+          results.push_back({ws->get_ws_id(), ws->get_ws_type(), workload_type, ws->get_freq(), &ws_stats[j]});
+        }
+        context_->results_writer_->write(context_->iteration_num_, seconds, *context_->perf_stats_, results);
+      }
+      context_->iteration_num_++;
+      context_->init_perf_stats();
       stats_init_ws_ = false;
     }
   }
-  set_cpu_freq_normal(core_idx);
 }
 
 FORCE_COMPILE_DISPATCHER
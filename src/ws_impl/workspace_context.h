@@ -6,8 +6,10 @@
 #include "common.h"
 #include "dispatcher.h"
 #include "util/barrier.h"
+#include "util/control_socket.h"
 #include "util/lock_free_queue.h"
 #include "util/net_stats.h"
+#include "util/timer.h"
 
 #include <mutex>
 #include <vector>
@@ -18,6 +20,8 @@
 namespace dperf {
 template <class TDispatcher>
 class Workspace;
+class StatsMonitor;
+class ResultsWriter;
 
 class WsContext {
   /**
@@ -33,7 +37,7 @@ class WsContext {
    */ 
   public:
     /// Init
-    WsContext(ThreadBarrier *barrier) : barrier_(barrier) {
+    WsContext(ThreadBarrier *barrier) : barrier_(barrier), tsc_freq_ghz_(calibrate_tsc_freq_ghz()) {
       for (size_t i = 0; i < kWorkspaceMaxNum; i++)
         ws_[i] = nullptr;
       perf_stats_init(perf_stats_);
@@ -64,6 +68,12 @@ class WsContext {
     std::map<uint8_t, Dispatcher::mem_reg_info<MEM_REG_TYPE>*> mem_reg_map_; // Map ws_id to mem_reg_info
     std::map<uint8_t, uint8_t> ws_id_dispatcher_map_;               // ws_id -> dispatcher_ws_id
     ThreadBarrier *barrier_ = nullptr;                              // barrier for all workspaces
+    const double tsc_freq_ghz_;                                     // calibrated once for all workspaces
+    bool cpufreq_set_ = false;                                      // cores pinned to max freq by main
+  #ifdef RoceMode
+    std::map<uint16_t, QPInfo> local_qp_info_;                      // (local, remote dispatcher) -> local QP info
+    std::map<uint16_t, QPInfo> remote_qp_info_;                     // (remote, local dispatcher) -> remote QP info
+  #endif
 
     // random
     std::random_device rd_;
@@ -76,5 +86,17 @@ class WsContext {
     /// End
     volatile bool end_signal_ = false;
     volatile uint8_t completed_ws_num_ = 0;
+
+    /// Daemon mode, the request is read by the first active workspace between barriers
+    ControlSocket *control_socket_ = nullptr;
+    int control_conn_ = -1;                     // connection of the request being served
+    bool quit_ = false;
+    std::vector<std::string> results_;          // perf stats of each iteration of the request, as JSON
+
+    /// Samples the stats while the workspaces run, nullptr without stats_interval
+    StatsMonitor *monitor_ = nullptr;
+    /// Writes the stats of each iteration, nullptr without result_file
+    ResultsWriter *results_writer_ = nullptr;
+    size_t iteration_num_ = 0;                  // iterations completed, across daemon requests
 };
 }
\ No newline at end of file
@@ -4,6 +4,40 @@
 namespace dperf {
 struct ws_hdr {
     uint8_t workload_type_;
-    size_t segment_num_;
+    uint8_t segment_num_;
+    uint8_t seg_idx_;       // index of this segment in its message
+    uint8_t src_ws_id_;     // client workspace that sent the request, echoed in the response
+    uint16_t msg_id_;       // per client workspace message id, echoed in the response
+    uint16_t resp_size_;    // request: response payload size the server returns, 0 for the built-in size
+    uint64_t send_tsc_;     // TSC the request was (scheduled to be) sent at, echoed in the response
+};
+/// Payload sizes in common.h are chosen for a 16-byte ws_hdr
+static_assert(sizeof(ws_hdr) == 16, "ws_hdr must stay 16 bytes");
+
+/**
+ * @brief Hash of the message a segment belongs to, so that a dispatcher
+ * steers all segments of a message to the same worker for reassembly
+ */
+static inline uint32_t ws_msg_hash(uint16_t src_port, const ws_hdr *hdr) {
+    return (((static_cast<uint32_t>(src_port) << 24) ^ hdr->msg_id_) * 2654435761u) >> 8;
+}
+
+/**
+ * @brief Hash of the flow a message belongs to, i.e., its client workspace,
+ * for flow-affinity dispatch (kSelectFlowHash)
+ */
+static inline uint32_t ws_flow_hash(uint16_t src_port, const ws_hdr *hdr) {
+    return (((static_cast<uint32_t>(src_port) << 8) ^ hdr->src_ws_id_) * 2654435761u) >> 8;
+}
+
+/**
+ * @brief Timestamps at the head of the payload for the latency breakdown
+ * (PERF_LAT_BREAKDOWN), echoed back to the client in the response
+ */
+struct ws_ts {
+    uint64_t client_tx_tsc_;    // the client dispatcher flushes the request to the NIC
+    /// request: the TSC the server dispatcher dispatches it at; 
+    /// response: server residency in ns, from then until the response is queued
+    uint64_t server_ts_;
 };
 } // namespace dperf
\ No newline at end of file
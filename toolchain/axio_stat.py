@@ -0,0 +1,78 @@
+import mmap, os, struct, sys, time
+
+# Layout of stats_shm_layout in src/util/stats_shm.h, keep both in sync
+MAGIC = 0x5441545343495841
+VERSION = 1
+WS_MAX = 16
+HEADER = struct.Struct(f"<QIIII{WS_MAX}s{WS_MAX}s{WS_MAX}s")
+SEQ = struct.Struct("<Q")
+SAMPLE_FIELDS = ["epoch", "app_tx", "app_rx", "disp_tx", "disp_rx", "nic_tx", "nic_rx", "drops", "loops", "idle_loops"]
+SNAPSHOT = struct.Struct("<Q" + "Q" * len(SAMPLE_FIELDS) * WS_MAX)
+SEQ_OFFSET = HEADER.size
+SNAPSHOT_OFFSET = SEQ_OFFSET + SEQ.size
+WS_TYPES = {1: "disp", 2: "app", 3: "disp+app"}
+
+class StatsReader:
+    """Read-only view of the live counters an axio process publishes with stats_shm.
+
+    Reading never touches the datapath: the stats monitor thread of axio copies the
+    counters into the segment under a seqlock, and a reader retries a torn copy.
+    """
+    def __init__(self, name):
+        path = "/dev/shm/" + name.lstrip("/")
+        with open(path, "rb") as f:
+            self.shm = mmap.mmap(f.fileno(), 0, prot=mmap.PROT_READ)
+        magic, version, _, self.interval_ms, self.pid, _, _, _ = HEADER.unpack_from(self.shm, 0)
+        if magic != MAGIC or version != VERSION:
+            raise ValueError(f"{path} is not an axio stats segment of version {VERSION}")
+        # the header is complete once the workspaces registered
+        while HEADER.unpack_from(self.shm, 0)[2] == 0:
+            time.sleep(self.interval_ms / 1000)
+        _, _, self.ws_num, _, _, ws_id, ws_type, workload = HEADER.unpack_from(self.shm, 0)
+        self.ws_id, self.ws_type, self.workload = ws_id[:self.ws_num], ws_type[:self.ws_num], workload[:self.ws_num]
+
+    def snapshot(self):
+        """Return (time_ns, [dict of SAMPLE_FIELDS per workspace])."""
+        while True:
+            seq0 = SEQ.unpack_from(self.shm, SEQ_OFFSET)[0]
+            values = SNAPSHOT.unpack_from(self.shm, SNAPSHOT_OFFSET)
+            seq1 = SEQ.unpack_from(self.shm, SEQ_OFFSET)[0]
+            if seq0 == seq1 and seq0 % 2 == 0:
+                break
+        n = len(SAMPLE_FIELDS)
+        samples = [dict(zip(SAMPLE_FIELDS, values[1 + i * n: 1 + (i + 1) * n])) for i in range(self.ws_num)]
+        return values[0], samples
+
+def render(reader, prev, cur):
+    """Print the rates between two snapshots, per workspace and in total."""
+    elapsed_us = (cur[0] - prev[0]) / 1000
+    if elapsed_us <= 0:
+        return
+    print(f"{'ws':>4} {'type':>9} {'wl':>3} " + " ".join(f"{s + ' Mpps':>12}" for s in SAMPLE_FIELDS[1:7]) + f" {'drops':>10} {'idle %':>7}")
+    total = dict.fromkeys(SAMPLE_FIELDS[1:], 0)
+    for i, (last, now) in enumerate(zip(prev[1], cur[1])):
+        if now["epoch"] != last["epoch"]:   # a new iteration restarted the counters
+            last = dict.fromkeys(SAMPLE_FIELDS, 0)
+        delta = {k: now[k] - last[k] for k in SAMPLE_FIELDS[1:]}
+        for k in delta:
+            total[k] += delta[k]
+        workload = "-" if reader.workload[i] == 255 else str(reader.workload[i])
+        print(f"{reader.ws_id[i]:>4} {WS_TYPES.get(reader.ws_type[i], '?'):>9} {workload:>3} "
+              + " ".join(f"{delta[k] / elapsed_us:>12.3f}" for k in SAMPLE_FIELDS[1:7])
+              + f" {delta['drops']:>10} {100 * delta['idle_loops'] / max(delta['loops'], 1):>7.2f}")
+    print(f"{'all':>4} {'':>9} {'':>3} " + " ".join(f"{total[k] / elapsed_us:>12.3f}" for k in SAMPLE_FIELDS[1:7])
+          + f" {total['drops']:>10} {100 * total['idle_loops'] / max(total['loops'], 1):>7.2f}\n")
+
+if __name__ == "__main__":
+    # e.g., python3 axio_stat.py axio_stats 1000
+    if len(sys.argv) < 2:
+        print(f"Usage: {sys.argv[0]} <stats_shm name> [refresh ms]")
+        sys.exit(1)
+    reader = StatsReader(sys.argv[1])
+    refresh_ms = int(sys.argv[2]) if len(sys.argv) > 2 else max(reader.interval_ms, 1000)
+    prev = reader.snapshot()
+    while os.path.exists(f"/proc/{reader.pid}"):
+        time.sleep(refresh_ms / 1000)
+        cur = reader.snapshot()
+        render(reader, prev, cur)
+        prev = cur
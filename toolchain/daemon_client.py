@@ -0,0 +1,30 @@
+import json, socket, sys
+
+def request(sock_path, params=None, cmd="run"):
+    """Send tunable params to an axio daemon (control_socket) and return its JSON reply.
+
+    With cmd="run", the daemon runs its iterations with the new params and replies with
+    the stats of each iteration, e.g., reply["iterations"][i]["e2e"]["mpps"].
+    """
+    lines = [f"{key} : {value}" for key, value in (params or {}).items()] + [cmd]
+    with socket.socket(socket.AF_UNIX, socket.SOCK_STREAM) as s:
+        s.connect(sock_path)
+        s.sendall(("\n".join(lines) + "\n").encode())
+        reply = b""
+        while True:
+            chunk = s.recv(4096)
+            if not chunk:
+                break
+            reply += chunk
+    return json.loads(reply.decode())
+
+if __name__ == "__main__":
+    # e.g., python3 daemon_client.py /tmp/axio.sock kAppRxMsgBatchSize=16 duration=2
+    #       python3 daemon_client.py /tmp/axio.sock quit
+    if len(sys.argv) < 2:
+        print(f"Usage: {sys.argv[0]} <control socket> [key=value ...] [quit]")
+        sys.exit(1)
+    args = sys.argv[2:]
+    cmd = "quit" if "quit" in args else "run"
+    params = dict(arg.split("=", 1) for arg in args if arg != "quit")
+    print(json.dumps(request(sys.argv[1], params, cmd), indent=2))